@@ -0,0 +1,500 @@
+// libfm microbenchmarks: ns/sample and voices per core for the voice
+// renderers and their building blocks, as a table or as JSON for tracking
+// regressions between builds.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "libfm/adsr.hpp"
+#include "libfm/fm_bank.hpp"
+#include "libfm/fm_channel.hpp"
+#include "libfm/noise_channel.hpp"
+#include "libfm/pulse_bank.hpp"
+#include "libfm/pulse_channel.hpp"
+#include "libfm/render_pool.hpp"
+#include "libfm/sigma_delta.hpp"
+#include "libfm/simd.hpp"
+#include "libfm/tables.hpp"
+
+namespace {
+
+constexpr int BLOCK_SIZE = 64;       // Audio::audioThread's buffer size
+constexpr int SAMPLE_RATE = 48000;   // standalone synth's output rate
+constexpr int VSYNC_SAMPLES = 525;   // envelope tick interval in Audio
+constexpr int BANK_VOICES = 64;
+
+struct Result {
+  std::string group;
+  std::string name;
+  double ns_per_sample;  // per voice-sample, or per call for the primitives
+  int voices;            // voices rendered per sample, 0 for primitives
+};
+
+// Real-time voices one core could sustain at SAMPLE_RATE.
+double voicesPerCore(const Result& r) {
+  if (r.voices == 0) {
+    return 0;
+  }
+  return 1e9 / SAMPLE_RATE / r.ns_per_sample;
+}
+
+// Best-of-5 ns per unit for `iterations` calls of fn, each doing `units` units
+// of work.
+template <class Fn>
+double timeBest(int iterations, int units, Fn fn) {
+  double best = 1e30;
+  for (int rep = 0; rep < 5; rep++) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++) {
+      fn();
+    }
+    auto end = std::chrono::steady_clock::now();
+    double ns = std::chrono::duration<double, std::nano>(end - start).count();
+    if (ns < best) {
+      best = ns;
+    }
+  }
+  return best / (static_cast<double>(iterations) * units);
+}
+
+// Keeps results of the primitive benchmarks alive.
+volatile int sink;
+
+std::string pulseFeatureName(unsigned features) {
+  char name[64];
+  snprintf(name, sizeof(name), "%s %s %s %s %s",
+           features & fm::PULSE_KERNEL_LPF ? "lpf" : "---",
+           features & fm::PULSE_KERNEL_QUARTER_DUTY ? "25%" : "50%",
+           features & fm::PULSE_KERNEL_UNIT_MULTIPLIER ? "mul1" : "mulN",
+           features & fm::PULSE_KERNEL_NO_DETUNE ? "det0" : "detN",
+           features & fm::PULSE_KERNEL_VIBRATO ? "vib" : "---");
+  return name;
+}
+
+// Config and voice state exercising exactly the given kernel features.
+void pulseSetup(unsigned features, fm::PulseConfig* config, fm::PulseState* state) {
+  config->sample_rate = SAMPLE_RATE;
+  config->lpf_enabled = features & fm::PULSE_KERNEL_LPF;
+  config->lpf_k1 = 2;
+  config->lpf_k2 = 3;
+  config->pulse_width = features & fm::PULSE_KERNEL_QUARTER_DUTY ? 1 : 0;
+  config->carrier_multiplier = features & fm::PULSE_KERNEL_UNIT_MULTIPLIER ? 1 : 2;
+  config->detune = features & fm::PULSE_KERNEL_NO_DETUNE ? 0 : 3;
+  state->noteOn(60, 100, *config);
+  state->vibrato_level = features & fm::PULSE_KERNEL_VIBRATO ? 8 : 0;
+}
+
+std::string fmFeatureName(unsigned features) {
+  std::string name = features & fm::FM_KERNEL_FEEDBACK ? "feedback" : "--------";
+  name += features & fm::FM_KERNEL_CARRIER_DECAY ? " decay" : " -----";
+  return name;
+}
+
+void fmSetup(unsigned features, fm::FMConfig* config) {
+  config->sample_rate = SAMPLE_RATE;
+  config->modulation_feedback = features & fm::FM_KERNEL_FEEDBACK ? 6 : 0;
+  config->carrier_decay = features & fm::FM_KERNEL_CARRIER_DECAY ? 4 : 0;
+}
+
+void benchPulse(int blocks, std::vector<Result>* results) {
+  for (unsigned features = 0; features < fm::PULSE_KERNEL_COUNT; features++) {
+    fm::PulseConfig config;
+    fm::PulseState state;
+    pulseSetup(features, &config, &state);
+    int16_t buffer[BLOCK_SIZE] = {};
+
+    std::string name = pulseFeatureName(features);
+    results->push_back({"pulse", name, timeBest(blocks, BLOCK_SIZE, [&] {
+      state.render(buffer, BLOCK_SIZE, config);
+    }), 1});
+    results->push_back({"pulse_generic", name, timeBest(blocks, BLOCK_SIZE, [&] {
+      fm::pulseRenderGeneric(state, buffer, BLOCK_SIZE, config);
+    }), 1});
+  }
+}
+
+void benchFM(int blocks, std::vector<Result>* results) {
+  for (unsigned features = 0; features < fm::FM_KERNEL_COUNT; features++) {
+    fm::FMConfig config;
+    fmSetup(features, &config);
+    fm::FMState state;
+    state.noteOn(60, 100, config);
+    int16_t buffer[BLOCK_SIZE] = {};
+
+    std::string name = fmFeatureName(features);
+    results->push_back({"fm", name, timeBest(blocks, BLOCK_SIZE, [&] {
+      state.render(buffer, BLOCK_SIZE, config);
+    }), 1});
+    results->push_back({"fm_generic", name, timeBest(blocks, BLOCK_SIZE, [&] {
+      fm::fmRenderGeneric(state, buffer, BLOCK_SIZE, config);
+    }), 1});
+  }
+}
+
+void benchBanks(int blocks, std::vector<Result>* results) {
+  const int bank_blocks = blocks / BANK_VOICES + 1;
+  {
+    fm::PulseConfig config;
+    config.sample_rate = SAMPLE_RATE;
+    fm::PulseBank bank(BANK_VOICES);
+    for (int v = 0; v < BANK_VOICES; v++) {
+      bank.noteOn(v, 36 + v, 100, config);
+    }
+    int16_t buffer[BLOCK_SIZE] = {};
+    results->push_back({"pulse_bank", fm::simdLevelName(bank.simdLevel()),
+                        timeBest(bank_blocks, BLOCK_SIZE * BANK_VOICES, [&] {
+                          bank.render(buffer, BLOCK_SIZE, config);
+                        }), BANK_VOICES});
+  }
+  {
+    fm::FMConfig config;
+    config.sample_rate = SAMPLE_RATE;
+    fm::FMBank bank(BANK_VOICES);
+    for (int v = 0; v < BANK_VOICES; v++) {
+      bank.noteOn(v, 36 + v, 100, config);
+    }
+    int16_t buffer[BLOCK_SIZE] = {};
+    results->push_back({"fm_bank", fm::simdLevelName(bank.simdLevel()),
+                        timeBest(bank_blocks, BLOCK_SIZE * BANK_VOICES, [&] {
+                          bank.render(buffer, BLOCK_SIZE, config);
+                        }), BANK_VOICES});
+  }
+}
+
+// ADSRState::step through whole note cycles, as FMState::render calls it.
+void benchAdsr(int blocks, std::vector<Result>* results) {
+  fm::ADSR config;
+  config.attack_speed = 1;
+  config.decay_speed = 3;
+  config.release_speed = 2;
+  config.sustain = 5;
+  fm::ADSRState state;
+  int count = 0;
+  results->push_back({"adsr", "step", timeBest(blocks, BLOCK_SIZE, [&] {
+    int value = 0;
+    for (int i = 0; i < BLOCK_SIZE; i++) {
+      int carry = count ^ (count + 1);
+      count++;
+      if ((count & 0x3fff) == 0) {
+        state.trigger();
+      } else if ((count & 0x3fff) == 0x2000) {
+        state.release();
+      }
+      value += state.step(carry, config);
+    }
+    sink = value;
+  }), 0});
+}
+
+// One logsin9 -> iexp11 lookup pair per call, sweeping phase and attenuation.
+void benchTables(int blocks, std::vector<Result>* results) {
+  int phase = 0;
+  results->push_back({"tables", "logsin9+iexp11", timeBest(blocks, BLOCK_SIZE, [&] {
+    int value = 0;
+    for (int i = 0; i < BLOCK_SIZE; i++) {
+      int sign = 1;
+      int l = fm::logsin9(phase & 0x1ff, &sign) + ((phase >> 9) & 0xff);
+      value += fm::iexp11(l) * sign;
+      phase += 7;
+    }
+    sink = value;
+  }), 0});
+
+  // note-on cost: phase increment plus velocity attenuation per note
+  fm::PulseConfig pulse_config;
+  pulse_config.sample_rate = SAMPLE_RATE;
+  results->push_back({"tables", "note-on pitch+velocity", timeBest(blocks, 128, [&] {
+    int value = 0;
+    for (int note = 0; note < 128; note++) {
+      value += fm::pulsePhaseInc(note, pulse_config) + fm::velocityToLogatten(note);
+    }
+    sink = value;
+  }), 0});
+}
+
+// Audio::audioThread's inner loop: four PulseStates mixed into a 64-sample
+// buffer, split at envelope ticks every VSYNC_SAMPLES samples.
+void benchMix(int blocks, std::vector<Result>* results) {
+  fm::PulseConfig config;
+  config.sample_rate = SAMPLE_RATE;
+  fm::PulseState voices[4];
+  const int notes[4] = {48, 55, 60, 64};
+  for (int i = 0; i < 4; i++) {
+    voices[i].noteOn(notes[i], 100, config);
+  }
+  int16_t buffer[BLOCK_SIZE];
+  int vsync_counter = 0;
+  results->push_back({"mix", "audio_thread 4 voices", timeBest(blocks, BLOCK_SIZE * 4, [&] {
+    memset(buffer, 0, sizeof(buffer));
+    int samples_to_render = BLOCK_SIZE;
+    int offset = 0;
+    while (samples_to_render > 0) {
+      int runlength = samples_to_render;
+      if (vsync_counter + runlength > VSYNC_SAMPLES) {
+        runlength = VSYNC_SAMPLES - vsync_counter;
+      }
+      for (int i = 0; i < 4; i++) {
+        voices[i].render(buffer + offset, runlength, config);
+      }
+      samples_to_render -= runlength;
+      offset += runlength;
+      vsync_counter += runlength;
+      if (vsync_counter >= VSYNC_SAMPLES) {
+        for (int i = 0; i < 4; i++) {
+          voices[i].tickEnvelopes(config);
+        }
+        vsync_counter = 0;
+      }
+    }
+  }), 4});
+}
+
+// Audio::renderVoices: BANK_VOICES PulseStates in jobs of 4, each job summed
+// into its own int32 row, serially and split over a RenderPool.
+struct PoolMix {
+  static constexpr int VOICES_PER_JOB = 4;
+  static constexpr int JOBS = BANK_VOICES / VOICES_PER_JOB;
+  fm::PulseConfig config;
+  fm::PulseState voices[BANK_VOICES];
+  int32_t rows[JOBS][BLOCK_SIZE];
+
+  static void job(void* arg, int job) {
+    PoolMix* mix = static_cast<PoolMix*>(arg);
+    memset(mix->rows[job], 0, sizeof(mix->rows[job]));
+    for (int k = job * VOICES_PER_JOB; k < (job + 1) * VOICES_PER_JOB; k++) {
+      int16_t voice[BLOCK_SIZE] = {};
+      mix->voices[k].render(voice, BLOCK_SIZE, mix->config);
+      for (int i = 0; i < BLOCK_SIZE; i++) {
+        mix->rows[job][i] += voice[i];
+      }
+    }
+  }
+};
+
+void benchPool(int blocks, std::vector<Result>* results) {
+  PoolMix mix;
+  mix.config.sample_rate = SAMPLE_RATE;
+  for (int i = 0; i < BANK_VOICES; i++) {
+    mix.voices[i].noteOn(36 + i, 100, mix.config);
+  }
+  results->push_back({"pool", "serial", timeBest(blocks, BLOCK_SIZE * BANK_VOICES, [&] {
+    for (int job = 0; job < PoolMix::JOBS; job++) {
+      PoolMix::job(&mix, job);
+    }
+  }), BANK_VOICES});
+
+  int cores = std::thread::hardware_concurrency();
+  for (int workers : {1, 3, 7}) {
+    if (workers >= cores) {
+      break;
+    }
+    fm::RenderPool pool(workers);
+    char name[64];
+    snprintf(name, sizeof(name), "%d workers", workers);
+    results->push_back({"pool", name, timeBest(blocks, BLOCK_SIZE * BANK_VOICES, [&] {
+      pool.run(PoolMix::job, &mix, PoolMix::JOBS);
+    }), BANK_VOICES});
+    snprintf(name, sizeof(name), "%d workers dispatch", workers);
+    results->push_back({"pool", name, static_cast<double>(pool.dispatchOverheadNs()), 0});
+  }
+}
+
+// A noise voice hit every 40 ticks (every eighth song position, as in the
+// song's snare track) and mostly decayed to silence in between, against the
+// one-shift-per-sample loop NoiseState replaces.
+struct SerialNoise {
+  uint32_t lfsr;
+  int volume;
+  int tick_count{0};
+  int phase{0};
+
+  explicit SerialNoise(fm::NoiseVariant variant)
+      : lfsr(variant == fm::NOISE_CHIP ? 0x7fff : 0x1caf), volume(variant == fm::NOISE_CHIP ? 15 : 16) {}
+
+  void render(int16_t* buffer, int num_samples, const fm::NoiseConfig& config) {
+    for (int i = 0; i < num_samples; i++, phase++) {
+      if (config.variant == fm::NOISE_CHIP) {
+        uint32_t bit = lfsr & 1;
+        lfsr = (bit << 14) | ((bit ^ (lfsr >> 14)) << 13) | ((lfsr >> 1) & 0x1fff);
+        buffer[i] += volume == 15 ? 0 : (lfsr & 0xff) >> (volume >> 1);
+      } else {
+        if ((phase & 1) == 0) {
+          lfsr = ((lfsr & 0x8000) ? ((lfsr << 1) ^ 0x8016) : (lfsr << 1)) & 0xffff;
+        }
+        buffer[i] += lfsr >> (volume + 1);
+      }
+    }
+  }
+  void tickEnvelopes(const fm::NoiseConfig& config) {
+    phase = 0;
+    int silent = config.variant == fm::NOISE_CHIP ? 15 : 16;
+    if (++tick_count >= config.decay) {
+      tick_count = 0;
+      if (volume < silent) {
+        volume++;
+      }
+    }
+  }
+  void trigger(const fm::NoiseConfig& config) {
+    volume = config.variant == fm::NOISE_CHIP ? 0 : 1;
+  }
+};
+
+template <class Voice>
+double timeNoise(int blocks, Voice& voice, const fm::NoiseConfig& config) {
+  int16_t buffer[BLOCK_SIZE] = {};
+  int vsync_counter = 0;
+  int ticks = 0;
+  return timeBest(blocks, BLOCK_SIZE, [&] {
+    int offset = 0;
+    while (offset < BLOCK_SIZE) {
+      int runlength = std::min(BLOCK_SIZE - offset, VSYNC_SAMPLES - vsync_counter);
+      voice.render(buffer + offset, runlength, config);
+      offset += runlength;
+      vsync_counter += runlength;
+      if (vsync_counter == VSYNC_SAMPLES) {
+        vsync_counter = 0;
+        if (++ticks % 40 == 0) {
+          voice.trigger(config);
+        }
+        voice.tickEnvelopes(config);
+      }
+    }
+    sink = buffer[0];
+  });
+}
+
+void benchNoise(int blocks, std::vector<Result>* results) {
+  for (fm::NoiseVariant variant : {fm::NOISE_CHIP, fm::NOISE_SNARE}) {
+    fm::NoiseConfig config(variant);
+    fm::NoiseState state(config);
+    SerialNoise serial(variant);
+    const char* name = variant == fm::NOISE_CHIP ? "chip" : "snare";
+    results->push_back({"noise", name, timeNoise(blocks, state, config), 1});
+    results->push_back({"noise_serial", name, timeNoise(blocks, serial, config), 1});
+  }
+}
+
+// SigmaDeltaDecimator on one VGA frame of the chip's audio pin at a time: a
+// first-order sigma-delta of a 440 Hz square wave, like music.v's DAC. ns per output
+// sample, i.e. per SIGMA_DELTA_DECIMATION bits.
+void benchSigmaDelta(int blocks, std::vector<Result>* results) {
+  const int frame_samples = VSYNC_SAMPLES;
+  std::vector<uint8_t> bits(frame_samples * fm::SIGMA_DELTA_DECIMATION / 8);
+  int accum = 0;
+  for (int line = 0; line < frame_samples; line++) {
+    int x = 4096 + (line * 440 % 30000 < 15000 ? 2000 : -2000);
+    for (int c = 0; c < fm::SIGMA_DELTA_DECIMATION; c++) {
+      int clk = line * fm::SIGMA_DELTA_DECIMATION + c;
+      accum += x;
+      bits[clk >> 3] |= ((accum >> 13) & 1) << (clk & 7);
+      accum &= 0x1fff;
+    }
+  }
+  std::vector<int16_t> out(frame_samples + 1);
+  const int frames = blocks / 100 + 1;
+  for (fm::SimdLevel level : {fm::SIMD_SCALAR, fm::detectSimdLevel()}) {
+    fm::SigmaDeltaDecimator decimator;
+    decimator.setSimdLevel(level);
+    results->push_back({"sigma_delta", fm::simdLevelName(decimator.simdLevel()),
+                        timeBest(frames, frame_samples, [&] {
+                          decimator.process(bits.data(), static_cast<int>(bits.size()), out.data());
+                          sink = out[0];
+                        }), 0});
+    if (level == fm::detectSimdLevel()) {
+      break;
+    }
+  }
+}
+
+void printTable(const std::vector<Result>& results) {
+  printf("%-14s %-26s %10s %10s\n", "group", "name", "ns/sample", "voices");
+  for (const Result& r : results) {
+    if (r.voices) {
+      printf("%-14s %-26s %10.3f %10.0f\n", r.group.c_str(), r.name.c_str(), r.ns_per_sample,
+             voicesPerCore(r));
+    } else {
+      printf("%-14s %-26s %10.3f %10s\n", r.group.c_str(), r.name.c_str(), r.ns_per_sample, "-");
+    }
+  }
+}
+
+bool writeJson(const char* path, const std::vector<Result>& results, int blocks) {
+  FILE* out = strcmp(path, "-") == 0 ? stdout : fopen(path, "w");
+  if (!out) {
+    return false;
+  }
+  fprintf(out, "{\n");
+  fprintf(out, "  \"compiler\": \"%s\",\n", __VERSION__);
+  fprintf(out, "  \"simd\": \"%s\",\n", fm::simdLevelName(fm::detectSimdLevel()));
+  fprintf(out, "  \"sample_rate\": %d,\n", SAMPLE_RATE);
+  fprintf(out, "  \"block_size\": %d,\n", BLOCK_SIZE);
+  fprintf(out, "  \"blocks\": %d,\n", blocks);
+  fprintf(out, "  \"results\": [\n");
+  for (size_t i = 0; i < results.size(); i++) {
+    const Result& r = results[i];
+    fprintf(out, "    {\"group\": \"%s\", \"name\": \"%s\", \"ns_per_sample\": %.4f, \"voices_per_core\": %.1f}%s\n",
+            r.group.c_str(), r.name.c_str(), r.ns_per_sample, voicesPerCore(r),
+            i + 1 < results.size() ? "," : "");
+  }
+  fprintf(out, "  ]\n}\n");
+  return out == stdout || fclose(out) == 0;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  int blocks = 20000;
+  const char* json_path = nullptr;
+  const char* filter = nullptr;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--blocks") == 0 && i + 1 < argc) {
+      blocks = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+      json_path = argv[++i];
+    } else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+      filter = argv[++i];
+    } else {
+      fprintf(stderr,
+              "usage: %s [--blocks N] [--json FILE|-] [--filter GROUP]\n"
+              "  groups: pulse fm bank adsr tables mix pool noise sigma_delta\n",
+              argv[0]);
+      return 1;
+    }
+  }
+
+  struct Suite {
+    const char* name;
+    void (*run)(int, std::vector<Result>*);
+  };
+  const Suite suites[] = {
+      {"pulse", benchPulse}, {"fm", benchFM},         {"bank", benchBanks},
+      {"adsr", benchAdsr},   {"tables", benchTables}, {"mix", benchMix},
+      {"pool", benchPool},   {"noise", benchNoise},   {"sigma_delta", benchSigmaDelta},
+  };
+
+  std::vector<Result> results;
+  for (const Suite& suite : suites) {
+    if (!filter || strcmp(filter, suite.name) == 0) {
+      suite.run(blocks, &results);
+    }
+  }
+
+  if (json_path) {
+    if (!writeJson(json_path, results, blocks)) {
+      fprintf(stderr, "Failed to write %s\n", json_path);
+      return 1;
+    }
+    if (strcmp(json_path, "-") == 0) {
+      return 0;
+    }
+  }
+  printTable(results);
+  return 0;
+}
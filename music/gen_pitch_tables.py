@@ -0,0 +1,122 @@
+#!/usr/bin/env python3
+# Generates libfm/src/pitch_tables.hpp: the note-on tables behind
+# fm::notePhaseInc and fm::velocityToLogatten, so libfm needs no pow()/log().
+#
+# Phase increments are stored for the top MIDI octave (notes 120..131) with
+# TOP_BITS bits of phase; any other note and phase width is a right shift of
+# one of those. The entries are exact floors, computed in high precision, so
+# shifting them down truncates or rounds exactly like evaluating the formula
+# directly. The script checks that rounding mode against synth.noteinc (what
+# track.py writes into data/*_pitch.hex) for every note before writing.
+
+import math
+from decimal import Decimal, getcontext
+
+from consts import samplerate
+from synth import noteinc
+
+getcontext().prec = 60
+
+TOP_NOTE = 120
+TOP_BITS = 36
+FREQ_BITS = 24
+SAMPLE_RATES = [round(samplerate), 44100, 48000]
+OUTPUT = "libfm/src/pitch_tables.hpp"
+
+
+def note_freq(note):
+    return Decimal(440) * Decimal(2) ** (Decimal(note - 69) / Decimal(12))
+
+
+def top_octave(rate):
+    return [int(note_freq(TOP_NOTE + s) * (1 << TOP_BITS) / rate) for s in range(12)]
+
+
+def phase_inc(top, note, phase_bits, nearest):
+    # mirrors notePhaseInc in libfm/src/pitch.cpp
+    octave = (note - TOP_NOTE) // 12
+    semitone = (note - TOP_NOTE) % 12
+    shift = TOP_BITS - phase_bits - octave
+    value = top[semitone]
+    if nearest and shift > 0:
+        value += 1 << (shift - 1)
+    return value >> shift
+
+
+def check_chip_rounding(top):
+    for phase_bits in (14, 18):
+        for note in range(128):
+            expected = noteinc(note - 36, phase_bits)
+            actual = phase_inc(top, note, phase_bits, True)
+            if actual != expected:
+                raise SystemExit(f"note {note} at {phase_bits} bits: table gives {actual}, "
+                                 f"synth.noteinc gives {expected}")
+
+
+def velocity_logatten(velocity):
+    # -log2(velocity/127) in 1/64ths, truncated like the float code it replaces
+    if velocity == 0:
+        return 511
+    return int(-math.log(velocity / 127) / math.log(2) * 64)
+
+
+def format_u64(values):
+    return ", ".join(f"0x{v:x}ull" for v in values)
+
+
+def main():
+    rates = {rate: top_octave(rate) for rate in SAMPLE_RATES}
+    check_chip_rounding(rates[round(samplerate)])
+    freqs = [int(note_freq(TOP_NOTE + s) * (1 << FREQ_BITS)) for s in range(12)]
+    logatten = [velocity_logatten(v) for v in range(128)]
+
+    lines = [
+        "#pragma once",
+        "// Generated by music/gen_pitch_tables.py; do not edit.",
+        "",
+        "#include <cstdint>",
+        "",
+        "namespace fm {",
+        "namespace pitch_tables {",
+        "",
+        "// Increment at P phase bits for MIDI note TOP_NOTE + s is",
+        "// top_octave[s] >> (TOP_BITS - P), one more bit of shift per octave down.",
+        f"constexpr int TOP_NOTE = {TOP_NOTE};",
+        f"constexpr int TOP_BITS = {TOP_BITS};",
+        "",
+        "struct RateTable {",
+        "  uint32_t sample_rate;",
+        "  uint64_t top_octave[12];",
+        "};",
+        "",
+        "constexpr RateTable RATES[] = {",
+    ]
+    for rate, top in rates.items():
+        lines.append(f"    {{{rate}, {{{format_u64(top)}}}}},")
+    lines += [
+        "};",
+        "",
+        "// Top-octave frequencies in Hz << FREQ_BITS, for sample rates without a",
+        "// table.",
+        f"constexpr int FREQ_BITS = {FREQ_BITS};",
+        f"constexpr uint64_t TOP_OCTAVE_HZ[12] = {{{format_u64(freqs)}}};",
+        "",
+        "// -log2(velocity / 127) * 64, truncated; velocity 0 is fully attenuated.",
+        "constexpr uint16_t VELOCITY_LOGATTEN[128] = {",
+    ]
+    for i in range(0, 128, 16):
+        lines.append("    " + ", ".join(str(v) for v in logatten[i:i + 16]) + ",")
+    lines += [
+        "};",
+        "",
+        "}  // namespace pitch_tables",
+        "}  // namespace fm",
+        "",
+    ]
+    with open(OUTPUT, "w") as f:
+        f.write("\n".join(lines))
+    print(f"wrote {OUTPUT}")
+
+
+if __name__ == "__main__":
+    main()
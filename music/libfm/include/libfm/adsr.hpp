@@ -28,6 +28,10 @@ struct ADSRState {
   void trigger();
   void release();
   int step(int carry, const ADSR& config);
+  // Same as calling step() for num_samples samples whose counter starts at
+  // sample_count (carry = count ^ (count + 1)), but jumps straight from one
+  // envelope event to the next.
+  int advance(int sample_count, int num_samples, const ADSR& config);
 };
 
 }  // namespace fm 
\ No newline at end of file
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "libfm/fm_channel.hpp"
+#include "libfm/simd.hpp"
+
+namespace fm {
+
+// A bank of FM voices sharing one FMConfig, stored structure-of-arrays so that
+// render() can run the logsin9 -> attenuation -> iexp11 pipeline for 8 voices
+// per instruction (AVX2 gathers over the log-sine and mantissa tables). The
+// mixed output is bit-identical to calling FMState::render on every voice into
+// the same buffer.
+class FMBank {
+ public:
+  explicit FMBank(int num_voices);
+
+  int size() const { return num_voices_; }
+
+  void noteOn(int voice, int note, int velocity, const FMConfig& config);
+  void noteOff(int voice, const FMConfig& config);
+  void render(int16_t* buffer, int num_samples, const FMConfig& config);
+
+  int note(int voice) const { return note_[voice]; }
+  ADSRStatus carrierState(int voice) const { return static_cast<ADSRStatus>(carrier_adsr_state_[voice]); }
+
+  // Copy a voice in or out of the bank, e.g. to hand it over from an FMState.
+  void loadVoice(int voice, const FMState& state);
+  void storeVoice(int voice, FMState* state) const;
+
+  // Defaults to detectSimdLevel(); requests above what the CPU supports are
+  // clamped. There is no SSE4.1 kernel (it has no gathers or per-lane shifts),
+  // so SIMD_SSE41 renders with the scalar kernel.
+  SimdLevel simdLevel() const { return simd_level_; }
+  void setSimdLevel(SimdLevel level);
+
+ private:
+  int num_voices_;
+  int num_lanes_;  // num_voices_ rounded up to a whole AVX2 register
+  SimdLevel simd_level_;
+
+  std::vector<int32_t> note_;
+  std::vector<int32_t> carrier_velocity_;
+  std::vector<int32_t> carrier_phase_;
+  std::vector<int32_t> modulator_phase_;
+  std::vector<int32_t> carrier_phase_inc_;
+  std::vector<int32_t> modulator_phase_inc_;
+  std::vector<int32_t> modulator_sample_;
+  std::vector<int32_t> sample_count_;
+  std::vector<int32_t> carrier_adsr_state_;
+  std::vector<int32_t> carrier_adsr_value_;
+  std::vector<int32_t> modulator_adsr_state_;
+  std::vector<int32_t> modulator_adsr_value_;
+};
+
+}  // namespace fm
@@ -6,6 +6,11 @@ namespace fm {
 
 class FMConfig;
 
+// Carrier attenuation (in logsin9 units) and phase increment for a MIDI note,
+// as used by FMState::noteOn.
+int velocityToLogatten(int velocity);
+int fmPhaseInc(int note, const FMConfig& config);
+
 struct FMState {
   FMState();
 
@@ -20,15 +25,16 @@ struct FMState {
   ADSRState carrier_adsr;
   ADSRState modulator_adsr;
 
-  // For visualization
-  float scope_buffer[1024]{};
-  int scope_index{0};
-
   int sample_count{0};
 
   void noteOn(int note, int velocity, const FMConfig& config);
   void noteOff(const FMConfig& config);
   void render(int16_t* buffer, int num_samples, const FMConfig& config);
+  // Leaves the voice where render() would after num_samples samples without
+  // computing them: envelopes jump between events and the phases move a run
+  // of constant increment at a time. With feedback the modulator depends on
+  // its own output, so that case renders into scratch.
+  void advance(int num_samples, const FMConfig& config);
 };
 
 class FMConfig {
@@ -48,4 +54,22 @@ class FMConfig {
   float sample_rate{48000.0f};
 };
 
+// FMState::render picks one of FM_KERNEL_COUNT kernels per call, keyed on
+// these bits, which must match the config.
+enum FMKernelFeatures : unsigned {
+  FM_KERNEL_FEEDBACK = 1 << 0,       // config.modulation_feedback > 0
+  FM_KERNEL_CARRIER_DECAY = 1 << 1,  // config.carrier_decay != 0
+  FM_KERNEL_COUNT = 1 << 2,
+};
+
+using FMRenderFn = void (*)(FMState& state, int16_t* buffer, int num_samples,
+                            const FMConfig& config);
+
+unsigned fmKernelFeatures(const FMConfig& config);
+FMRenderFn fmRenderKernel(unsigned features);
+
+// Unspecialized kernel that checks every feature per sample; the reference the
+// specialized kernels are benchmarked against.
+void fmRenderGeneric(FMState& state, int16_t* buffer, int num_samples, const FMConfig& config);
+
 }  // namespace fm 
\ No newline at end of file
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+#include "libfm/noise_channel.hpp"
+#include "libfm/song.hpp"
+
+namespace fm {
+
+// Song positions addressable by music.v's 9-bit song_position register.
+constexpr int MUSIC_SONG_LENGTH = 512;
+
+// Sample-exact model of src/music.v: the bass, melody and backup
+// pulse_channels, the noise_channel snare, the tick/song clocks and the 13-bit
+// audio_sample sum. Instead of 800 clocks per sample it only evaluates the
+// clocks that change state, so it runs thousands of times faster than an RTL
+// simulation while producing the same audio_sample sequence.
+//
+// sampleClock() and tickClock() each correspond to one clock edge with the
+// matching enable high; on the chip they never coincide. clockDac() is the
+// sigma-delta accumulator that runs on every clock.
+class MusicModel {
+ public:
+  // Tables are copied, so song need not outlive the model. Positions beyond
+  // song.length() read as zero, like uninitialized RTL memory.
+  explicit MusicModel(const SongData& song);
+
+  // rst_n low for one clock.
+  void reset();
+
+  void sampleClock();
+  void tickClock();
+  void clockDac() { dac_accum_ = (dac_accum_ + sample()) & 0x1fff; }
+
+  // Runs the chip's schedule (SONG_SAMPLES_PER_TICK sample clocks, then a
+  // tick) and stores audio_sample after each sample clock.
+  void render(uint16_t* buffer, int num_samples);
+  // Same as render() without storing anything: the phases jump over each
+  // tick in one step, the noise LFSR 64 steps at a time. The DAC accumulator
+  // is not clocked.
+  void advance(int num_samples);
+  // reset(), then advance to the first sample of song position `position`.
+  void seek(int position);
+
+  // Current value of each output, i.e. what the RTL drives after the last edge.
+  int sample() const;
+  int channelSample(int track) const;  // SongTrackId; SONG_SNARE is the noise channel
+  int audioOut() const { return ((dac_accum_ + sample()) >> 13) & 1; }
+  int songPosition() const { return song_position_; }
+  int tickCounter() const { return tick_counter_; }
+  int lineCounter() const { return line_; }
+
+ private:
+  struct PulseChannel {
+    int phase_bits;
+    int release;
+    bool pulse_width;
+    uint8_t on[MUSIC_SONG_LENGTH];
+    uint8_t trigger[MUSIC_SONG_LENGTH];
+    uint32_t phase_inc[MUSIC_SONG_LENGTH];
+
+    uint32_t phase1;
+    uint32_t phase2;
+    uint32_t amplitude;
+
+    int sample() const;
+  };
+
+  PulseChannel pulse_[SONG_PULSE_TRACKS];
+
+  NoiseConfig noise_config_{NOISE_CHIP};
+  NoiseState noise_{noise_config_};
+
+  int tick_counter_;
+  int song_position_;
+  int dac_accum_;
+  int line_;  // sample clocks since the last tick, for render()
+};
+
+}  // namespace fm
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstdint>
+
+namespace fm {
+
+enum NoiseVariant {
+  // src/noise_channel.v: 15-bit LFSR stepped every sample; outputs its low
+  // byte shifted down by volume / 2, silent at volume 15.
+  NOISE_CHIP,
+  // synth.snare: 16-bit Galois LFSR (taps 0x8016) stepped on even samples
+  // counted from each tick; outputs the register shifted down by volume + 1.
+  NOISE_SNARE,
+};
+
+class NoiseConfig {
+ public:
+  NoiseConfig() = default;
+  explicit NoiseConfig(NoiseVariant variant)
+      : variant(variant), decay(variant == NOISE_CHIP ? 1 : 2) {}
+
+  NoiseVariant variant{NOISE_SNARE};
+  int decay{2};  // ticks per volume step
+};
+
+// Noise voice, bit-exact with either variant. The register is not shifted
+// once per sample: every step feeds back one bit, and the fed-back bits obey
+// the LFSR's recurrence with all lags multiplied by 64 (squaring a polynomial
+// over GF(2) squares its terms), so 64 steps at a time are one XOR of earlier
+// 64-bit words. The register at any step is a linear function of the bits fed
+// back from there on, which render() reads out with table lookups.
+class NoiseState {
+ public:
+  explicit NoiseState(const NoiseConfig& config);
+
+  // Back to the power-on register and a silent volume.
+  void reset(const NoiseConfig& config);
+  void trigger(const NoiseConfig& config);
+  // Called at the start of every tick, before its samples. The chip's
+  // trigger replaces that tick's decay step, so it calls trigger() after
+  // this; the snare decays on the trigger's tick too, so it calls it before.
+  void tickEnvelopes(const NoiseConfig& config);
+  // Adds num_samples samples into buffer; each steps the register (if it is
+  // due) and then outputs it.
+  void render(int16_t* buffer, int num_samples, const NoiseConfig& config);
+  // Same state changes as render() without producing samples, 64 steps per
+  // word operation.
+  void advance(int num_samples, const NoiseConfig& config);
+
+  // Output for the current register and volume, what the last sample was.
+  int sample(const NoiseConfig& config) const;
+  uint32_t lfsr(const NoiseConfig& config) const;
+  int volume() const { return volume_; }
+  bool silent(const NoiseConfig& config) const;
+
+ private:
+  void renderChip(int16_t* buffer, int num_samples);
+  void renderSnare(int16_t* buffer, int num_samples);
+  // Feedback bits of steps step_ .. step_ + 63.
+  uint64_t upcoming() const;
+  // Generates words until upcoming() can be read.
+  void fill(NoiseVariant variant);
+
+  static constexpr int WORDS = 16;  // ring of stream words, >= the longest lag + 1
+
+  int volume_;
+  int tick_count_{0};
+  int tick_sample_{0};  // samples since the last tick, for the snare's stepping
+
+  uint64_t stream_[WORDS];  // word k in stream_[k % WORDS]
+  uint64_t words_;          // words generated so far
+  uint64_t step_;           // register steps taken so far
+};
+
+}  // namespace fm
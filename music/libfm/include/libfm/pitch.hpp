@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstdint>
+
+namespace fm {
+
+// How notePhaseInc rounds. The synth has always truncated; PITCH_NEAREST
+// reproduces the increments track.py writes into data/*_pitch.hex.
+enum PitchRounding {
+  PITCH_TRUNCATE,
+  PITCH_NEAREST,
+};
+
+// 2^phase_bits * f(note) / sample_rate for MIDI note `note` (which may fall
+// outside 0..127 after an octave transpose), for phase_bits up to 32. A table
+// load and a shift at 30000, 44100 and 48000 Hz, plus one divide at other
+// rates; no libm.
+uint32_t notePhaseInc(int note, int phase_bits, float sample_rate,
+                      PitchRounding rounding = PITCH_TRUNCATE);
+
+}  // namespace fm
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "libfm/pulse_channel.hpp"
+#include "libfm/simd.hpp"
+
+namespace fm {
+
+// A bank of pulse voices sharing one PulseConfig, stored structure-of-arrays so
+// that render() can run 4 (SSE4.1) or 8 (AVX2) voices per instruction. Each
+// voice behaves exactly like a PulseState: the mixed output is bit-identical to
+// calling PulseState::render on every voice into the same buffer.
+class PulseBank {
+ public:
+  explicit PulseBank(int num_voices);
+
+  int size() const { return num_voices_; }
+
+  void noteOn(int voice, int note, int velocity, const PulseConfig& config);
+  void noteOff(int voice, const PulseConfig& config);
+  void tickEnvelopes(const PulseConfig& config);
+  void render(int16_t* buffer, int num_samples, const PulseConfig& config);
+
+  int note(int voice) const { return note_[voice]; }
+  int adsrState(int voice) const { return adsr_state_[voice]; }
+  int volume(int voice) const { return volume_[voice]; }
+
+  // Copy a voice in or out of the bank, e.g. to hand it over from a PulseState.
+  void loadVoice(int voice, const PulseState& state);
+  void storeVoice(int voice, PulseState* state) const;
+
+  // Defaults to detectSimdLevel(); requests above what the CPU supports are
+  // clamped.
+  SimdLevel simdLevel() const { return simd_level_; }
+  void setSimdLevel(SimdLevel level);
+
+ private:
+  int num_voices_;
+  int num_lanes_;  // num_voices_ rounded up to a whole AVX2 register
+  SimdLevel simd_level_;
+
+  std::vector<int32_t> note_;
+  std::vector<int32_t> octave_;
+  std::vector<int32_t> primary_phase_;
+  std::vector<int32_t> secondary_phase_;
+  std::vector<int32_t> volume_;
+  std::vector<int32_t> phase_inc_;
+  std::vector<int32_t> vibrato_sin_;
+  std::vector<int32_t> vibrato_cos_;
+  std::vector<int32_t> adsr_state_;
+  std::vector<int32_t> vibrato_level_;
+  std::vector<int32_t> lpf_y_;
+  std::vector<int32_t> lpf_v_;
+
+  // per-render phase steps, constant for the duration of a render() call
+  std::vector<int32_t> primary_step_;
+  std::vector<int32_t> secondary_step_;
+};
+
+}  // namespace fm
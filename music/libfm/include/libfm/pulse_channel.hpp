@@ -1,10 +1,18 @@
 #pragma once
 
 #include <cstdint>
+#include "libfm/pitch.hpp"
 
 namespace fm {
 
+// at 30kHz this gives a frequency resolution of 1.8Hz
+constexpr int PULSE_PHASEBITS = 18;
+
 class PulseConfig;
+struct PulseState;
+
+// Phase increment for a MIDI note, as used by PulseState::noteOn.
+int pulsePhaseInc(int note, const PulseConfig& config);
 
 struct PulseState {
   PulseState();
@@ -26,15 +34,21 @@ struct PulseState {
   int lpf_y{0};
   int lpf_v{0};
 
-  float scope_buffer[1024]{};
-  int scope_index{0};
-
   int sample_count{0};
 
   void noteOn(int note, int velocity, const PulseConfig& config);
   void noteOff(const PulseConfig& config);
+  // Starts a note at a raw phase increment without resetting the oscillators
+  // or vibrato, the way the song sequencer (track.py) does.
+  void retrigger(int phase_inc, const PulseConfig& config);
   void tickEnvelopes(const PulseConfig& config);
   void render(int16_t* buffer, int num_samples, const PulseConfig& config);
+  // Leaves the oscillators where render() would after num_samples samples,
+  // in closed form (the steps are constant between envelope ticks). The LPF
+  // state depends on the signal, so with the LPF on this renders into scratch.
+  void advance(int num_samples, const PulseConfig& config);
+  // tickEnvelopes() num_ticks times.
+  void advanceTicks(int num_ticks, const PulseConfig& config);
 };
 
 class PulseConfig {
@@ -46,6 +60,8 @@ class PulseConfig {
   // Configuration
   int pulse_width{0};  // is actually number of MSBs (0=50%, 1=25%, 2=12.5%, ...)
   int octave_transpose{0};
+  // PITCH_NEAREST matches the chip's song tables at 30kHz
+  PitchRounding pitch_rounding{PITCH_TRUNCATE};
 
   // secondary oscillator offsets
   int detune{0};
@@ -63,4 +79,28 @@ class PulseConfig {
   int lpf_k2{0};
 };
 
+// PulseState::render picks one of PULSE_KERNEL_COUNT kernels per call, keyed
+// on these bits. The LPF and duty bits must match the config; the others are
+// fast paths, and a kernel with UNIT_MULTIPLIER/NO_DETUNE cleared or VIBRATO
+// set is still correct (only slower) for any state.
+enum PulseKernelFeatures : unsigned {
+  PULSE_KERNEL_LPF = 1 << 0,              // config.lpf_enabled
+  PULSE_KERNEL_QUARTER_DUTY = 1 << 1,     // config.pulse_width & 1
+  PULSE_KERNEL_UNIT_MULTIPLIER = 1 << 2,  // config.carrier_multiplier == 1
+  PULSE_KERNEL_NO_DETUNE = 1 << 3,        // config.detune == 0
+  PULSE_KERNEL_VIBRATO = 1 << 4,          // state.vibrato_level != 0
+  PULSE_KERNEL_COUNT = 1 << 5,
+};
+
+using PulseRenderFn = void (*)(PulseState& state, int16_t* buffer, int num_samples,
+                               const PulseConfig& config);
+
+unsigned pulseKernelFeatures(const PulseState& state, const PulseConfig& config);
+PulseRenderFn pulseRenderKernel(unsigned features);
+
+// Unspecialized kernel that checks every feature per sample; the reference the
+// specialized kernels are benchmarked against.
+void pulseRenderGeneric(PulseState& state, int16_t* buffer, int num_samples,
+                        const PulseConfig& config);
+
 }  // namespace libfm
\ No newline at end of file
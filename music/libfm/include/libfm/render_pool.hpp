@@ -0,0 +1,76 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace fm {
+
+// Worker threads for splitting one audio block into independent jobs, e.g.
+// groups of voices that each render into their own scratch buffer.
+//
+// run() deals the jobs out round-robin to one queue per participant (the
+// workers plus the calling thread); each participant drains its own queue and
+// then steals from the others, so a slow job does not hold up the rest. The
+// caller returns once every job has finished. Between blocks the workers spin
+// for a while so back-to-back blocks do not pay for a wakeup, then sleep.
+// run() is therefore not free of syscalls: waking sleeping workers takes a
+// mutex and a futex wake, and the caller yields while it waits for workers.
+//
+// Only one thread may call run(), and jobs must not call it.
+class RenderPool {
+ public:
+  using JobFn = void (*)(void* context, int job);
+  using StartFn = void (*)();
+
+  // Each worker calls on_start, if given, before it waits for its first job,
+  // e.g. to mark itself as a real-time thread.
+  explicit RenderPool(int workers, StartFn on_start = nullptr);
+  ~RenderPool();
+
+  RenderPool(const RenderPool&) = delete;
+  RenderPool& operator=(const RenderPool&) = delete;
+
+  int workers() const { return static_cast<int>(threads_.size()); }
+  // For setting priority/affinity on the workers.
+  std::thread& worker(int i) { return threads_[i]; }
+
+  // Runs fn(context, job) for every job in [0, jobs).
+  void run(JobFn fn, void* context, int jobs);
+
+  // Typical cost of a run() of empty jobs with the workers awake, measured at
+  // construction; a block is only worth splitting if its work is well above
+  // this.
+  int64_t dispatchOverheadNs() const { return dispatch_overhead_ns_; }
+
+ private:
+  struct alignas(64) Queue {
+    std::atomic<int> next{0};
+    int end{0};
+  };
+
+  void workerThread(int self, StartFn on_start);
+  void drain(int self);
+  int64_t measureDispatchOverhead();
+
+  std::vector<std::thread> threads_;
+  std::unique_ptr<Queue[]> queues_;  // [0] is the caller's, then one per worker
+
+  JobFn fn_{nullptr};
+  void* context_{nullptr};
+  alignas(64) std::atomic<uint32_t> generation_{0};
+  alignas(64) std::atomic<int> pending_{0};  // participants still draining
+  std::atomic<bool> stop_{false};
+
+  std::mutex sleep_mutex_;
+  std::condition_variable wake_;
+  std::atomic<int> sleepers_{0};
+
+  int64_t dispatch_overhead_ns_{0};
+};
+
+}  // namespace fm
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "libfm/simd.hpp"
+
+namespace fm {
+
+// Clocks per output sample: one per VGA line, like music.v's sample_clk.
+constexpr int SIGMA_DELTA_DECIMATION = 800;
+
+// Turns music.v's audio_out, a first-order sigma-delta bitstream with one bit
+// per clock, back into 16-bit PCM at one sample per SIGMA_DELTA_DECIMATION
+// clocks, scaled like audio_sample: a ones density of audio_sample / 8192
+// decodes to (audio_sample - 4096) << 3.
+//
+// Two stages: a 3rd-order CIC decimating by 32, integrated a byte of the
+// bitstream at a time from lookup tables, then a windowed-sinc low-pass FIR
+// decimating by the remaining 25, whose passband is divided by the CIC's
+// response to undo its droop. The FIR is int16 x int16 with an exact int32
+// sum, so every SIMD level produces the same samples.
+class SigmaDeltaDecimator {
+ public:
+  SigmaDeltaDecimator();
+
+  // Clears the filters, as if the bitstream had been all zeros.
+  void reset();
+
+  // Consumes num_bytes bytes of bitstream, bit i of bits[k] being clock
+  // 8k + i, and writes a sample to out every SIGMA_DELTA_DECIMATION clocks
+  // counted from reset(). Returns the number written, at most
+  // num_bytes / 100 + 1.
+  int process(const uint8_t* bits, int num_bytes, int16_t* out);
+
+  // Clocks between the centre of the filters' response and the last clock
+  // before the output sample, i.e. the latency of the pair.
+  static double delayClocks();
+
+  // Defaults to detectSimdLevel(); requests above what the CPU supports are
+  // clamped.
+  SimdLevel simdLevel() const { return simd_level_; }
+  void setSimdLevel(SimdLevel level);
+
+ private:
+  SimdLevel simd_level_;
+
+  uint32_t integrator_[3];
+  uint32_t comb_[3];
+  int cic_phase_;  // bytes since the last CIC output
+  int fir_phase_;  // CIC outputs since the last FIR output
+
+  std::vector<int16_t> taps_;
+  // The last FIR_TAPS CIC outputs, written twice so that the FIR reads them
+  // contiguously from history_pos_.
+  std::vector<int16_t> history_;
+  int history_pos_;
+};
+
+}  // namespace fm
@@ -0,0 +1,18 @@
+#pragma once
+
+namespace fm {
+
+// Instruction set used by the multi-voice renderers. Levels are ordered, so a
+// CPU supporting a level also supports every level below it.
+enum SimdLevel {
+  SIMD_SCALAR,
+  SIMD_SSE41,
+  SIMD_AVX2,
+};
+
+// Best level supported by the running CPU (detected once, then cached).
+SimdLevel detectSimdLevel();
+
+const char* simdLevelName(SimdLevel level);
+
+}  // namespace fm
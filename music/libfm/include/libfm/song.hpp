@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "libfm/pulse_channel.hpp"
+
+namespace fm {
+
+// Timing of the chip's sequencer (see src/music.v): one audio sample per VGA
+// line, one envelope tick per frame, and a new song position every 5 ticks.
+constexpr int SONG_SAMPLE_RATE = 30000;  // 24MHz / 800 clocks per line
+constexpr int SONG_SAMPLES_PER_TICK = 525;
+constexpr int SONG_TICKS_PER_POSITION = 5;
+constexpr int SONG_SAMPLES_PER_POSITION = SONG_SAMPLES_PER_TICK * SONG_TICKS_PER_POSITION;
+
+enum SongTrackId {
+  SONG_BASS,
+  SONG_MELODY,
+  SONG_BACKUP,
+  SONG_SNARE,
+  SONG_TRACK_COUNT,
+  SONG_PULSE_TRACKS = SONG_SNARE,
+};
+
+const char* songTrackName(int track);
+
+// One pulse track's tables as written by track.py. pitch and on are rotated
+// back by one position relative to trigger, so a trigger at position p plays
+// pitch[p+1]; this is what the chip's one-position pipeline expects.
+struct SongTrack {
+  std::vector<uint8_t> on;
+  std::vector<uint8_t> trigger;
+  std::vector<uint32_t> pitch;
+};
+
+class SongFile;
+
+// A song's tables: either expanded into the vectors (data/*.hex, or built by
+// hand) or left in a mapped song file, which the lookups below then decode
+// one position at a time. Read songs through the lookups, which work for both.
+struct SongData {
+  SongTrack tracks[SONG_PULSE_TRACKS];
+  std::vector<uint8_t> snare;  // drum_snare.hex, looped over the song
+  std::shared_ptr<const SongFile> file;  // when set, the tables above are empty
+
+  int length() const;
+  int snareLength() const;
+  // Flags are single bits, as the chip reads them. Positions must be in range.
+  bool on(int track, int position) const;
+  bool trigger(int track, int position) const;
+  uint32_t pitch(int track, int position) const;
+  bool snareHit(int position) const;
+};
+
+// Largest memory readMemHex accepts, in words: the chip's biggest table (the
+// 128x128 logo) with room to spare.
+constexpr size_t MEMHEX_MAX_WORDS = 1 << 16;
+
+// Reads a $readmemh-style file (whitespace separated hex words, // comments
+// and @address directives). Fails on a word at or beyond MEMHEX_MAX_WORDS,
+// so a corrupt @address cannot make it allocate without bound.
+bool readMemHex(const std::string& path, std::vector<uint32_t>* values);
+
+// Loads <data_dir>/{bass,melody,backup}_{on,trigger,pitch}.hex and
+// drum_snare.hex, or maps a song file (see song_file.hpp) if data_dir names
+// one. On failure returns false and names the offending file in *error.
+bool loadSong(const std::string& data_dir, SongData* song, std::string* error);
+
+// Voice settings each track was written with (bassconfig, melodyconfig and
+// backupconfig in track.py), in PULSE_PHASEBITS phase units.
+PulseConfig songTrackConfig(int track);
+
+// Converts a pitch table entry to a PulseState phase increment. The melody
+// table is written for a 14-bit phase accumulator, the others for 18 bits.
+int songPhaseInc(int track, uint32_t pitch);
+
+}  // namespace fm
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "libfm/song.hpp"
+
+namespace fm {
+
+// Binary song file (.fmsong): the tables loadSong() reads from data/*.hex,
+// packed. Little-endian throughout:
+//
+//    0  "FMSG"
+//    4  u16 version, SONG_FILE_VERSION
+//    6  u16 number of pulse tracks, SONG_PULSE_TRACKS
+//    8  u32 positions per pulse track
+//   12  u32 snare positions
+//   16  u32 offset of the snare bitmap
+//   20  u32 file size
+//   24  per pulse track (the index), 16 bytes: u32 offsets of the on bitmap,
+//       the trigger bitmap and the pitch runs, u32 number of pitch runs
+//
+// A bitmap holds position p in bit p % 8 of byte p / 8. Pitch runs are 8
+// bytes, u32 first position and u32 pitch, in increasing order starting at
+// position 0; each lasts until the next begins. Song tables hold a note for
+// many positions, so the runs are a small fraction of the table.
+constexpr uint16_t SONG_FILE_VERSION = 1;
+
+// Read-only view of a song file mapped into memory. Lookups decode straight
+// from the mapping, so opening costs the same for any song and only the
+// positions that get played are ever paged in. Positions must be in range.
+// loadSong() keeps one in SongData, whose lookups forward here.
+class SongFile {
+ public:
+  SongFile() = default;
+  ~SongFile();
+
+  SongFile(const SongFile&) = delete;
+  SongFile& operator=(const SongFile&) = delete;
+
+  // Maps and validates path. On failure returns false with the reason in
+  // *error.
+  bool open(const std::string& path, std::string* error);
+  void close();
+
+  int length() const { return length_; }
+  int snareLength() const { return snare_length_; }
+
+  bool on(int track, int position) const { return bit(tracks_[track].on, position); }
+  bool trigger(int track, int position) const { return bit(tracks_[track].trigger, position); }
+  uint32_t pitch(int track, int position) const;
+  bool snare(int position) const { return bit(snare_, position); }
+
+ private:
+  struct Track {
+    const uint8_t* on;
+    const uint8_t* trigger;
+    const uint8_t* runs;
+    uint32_t run_count;
+  };
+
+  static bool bit(const uint8_t* bitmap, int position) {
+    return (bitmap[position >> 3] >> (position & 7)) & 1;
+  }
+  bool validate(std::string* error);
+
+  const uint8_t* data_{nullptr};
+  size_t size_{0};
+  int length_{0};
+  int snare_length_{0};
+  const uint8_t* snare_{nullptr};
+  Track tracks_[SONG_PULSE_TRACKS]{};
+};
+
+// True if path starts with a song file's magic number.
+bool isSongFile(const std::string& path);
+
+// Packs song, read through its lookups, into a song file at path. On failure returns false with the
+// reason in *error.
+bool writeSongFile(const std::string& path, const SongData& song, std::string* error);
+
+}  // namespace fm
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+#include "libfm/noise_channel.hpp"
+#include "libfm/pulse_channel.hpp"
+#include "libfm/song.hpp"
+
+namespace fm {
+
+// Plays one track of a SongData the way track.py's audiogen does: on the first
+// tick of every song position the track's tables are applied, then envelopes
+// tick every SONG_SAMPLES_PER_TICK samples. Tracks are independent, so each
+// can be rendered on its own thread and mixed afterwards.
+//
+// Players are copyable and only point at the song, which must outlive them.
+class TrackPlayer {
+ public:
+  // At a sample_rate other than the chip's the pitches are rescaled to sound
+  // the same. Ticks stay SONG_SAMPLES_PER_TICK samples apart, so the tempo
+  // scales with the rate.
+  TrackPlayer(const SongData& song, int track, int sample_rate = SONG_SAMPLE_RATE);
+
+  // Adds the next num_samples samples of this track into buffer.
+  void render(int16_t* buffer, int num_samples);
+  // Same state changes as render() without producing samples, skipping
+  // straight from one tick to the next.
+  void advance(int num_samples);
+  // Restarts the track at song position `position`, as if it had been
+  // rendered from the beginning.
+  void seek(int position);
+
+  // Number of song positions started so far (not wrapped to the song length).
+  int position() const { return position_; }
+
+ private:
+  void tick();
+  void stepSong(int p);
+  void renderVoice(int16_t* buffer, int num_samples);
+  void advanceVoice(int num_samples);
+  PulseConfig trackConfig() const;
+  int scalePhaseInc(int phase_inc) const;
+
+  const SongData* song_;
+  int track_;
+  int sample_rate_;
+
+  int tick_sample_{0};
+  int tick_{0};
+  int position_{0};
+
+  PulseConfig config_;
+  PulseState voice_;
+
+  NoiseConfig noise_config_{NOISE_SNARE};
+  NoiseState noise_{noise_config_};
+};
+
+}  // namespace fm
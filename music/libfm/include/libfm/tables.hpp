@@ -3,6 +3,10 @@
 
 namespace fm {
 
+// Raw tables behind logsin9/iexp11, for the batched renderers.
+extern const uint16_t logsin_tbl[128];
+extern const uint16_t mantissa_tbl[64];
+
 int logsin9(int x, int* sign);
 int iexp11(int x);
 
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// Set by the LIBFM_TELEMETRY CMake option; headless builds turn it off and
+// every tap becomes an empty object whose listening() is constant false.
+#ifndef LIBFM_TELEMETRY
+#define LIBFM_TELEMETRY 1
+#endif
+
+namespace fm {
+
+#if LIBFM_TELEMETRY
+
+// Opt-in copy of rendered samples from the audio thread to a viewer such as a
+// scope display. One producer (the audio thread) and one consumer (the GUI)
+// share a lock-free ring. Until the consumer subscribes, the producer's only
+// cost is the relaxed load in listening(), so it should check that before
+// doing any extra work to produce samples for the tap.
+class TelemetryTap {
+ public:
+  static constexpr int CAPACITY = 4096;  // samples, power of two
+
+  // Consumer side. subscribe() discards anything left over from a previous
+  // subscription.
+  void subscribe();
+  void unsubscribe() { listening_.store(false, std::memory_order_relaxed); }
+  // Copies out up to max_samples of the oldest unread samples; returns how
+  // many were copied.
+  int read(int16_t* samples, int max_samples);
+
+  // Producer side. A push that does not fit is dropped whole rather than
+  // overwriting samples the consumer may be reading.
+  bool listening() const { return listening_.load(std::memory_order_relaxed); }
+  void push(const int16_t* samples, int num_samples);
+
+  uint32_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+ private:
+  std::atomic<bool> listening_{false};
+  std::atomic<uint32_t> write_{0};
+  std::atomic<uint32_t> read_{0};
+  std::atomic<uint32_t> dropped_{0};
+  int16_t ring_[CAPACITY];
+};
+
+#else
+
+class TelemetryTap {
+ public:
+  static constexpr int CAPACITY = 0;
+
+  void subscribe() {}
+  void unsubscribe() {}
+  int read(int16_t*, int) { return 0; }
+
+  static constexpr bool listening() { return false; }
+  void push(const int16_t*, int) {}
+
+  uint32_t dropped() const { return 0; }
+};
+
+#endif
+
+}  // namespace fm
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <vector>
+
+namespace fm {
+
+// Assigns MIDI notes to a fixed pool of voice slots. Only voice indices are
+// managed; the voices themselves live in the caller's array.
+//
+// Free slots come off a free list, the sounding ones are kept in a dense list
+// so rendering costs scale with activeCount() rather than capacity(), and
+// when everything is in use the lowest-priority voice (released before held,
+// then quietest) is taken from an indexed min-heap. noteOn/noteOff/free are
+// O(1) apart from the O(log n) heap update.
+class VoiceAllocator {
+ public:
+  static constexpr int NUM_NOTES = 128;
+
+  explicit VoiceAllocator(int capacity);
+
+  int capacity() const { return static_cast<int>(voice_note_.size()); }
+
+  // Sounding voices in no particular order. free() may reorder the list, so
+  // walk it backwards when freeing during iteration.
+  int activeCount() const { return static_cast<int>(active_.size()); }
+  const int* activeVoices() const { return active_.data(); }
+
+  // Voice to start note on: the note's own voice if it is still held, else a
+  // free slot, else a stolen one. Returns -1 for notes outside 0..127.
+  int noteOn(int note);
+  // Marks the note's voice released and returns it, or -1 if the note is not
+  // held. The voice keeps sounding until free().
+  int noteOff(int note);
+  // Returns a voice that has gone silent to the free list.
+  void free(int voice);
+
+  // Steal priority within the held or released group, e.g. the volume.
+  void setLevel(int voice, int level);
+
+  int voiceForNote(int note) const { return note >= 0 && note < NUM_NOTES ? note_voice_[note] : -1; }
+  int note(int voice) const { return voice_note_[voice]; }
+  bool isActive(int voice) const { return active_pos_[voice] >= 0; }
+  bool isReleased(int voice) const { return released_[voice]; }
+
+ private:
+  int priority(int voice) const;
+  void heapSwap(int a, int b);
+  void siftUp(int pos);
+  void siftDown(int pos);
+  void heapUpdate(int voice);
+  void heapRemove(int voice);
+
+  std::vector<int> free_;        // stack of free slots
+  std::vector<int> active_;      // dense list of sounding slots
+  std::vector<int> active_pos_;  // index into active_, or -1 when free
+  std::vector<int> heap_;        // active slots, lowest priority first
+  std::vector<int> heap_pos_;
+
+  std::vector<int> voice_note_;  // note last started on the slot, -1 if none
+  std::vector<int> level_;
+  std::vector<bool> released_;
+  int note_voice_[NUM_NOTES];    // held voice per note, or -1
+};
+
+}  // namespace fm
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+
+namespace fm {
+
+// Streams 16-bit PCM to a WAV file; the header's sizes are patched on close().
+class WavWriter {
+ public:
+  WavWriter() = default;
+  ~WavWriter();
+
+  bool open(const char* filename, int sample_rate, int channels = 1);
+  bool write(const int16_t* samples, int num_frames);
+  bool close();
+
+  int64_t framesWritten() const { return frames_written_; }
+
+ private:
+  FILE* file_{nullptr};
+  int sample_rate_{0};
+  int channels_{1};
+  int64_t frames_written_{0};
+};
+
+}  // namespace fm
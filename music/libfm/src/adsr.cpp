@@ -1,4 +1,5 @@
 #include "libfm/adsr.hpp"
+#include <cstdint>
 
 namespace fm {
 
@@ -51,4 +52,50 @@ int ADSRState::step(int carry, const ADSR &config) {
   return value;
 }
 
+int ADSRState::advance(int sample_count, int num_samples, const ADSR& config) {
+  // step() acts on a sample whose counter value c has the speed's bit set in
+  // c ^ (c + 1), i.e. when c + 1 is a multiple of 2^speed
+  uint64_t count = static_cast<uint32_t>(sample_count);
+  const uint64_t end = count + num_samples;
+  while (count < end) {
+    int speed;
+    switch (state) {
+      case ATTACK: speed = config.attack_speed; break;
+      case DECAY: speed = config.decay_speed; break;
+      case RELEASE: speed = config.release_speed; break;
+      case SUSTAIN:
+        value = (1 << config.sustain);
+        return value;
+      default:
+        value = 511;
+        return value;
+    }
+
+    // events left in [count, end), and how many this state takes to finish
+    uint64_t events = (end >> speed) - (count >> speed);
+    uint64_t needed;
+    if (state == ATTACK) {
+      needed = 1;  // nonlinear, so one event at a time
+    } else {
+      int target = state == DECAY ? (1 << config.sustain) : 511;
+      needed = value < target ? target - value : 1;
+    }
+    if (events < needed) {
+      if (state != ATTACK) {
+        value += static_cast<int>(events);
+      }
+      return value;
+    }
+
+    // jump to the sample of the needed-th event and take it with step()
+    uint64_t event = (((count >> speed) + needed) << speed) - 1;
+    if (state != ATTACK) {
+      value += static_cast<int>(needed) - 1;
+    }
+    step(1 << speed, config);
+    count = event + 1;
+  }
+  return value;
+}
+
 }  // namespace fm 
\ No newline at end of file
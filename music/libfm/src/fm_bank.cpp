@@ -0,0 +1,157 @@
+#include "libfm/fm_bank.hpp"
+#include "libfm/tables.hpp"
+#include "fm_bank_kernel.hpp"
+
+namespace fm {
+
+namespace {
+constexpr int LANE_ALIGN = 8;  // one AVX2 register of int32
+
+struct ScalarOps {
+  using Vec = int32_t;
+  using Shift = int;
+  static constexpr int kWidth = 1;
+
+  static Vec load(const int32_t* p) { return *p; }
+  static void store(int32_t* p, Vec v) { *p = v; }
+  static Vec set1(int32_t x) { return x; }
+  static Vec add(Vec a, Vec b) { return a + b; }
+  static Vec sub(Vec a, Vec b) { return a - b; }
+  static Vec mullo(Vec a, Vec b) { return a * b; }
+  static Vec andv(Vec a, Vec b) { return a & b; }
+  static Vec andnot(Vec a, Vec b) { return ~a & b; }
+  static Vec xorv(Vec a, Vec b) { return a ^ b; }
+  static Vec cmpeq(Vec a, Vec b) { return a == b ? -1 : 0; }
+  static Vec cmpgt(Vec a, Vec b) { return a > b ? -1 : 0; }
+  static Vec select(Vec m, Vec a, Vec b) { return m ? a : b; }
+  static Shift shiftCount(int k) { return k; }
+  static Vec sll(Vec v, Shift k) { return static_cast<int32_t>(static_cast<uint32_t>(v) << k); }
+  static Vec sra(Vec v, Shift k) { return v >> k; }
+  static Vec srai3(Vec v) { return v >> 3; }
+  static Vec srai6(Vec v) { return v >> 6; }
+  static Vec srai10(Vec v) { return v >> 10; }
+  static Vec srlv(Vec v, Vec k) { return static_cast<int32_t>(static_cast<uint32_t>(v) >> k); }
+  static Vec gather(const int32_t* table, Vec index) { return table[index]; }
+  static int32_t hsum(Vec v) { return v; }
+};
+
+FMTables32 widenTables() {
+  FMTables32 tables;
+  for (int i = 0; i < 128; i++) {
+    tables.logsin[i] = logsin_tbl[i];
+  }
+  for (int i = 0; i < 64; i++) {
+    tables.mantissa[i] = mantissa_tbl[i];
+  }
+  return tables;
+}
+}  // namespace
+
+const FMTables32& fmTables32() {
+  static const FMTables32 tables = widenTables();
+  return tables;
+}
+
+void renderFMLanesScalar(const FMLanes& lanes, const FMLaneParams& params,
+                         int16_t* buffer, int num_samples) {
+  dispatchFMLanes<ScalarOps>(lanes, params, buffer, num_samples);
+}
+
+FMBank::FMBank(int num_voices)
+    : num_voices_(num_voices),
+      num_lanes_((num_voices + LANE_ALIGN - 1) / LANE_ALIGN * LANE_ALIGN),
+      simd_level_(detectSimdLevel()),
+      note_(num_lanes_, 0),
+      carrier_velocity_(num_lanes_, 0),
+      carrier_phase_(num_lanes_, 0),
+      modulator_phase_(num_lanes_, 0),
+      carrier_phase_inc_(num_lanes_, 0),
+      modulator_phase_inc_(num_lanes_, 0),
+      modulator_sample_(num_lanes_, 0),
+      sample_count_(num_lanes_, 0),
+      carrier_adsr_state_(num_lanes_, IDLE),
+      carrier_adsr_value_(num_lanes_, 511),
+      modulator_adsr_state_(num_lanes_, IDLE),
+      modulator_adsr_value_(num_lanes_, 511) {}
+
+void FMBank::setSimdLevel(SimdLevel level) {
+  SimdLevel supported = detectSimdLevel();
+  simd_level_ = level > supported ? supported : level;
+}
+
+void FMBank::noteOn(int voice, int note, int velocity, const FMConfig& config) {
+  carrier_adsr_state_[voice] = ATTACK;
+  modulator_adsr_state_[voice] = ATTACK;
+  carrier_velocity_[voice] = velocityToLogatten(velocity);
+  carrier_phase_inc_[voice] = fmPhaseInc(note, config);
+  note_[voice] = note;
+}
+
+void FMBank::noteOff(int voice, const FMConfig&) {
+  carrier_adsr_state_[voice] = RELEASE;
+  modulator_adsr_state_[voice] = RELEASE;
+}
+
+void FMBank::render(int16_t* buffer, int num_samples, const FMConfig& config) {
+  FMLanes lanes;
+  lanes.carrier_phase = carrier_phase_.data();
+  lanes.modulator_phase = modulator_phase_.data();
+  lanes.carrier_phase_inc = carrier_phase_inc_.data();
+  lanes.modulator_phase_inc = modulator_phase_inc_.data();
+  lanes.modulator_sample = modulator_sample_.data();
+  lanes.sample_count = sample_count_.data();
+  lanes.carrier_adsr_state = carrier_adsr_state_.data();
+  lanes.carrier_adsr_value = carrier_adsr_value_.data();
+  lanes.modulator_adsr_state = modulator_adsr_state_.data();
+  lanes.modulator_adsr_value = modulator_adsr_value_.data();
+  lanes.carrier_velocity = carrier_velocity_.data();
+  lanes.num_lanes = num_lanes_;
+
+  FMLaneParams params;
+  params.modulation_index = config.modulation_index;
+  params.modulation_depth = config.modulation_depth;
+  params.modulation_feedback = config.modulation_feedback;
+  params.carrier_decay = config.carrier_decay;
+  params.carrier_adsr = config.carrier_adsr;
+  params.modulator_adsr = config.modulator_adsr;
+
+#if defined(LIBFM_X86_SIMD)
+  if (simd_level_ >= SIMD_AVX2) {
+    renderFMLanesAvx2(lanes, params, buffer, num_samples);
+    return;
+  }
+#endif
+  renderFMLanesScalar(lanes, params, buffer, num_samples);
+}
+
+void FMBank::loadVoice(int voice, const FMState& state) {
+  note_[voice] = state.note;
+  carrier_velocity_[voice] = state.carrier_velocity;
+  carrier_phase_[voice] = state.carrier_phase;
+  modulator_phase_[voice] = state.modulator_phase;
+  carrier_phase_inc_[voice] = state.carrier_phase_inc;
+  modulator_phase_inc_[voice] = state.modulator_phase_inc;
+  modulator_sample_[voice] = state.modulator_sample;
+  sample_count_[voice] = state.sample_count;
+  carrier_adsr_state_[voice] = state.carrier_adsr.state;
+  carrier_adsr_value_[voice] = state.carrier_adsr.value;
+  modulator_adsr_state_[voice] = state.modulator_adsr.state;
+  modulator_adsr_value_[voice] = state.modulator_adsr.value;
+}
+
+void FMBank::storeVoice(int voice, FMState* state) const {
+  state->note = note_[voice];
+  state->carrier_velocity = carrier_velocity_[voice];
+  state->carrier_phase = carrier_phase_[voice];
+  state->modulator_phase = modulator_phase_[voice];
+  state->carrier_phase_inc = carrier_phase_inc_[voice];
+  state->modulator_phase_inc = modulator_phase_inc_[voice];
+  state->modulator_sample = modulator_sample_[voice];
+  state->sample_count = sample_count_[voice];
+  state->carrier_adsr.state = static_cast<ADSRStatus>(carrier_adsr_state_[voice]);
+  state->carrier_adsr.value = carrier_adsr_value_[voice];
+  state->modulator_adsr.state = static_cast<ADSRStatus>(modulator_adsr_state_[voice]);
+  state->modulator_adsr.value = modulator_adsr_value_[voice];
+}
+
+}  // namespace fm
@@ -0,0 +1,222 @@
+#pragma once
+#include <cstdint>
+#include "libfm/adsr.hpp"
+
+// Shared by the scalar and AVX2 FMBank kernels; see pulse_bank_kernel.hpp for
+// why the vector ops live in anonymous namespaces and std:: is avoided here.
+
+namespace fm {
+
+struct FMLanes {
+  int32_t* carrier_phase;
+  int32_t* modulator_phase;
+  int32_t* carrier_phase_inc;
+  int32_t* modulator_phase_inc;
+  int32_t* modulator_sample;
+  int32_t* sample_count;
+  int32_t* carrier_adsr_state;
+  int32_t* carrier_adsr_value;
+  int32_t* modulator_adsr_state;
+  int32_t* modulator_adsr_value;
+  const int32_t* carrier_velocity;
+  int num_lanes;  // multiple of the widest vector
+};
+
+struct FMLaneParams {
+  int modulation_index;
+  int modulation_depth;
+  int modulation_feedback;
+  int carrier_decay;
+  ADSR carrier_adsr;
+  ADSR modulator_adsr;
+};
+
+// logsin_tbl/mantissa_tbl widened to int32 for gathers
+struct FMTables32 {
+  int32_t logsin[128];
+  int32_t mantissa[64];
+};
+const FMTables32& fmTables32();
+
+void renderFMLanesScalar(const FMLanes& lanes, const FMLaneParams& params,
+                         int16_t* buffer, int num_samples);
+void renderFMLanesAvx2(const FMLanes& lanes, const FMLaneParams& params,
+                       int16_t* buffer, int num_samples);
+
+template <class V>
+struct FMAdsrVec {
+  typename V::Vec attack_bit;
+  typename V::Vec decay_bit;
+  typename V::Vec release_bit;
+  typename V::Vec sustain_level;
+
+  explicit FMAdsrVec(const ADSR& config)
+      : attack_bit(V::set1(1 << config.attack_speed)),
+        decay_bit(V::set1(1 << config.decay_speed)),
+        release_bit(V::set1(1 << config.release_speed)),
+        sustain_level(V::set1(1 << config.sustain)) {}
+};
+
+// ADSRState::step for every lane: each state's update is computed
+// unconditionally and the result is blended in by state and carry bit.
+template <class V>
+inline void stepAdsrLanes(typename V::Vec carry, typename V::Vec& state, typename V::Vec& value,
+                          const FMAdsrVec<V>& adsr) {
+  using Vec = typename V::Vec;
+  const Vec zero = V::set1(0);
+  const Vec one = V::set1(1);
+  const Vec max_atten = V::set1(511);
+
+  Vec hit_attack = V::andnot(V::cmpeq(V::andv(carry, adsr.attack_bit), zero), V::cmpeq(state, V::set1(ATTACK)));
+  Vec hit_decay = V::andnot(V::cmpeq(V::andv(carry, adsr.decay_bit), zero), V::cmpeq(state, V::set1(DECAY)));
+  Vec hit_release = V::andnot(V::cmpeq(V::andv(carry, adsr.release_bit), zero), V::cmpeq(state, V::set1(RELEASE)));
+  Vec is_sustain = V::cmpeq(state, V::set1(SUSTAIN));
+  Vec is_idle = V::cmpeq(state, V::set1(IDLE));
+
+  Vec attack_value = V::sub(V::sub(value, V::srai3(value)), one);
+  Vec attack_done = V::cmpgt(one, attack_value);
+  attack_value = V::select(attack_done, zero, attack_value);
+  Vec attack_state = V::select(attack_done, V::set1(DECAY), V::set1(ATTACK));
+
+  Vec decay_value = V::add(value, one);
+  Vec decay_done = V::cmpgt(decay_value, V::sub(adsr.sustain_level, one));
+  decay_value = V::select(decay_done, adsr.sustain_level, decay_value);
+  Vec decay_state = V::select(decay_done, V::set1(SUSTAIN), V::set1(DECAY));
+
+  Vec release_value = V::add(value, one);
+  Vec release_done = V::cmpgt(release_value, V::set1(510));
+  release_value = V::select(release_done, max_atten, release_value);
+  Vec release_state = V::select(release_done, V::set1(IDLE), V::set1(RELEASE));
+
+  value = V::select(hit_attack, attack_value, value);
+  state = V::select(hit_attack, attack_state, state);
+  value = V::select(hit_decay, decay_value, value);
+  state = V::select(hit_decay, decay_state, state);
+  value = V::select(hit_release, release_value, value);
+  state = V::select(hit_release, release_state, state);
+  value = V::select(is_sustain, adsr.sustain_level, value);
+  value = V::select(is_idle, max_atten, value);
+}
+
+// logsin9 followed by iexp11 on every lane: returns the signed linear sample
+// for phase x (in PARTIALPHASEBITS fixed point) attenuated by atten.
+template <class V>
+inline typename V::Vec logsinExpLanes(typename V::Vec x, typename V::Vec atten, const FMTables32& tables) {
+  using Vec = typename V::Vec;
+  x = V::srai10(x);
+  // x ^= (x & 128) ? 0x7f : 0
+  x = V::xorv(x, V::andv(V::cmpeq(V::andv(x, V::set1(128)), V::set1(128)), V::set1(0x7f)));
+  Vec negative = V::cmpeq(V::andv(x, V::set1(256)), V::set1(256));
+  Vec l = V::add(atten, V::gather(tables.logsin, V::andv(x, V::set1(0x7f))));
+
+  // iexp11: out of range (l < 0 or l > 511) is silent
+  Vec in_range = V::andnot(V::cmpgt(l, V::set1(511)), V::cmpgt(l, V::set1(-1)));
+  Vec mantissa = V::gather(tables.mantissa, V::andv(l, V::set1(63)));
+  Vec magnitude = V::andv(V::srlv(mantissa, V::andv(V::srai6(l), V::set1(7))), in_range);
+  return V::select(negative, V::sub(V::set1(0), magnitude), magnitude);
+}
+
+// Mirrors FMState::render for V::kWidth voices at a time. The per-voice output
+// (carrier_sample << 3) is summed across voices before the int16 add, which
+// wraps identically to adding each voice in turn.
+template <class V, bool kFeedback, bool kCarrierDecay>
+void renderFMLanes(const FMLanes& lanes, const FMLaneParams& params, int16_t* buffer, int num_samples) {
+  using Vec = typename V::Vec;
+  constexpr int W = V::kWidth;
+  constexpr int CHUNK = 64;
+  alignas(32) int32_t mix[CHUNK * W];
+
+  const FMTables32& tables = fmTables32();
+  const FMAdsrVec<V> carrier_adsr(params.carrier_adsr);
+  const FMAdsrVec<V> modulator_adsr(params.modulator_adsr);
+  const typename V::Shift feedback_shift = V::shiftCount(kFeedback ? params.modulation_feedback - 1 : 0);
+  const typename V::Shift depth_shift = V::shiftCount(params.modulation_depth);
+  const typename V::Shift decay_shift = V::shiftCount(params.carrier_decay);
+  const typename V::Shift out_shift = V::shiftCount(3);
+  const Vec modulation_index = V::set1(params.modulation_index);
+  const Vec zero = V::set1(0);
+  const Vec one = V::set1(1);
+  const Vec decay_bit = V::set1(0x40);
+
+  for (int start = 0; start < num_samples; start += CHUNK) {
+    int n = num_samples - start;
+    if (n > CHUNK) {
+      n = CHUNK;
+    }
+    for (int i = 0; i < n * W; i++) {
+      mix[i] = 0;
+    }
+
+    for (int g = 0; g < lanes.num_lanes; g += W) {
+      Vec carrier_phase = V::load(lanes.carrier_phase + g);
+      Vec modulator_phase = V::load(lanes.modulator_phase + g);
+      Vec carrier_inc = V::load(lanes.carrier_phase_inc + g);
+      Vec modulator_inc = V::load(lanes.modulator_phase_inc + g);
+      Vec modulator_sample = V::load(lanes.modulator_sample + g);
+      Vec sample_count = V::load(lanes.sample_count + g);
+      Vec carrier_state = V::load(lanes.carrier_adsr_state + g);
+      Vec carrier_value = V::load(lanes.carrier_adsr_value + g);
+      Vec modulator_state = V::load(lanes.modulator_adsr_state + g);
+      Vec modulator_value = V::load(lanes.modulator_adsr_value + g);
+      const Vec carrier_velocity = V::load(lanes.carrier_velocity + g);
+
+      for (int i = 0; i < n; i++) {
+        Vec next_count = V::add(sample_count, one);
+        Vec carry = V::xorv(sample_count, next_count);
+        sample_count = next_count;
+
+        if (kCarrierDecay) {
+          Vec decay_tick = V::andnot(V::cmpeq(V::andv(carry, decay_bit), zero), V::set1(-1));
+          Vec dec_carrier = V::andv(decay_tick, V::cmpgt(carrier_inc, zero));
+          carrier_inc = V::select(dec_carrier, V::sub(carrier_inc, V::sra(carrier_inc, decay_shift)), carrier_inc);
+          Vec dec_modulator = V::andv(decay_tick, V::cmpgt(modulator_inc, zero));
+          modulator_inc = V::select(dec_modulator, V::sub(modulator_inc, V::sra(modulator_inc, decay_shift)), modulator_inc);
+        }
+        stepAdsrLanes<V>(carry, carrier_state, carrier_value, carrier_adsr);
+        stepAdsrLanes<V>(carry, modulator_state, modulator_value, modulator_adsr);
+
+        Vec fb = kFeedback ? V::sll(modulator_sample, feedback_shift) : zero;
+        modulator_sample = logsinExpLanes<V>(V::add(modulator_phase, fb), modulator_value, tables);
+        Vec cp = V::add(carrier_phase, V::sll(modulator_sample, depth_shift));
+        Vec carrier_sample = logsinExpLanes<V>(cp, V::add(carrier_value, carrier_velocity), tables);
+
+        V::store(mix + i * W, V::add(V::load(mix + i * W), V::sll(carrier_sample, out_shift)));
+
+        carrier_phase = V::add(carrier_phase, carrier_inc);
+        modulator_phase = V::add(modulator_phase, V::mullo(carrier_inc, modulation_index));
+      }
+
+      V::store(lanes.carrier_phase + g, carrier_phase);
+      V::store(lanes.modulator_phase + g, modulator_phase);
+      V::store(lanes.carrier_phase_inc + g, carrier_inc);
+      V::store(lanes.modulator_phase_inc + g, modulator_inc);
+      V::store(lanes.modulator_sample + g, modulator_sample);
+      V::store(lanes.sample_count + g, sample_count);
+      V::store(lanes.carrier_adsr_state + g, carrier_state);
+      V::store(lanes.carrier_adsr_value + g, carrier_value);
+      V::store(lanes.modulator_adsr_state + g, modulator_state);
+      V::store(lanes.modulator_adsr_value + g, modulator_value);
+    }
+
+    for (int i = 0; i < n; i++) {
+      buffer[start + i] += V::hsum(V::load(mix + i * W));
+    }
+  }
+}
+
+template <class V>
+void dispatchFMLanes(const FMLanes& lanes, const FMLaneParams& params, int16_t* buffer, int num_samples) {
+  bool feedback = params.modulation_feedback > 0;
+  bool decay = params.carrier_decay != 0;
+  if (feedback && decay) {
+    renderFMLanes<V, true, true>(lanes, params, buffer, num_samples);
+  } else if (feedback) {
+    renderFMLanes<V, true, false>(lanes, params, buffer, num_samples);
+  } else if (decay) {
+    renderFMLanes<V, false, true>(lanes, params, buffer, num_samples);
+  } else {
+    renderFMLanes<V, false, false>(lanes, params, buffer, num_samples);
+  }
+}
+
+}  // namespace fm
@@ -1,6 +1,7 @@
 #include "libfm/fm_channel.hpp"
+#include "libfm/pitch.hpp"
 #include "libfm/tables.hpp"
-#include <cmath>
+#include "pitch_tables.hpp"
 
 namespace fm {
 
@@ -8,21 +9,24 @@ namespace {
 constexpr int PHASEBITS = 9;
 constexpr int PARTIALPHASEBITS = 10;
 
-int velocity_to_logatten(int velocity) {
-  float v = velocity / 127.0f;
-  float l = -log(v) / log(2);
-  return static_cast<int>(l * 64);
-}
 }  // namespace
 
+int velocityToLogatten(int velocity) {
+  velocity = velocity < 0 ? 0 : velocity > 127 ? 127 : velocity;
+  return pitch_tables::VELOCITY_LOGATTEN[velocity];
+}
+
+int fmPhaseInc(int note, const FMConfig& config) {
+  return notePhaseInc(note + 12 * config.octave_transpose, PHASEBITS + PARTIALPHASEBITS, config.sample_rate);
+}
+
 FMState::FMState() = default;
 
 void FMState::noteOn(int note, int velocity, const FMConfig& config) {
   carrier_adsr.trigger();
   modulator_adsr.trigger();
-  carrier_velocity = velocity_to_logatten(velocity);
-  float carrier_freq = 440 * pow(2, (note - 69 + (12 * config.octave_transpose)) / 12.0);
-  carrier_phase_inc = static_cast<int>((1 << (PHASEBITS + PARTIALPHASEBITS)) * carrier_freq / config.sample_rate);
+  carrier_velocity = velocityToLogatten(velocity);
+  carrier_phase_inc = fmPhaseInc(note, config);
   this->note = note;
 }
 
@@ -31,49 +35,194 @@ void FMState::noteOff(const FMConfig& config) {
   modulator_adsr.release();
 }
 
-void FMState::render(int16_t* buffer, int n, const FMConfig& config) {
-  for (int i = 0; i < n; i++) {
-    int sample_carry = sample_count;
-    sample_count++;
-    sample_carry = sample_carry ^ sample_count;
+void FMState::advance(int num_samples, const FMConfig& config) {
+  if (num_samples <= 0) {
+    return;
+  }
+  if (config.modulation_feedback > 0) {
+    int16_t scratch[256];
+    while (num_samples > 0) {
+      int n = num_samples < 256 ? num_samples : 256;
+      render(scratch, n, config);
+      num_samples -= n;
+    }
+    return;
+  }
 
-    if (config.carrier_decay && (sample_carry&0x40)) {
+  const uint32_t start = sample_count;
+  const uint32_t index = config.modulation_index;
+  uint32_t count = start;
+  uint32_t carrier = carrier_phase;
+  uint32_t modulator = modulator_phase;
+  uint32_t inc = carrier_phase_inc;
+  int remaining = num_samples;
+  while (remaining > 0) {
+    // the increments decay on samples whose counter has its low 6 bits set,
+    // until the shift no longer changes them
+    bool decaying = config.carrier_decay &&
+        ((carrier_phase_inc > 0 && (carrier_phase_inc >> config.carrier_decay) != 0) ||
+         (modulator_phase_inc > 0 && (modulator_phase_inc >> config.carrier_decay) != 0));
+    int run = remaining;
+    if (decaying) {
+      uint32_t until = (count | 0x3f) - count;
+      if (until < static_cast<uint32_t>(run)) {
+        run = until;
+      }
+    }
+    carrier += inc * run;
+    modulator += inc * index * run;
+    count += run;
+    remaining -= run;
+    if (remaining > 0 && decaying) {
       if (carrier_phase_inc > 0) {
         carrier_phase_inc -= (carrier_phase_inc >> config.carrier_decay);
       }
       if (modulator_phase_inc > 0) {
         modulator_phase_inc -= (modulator_phase_inc >> config.carrier_decay);
       }
+      inc = carrier_phase_inc;
+      carrier += inc;
+      modulator += inc * index;
+      count++;
+      remaining--;
     }
-    carrier_adsr.step(sample_carry, config.carrier_adsr);
-    modulator_adsr.step(sample_carry, config.modulator_adsr);
+  }
+  carrier_adsr.advance(start, num_samples, config.carrier_adsr);
+  modulator_adsr.advance(start, num_samples, config.modulator_adsr);
+
+  // the modulator output of the last sample, which render() keeps for
+  // feedback
+  int last_phase = static_cast<int>(modulator - inc * index);
+  int modsign = 1;
+  int logmod = modulator_adsr.value + logsin9(last_phase >> PARTIALPHASEBITS, &modsign);
+  modulator_sample = iexp11(logmod) * modsign;
+
+  sample_count = static_cast<int>(count);
+  carrier_phase = static_cast<int>(carrier);
+  modulator_phase = static_cast<int>(modulator);
+}
+
+void fmRenderGeneric(FMState& s, int16_t* buffer, int n, const FMConfig& config) {
+  for (int i = 0; i < n; i++) {
+    int sample_carry = s.sample_count;
+    s.sample_count++;
+    sample_carry = sample_carry ^ s.sample_count;
+
+    if (config.carrier_decay && (sample_carry&0x40)) {
+      if (s.carrier_phase_inc > 0) {
+        s.carrier_phase_inc -= (s.carrier_phase_inc >> config.carrier_decay);
+      }
+      if (s.modulator_phase_inc > 0) {
+        s.modulator_phase_inc -= (s.modulator_phase_inc >> config.carrier_decay);
+      }
+    }
+    s.carrier_adsr.step(sample_carry, config.carrier_adsr);
+    s.modulator_adsr.step(sample_carry, config.modulator_adsr);
 
     int fb = 0;
     if (config.modulation_feedback > 0) {
-      fb = modulator_sample << (config.modulation_feedback - 1);
+      fb = s.modulator_sample << (config.modulation_feedback - 1);
     }
     int modsign = 1;
-    int logmod = modulator_adsr.value + logsin9((modulator_phase + fb) >> PARTIALPHASEBITS, &modsign);
+    int logmod = s.modulator_adsr.value + logsin9((s.modulator_phase + fb) >> PARTIALPHASEBITS, &modsign);
+    s.modulator_sample = iexp11(logmod) * modsign;
+    int cp = s.carrier_phase + (s.modulator_sample << config.modulation_depth);
+    int carsign = 1;
+    int logcar = s.carrier_adsr.value + s.carrier_velocity + logsin9(cp >> PARTIALPHASEBITS, &carsign);
+    int carrier_sample = iexp11(logcar) * carsign;
+
+    buffer[i] += carrier_sample << 3;
+
+    s.carrier_phase += s.carrier_phase_inc;
+    s.modulator_phase += s.carrier_phase_inc * config.modulation_index;
+  }
+}
+
+namespace {
+
+// fmRenderGeneric with the feedback and carrier decay checks resolved at
+// compile time and the hot state kept in locals.
+template <unsigned F>
+void renderFMKernel(FMState& s, int16_t* buffer, int n, const FMConfig& config) {
+  constexpr bool kFeedback = F & FM_KERNEL_FEEDBACK;
+  constexpr bool kCarrierDecay = F & FM_KERNEL_CARRIER_DECAY;
+  const int feedback_shift = kFeedback ? config.modulation_feedback - 1 : 0;
+  const int depth = config.modulation_depth;
+  const int decay = config.carrier_decay;
+  const int index = config.modulation_index;
+
+  int sample_count = s.sample_count;
+  int carrier_phase = s.carrier_phase;
+  int modulator_phase = s.modulator_phase;
+  int carrier_phase_inc = s.carrier_phase_inc;
+  int modulator_phase_inc = s.modulator_phase_inc;
+  int modulator_sample = s.modulator_sample;
+
+  for (int i = 0; i < n; i++) {
+    int sample_carry = sample_count;
+    sample_count++;
+    sample_carry = sample_carry ^ sample_count;
+
+    if (kCarrierDecay && (sample_carry&0x40)) {
+      if (carrier_phase_inc > 0) {
+        carrier_phase_inc -= (carrier_phase_inc >> decay);
+      }
+      if (modulator_phase_inc > 0) {
+        modulator_phase_inc -= (modulator_phase_inc >> decay);
+      }
+    }
+    s.carrier_adsr.step(sample_carry, config.carrier_adsr);
+    s.modulator_adsr.step(sample_carry, config.modulator_adsr);
+
+    int fb = kFeedback ? modulator_sample << feedback_shift : 0;
+    int modsign = 1;
+    int logmod = s.modulator_adsr.value + logsin9((modulator_phase + fb) >> PARTIALPHASEBITS, &modsign);
     modulator_sample = iexp11(logmod) * modsign;
-    int cp = carrier_phase + (modulator_sample << config.modulation_depth);
+    int cp = carrier_phase + (modulator_sample << depth);
     int carsign = 1;
-    int logcar = carrier_adsr.value + carrier_velocity + logsin9(cp >> PARTIALPHASEBITS, &carsign);
+    int logcar = s.carrier_adsr.value + s.carrier_velocity + logsin9(cp >> PARTIALPHASEBITS, &carsign);
     int carrier_sample = iexp11(logcar) * carsign;
 
     buffer[i] += carrier_sample << 3;
 
-    int old_carrier_phase = carrier_phase;
     carrier_phase += carrier_phase_inc;
-    if (((old_carrier_phase ^ carrier_phase) & (1<<(PHASEBITS + PARTIALPHASEBITS))) && scope_index >= 1024) {
-      scope_index = 0;
-    }
-    modulator_phase += carrier_phase_inc * config.modulation_index;
+    modulator_phase += carrier_phase_inc * index;
+  }
 
-    if (scope_index < 1024) {
-      scope_buffer[scope_index] = carrier_sample * (1.0/2047.0);
-      scope_index++;
-    }
+  s.sample_count = sample_count;
+  s.carrier_phase = carrier_phase;
+  s.modulator_phase = modulator_phase;
+  s.carrier_phase_inc = carrier_phase_inc;
+  s.modulator_phase_inc = modulator_phase_inc;
+  s.modulator_sample = modulator_sample;
+}
+
+constexpr FMRenderFn fm_kernels[FM_KERNEL_COUNT] = {
+    &renderFMKernel<0>,
+    &renderFMKernel<FM_KERNEL_FEEDBACK>,
+    &renderFMKernel<FM_KERNEL_CARRIER_DECAY>,
+    &renderFMKernel<FM_KERNEL_FEEDBACK | FM_KERNEL_CARRIER_DECAY>,
+};
+
+}  // namespace
+
+unsigned fmKernelFeatures(const FMConfig& config) {
+  unsigned features = 0;
+  if (config.modulation_feedback > 0) {
+    features |= FM_KERNEL_FEEDBACK;
   }
+  if (config.carrier_decay) {
+    features |= FM_KERNEL_CARRIER_DECAY;
+  }
+  return features;
+}
+
+FMRenderFn fmRenderKernel(unsigned features) {
+  return fm_kernels[features & (FM_KERNEL_COUNT - 1)];
+}
+
+void FMState::render(int16_t* buffer, int n, const FMConfig& config) {
+  fmRenderKernel(fmKernelFeatures(config))(*this, buffer, n, config);
 }
 
 FMConfig::FMConfig() = default;
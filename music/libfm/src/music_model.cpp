@@ -0,0 +1,157 @@
+#include "libfm/music_model.hpp"
+
+namespace fm {
+
+namespace {
+constexpr uint32_t SUSTAIN_LEVEL = 0x40;
+constexpr int DETUNE = 2;
+constexpr int CARRIER_SHIFT = 1;
+constexpr int SNARE_POSITION = 4;  // song_position[2:0] that triggers the snare
+
+// PHASE_BITS, RELEASE and PULSE_WIDTH of each pulse_channel instance
+struct ChannelParams {
+  int phase_bits;
+  int release;
+  bool pulse_width;
+};
+constexpr ChannelParams channel_params[SONG_PULSE_TRACKS] = {
+    {18, 2, true},   // bass
+    {14, 4, true},   // melody
+    {18, 2, false},  // backup
+};
+}  // namespace
+
+MusicModel::MusicModel(const SongData& song) {
+  for (int track = 0; track < SONG_PULSE_TRACKS; track++) {
+    PulseChannel& ch = pulse_[track];
+    ch.phase_bits = channel_params[track].phase_bits;
+    ch.release = channel_params[track].release;
+    ch.pulse_width = channel_params[track].pulse_width;
+    uint32_t mask = (1u << ch.phase_bits) - 1;
+    for (int p = 0; p < MUSIC_SONG_LENGTH; p++) {
+      bool loaded = p < song.length();
+      ch.on[p] = loaded && song.on(track, p);
+      ch.trigger[p] = loaded && song.trigger(track, p);
+      // bass and melody tables are 10 bits wide, backup is 16
+      ch.phase_inc[p] = loaded ? song.pitch(track, p) & (track == SONG_BACKUP ? 0xffff : 0x3ff) & mask : 0;
+    }
+  }
+  reset();
+}
+
+void MusicModel::reset() {
+  for (PulseChannel& ch : pulse_) {
+    ch.phase1 = 0;
+    ch.phase2 = 0;
+    ch.amplitude = 0;
+  }
+  noise_.reset(noise_config_);
+  tick_counter_ = 0;
+  song_position_ = 0;
+  dac_accum_ = 0;
+  line_ = 0;
+}
+
+void MusicModel::sampleClock() {
+  for (PulseChannel& ch : pulse_) {
+    uint32_t mask = (1u << ch.phase_bits) - 1;
+    uint32_t inc = ch.phase_inc[song_position_];
+    ch.phase1 = (ch.phase1 + inc) & mask;
+    ch.phase2 = (ch.phase2 + (inc << CARRIER_SHIFT) + DETUNE) & mask;
+  }
+  noise_.advance(1, noise_config_);
+}
+
+void MusicModel::tickClock() {
+  bool song_clk = tick_counter_ == 4;
+  for (PulseChannel& ch : pulse_) {
+    if (song_clk && ch.trigger[song_position_]) {
+      ch.amplitude = 0xff;
+    } else {
+      // evaluated 32 bits wide and unsigned, as in the RTL, so an amplitude
+      // below the target wraps around and jumps up rather than creeping
+      uint32_t target = ch.on[song_position_] ? SUSTAIN_LEVEL : 0;
+      uint32_t step = (ch.amplitude - target + ((1u << ch.release) - 1)) >> ch.release;
+      ch.amplitude = (ch.amplitude - step) & 0xff;
+    }
+  }
+
+  noise_.tickEnvelopes(noise_config_);
+  if (song_clk && (song_position_ & 7) == SNARE_POSITION) {
+    noise_.trigger(noise_config_);
+  }
+
+  if (song_clk) {
+    song_position_ = (song_position_ + 1) & (MUSIC_SONG_LENGTH - 1);
+    tick_counter_ = 0;
+  } else {
+    tick_counter_++;
+  }
+}
+
+void MusicModel::render(uint16_t* buffer, int num_samples) {
+  for (int i = 0; i < num_samples; i++) {
+    sampleClock();
+    buffer[i] = sample();
+    if (++line_ == SONG_SAMPLES_PER_TICK) {
+      tickClock();
+      line_ = 0;
+    }
+  }
+}
+
+void MusicModel::advance(int num_samples) {
+  while (num_samples > 0) {
+    int run = SONG_SAMPLES_PER_TICK - line_;
+    if (run > num_samples) {
+      run = num_samples;
+    }
+    // song_position_ only changes on a tick, so every increment is constant
+    for (PulseChannel& ch : pulse_) {
+      uint32_t mask = (1u << ch.phase_bits) - 1;
+      uint32_t inc = ch.phase_inc[song_position_];
+      ch.phase1 = (ch.phase1 + inc * run) & mask;
+      ch.phase2 = (ch.phase2 + ((inc << CARRIER_SHIFT) + DETUNE) * run) & mask;
+    }
+    noise_.advance(run, noise_config_);
+    num_samples -= run;
+    line_ += run;
+    if (line_ == SONG_SAMPLES_PER_TICK) {
+      tickClock();
+      line_ = 0;
+    }
+  }
+}
+
+void MusicModel::seek(int position) {
+  reset();
+  for (int p = 0; p < position; p++) {
+    advance(SONG_SAMPLES_PER_POSITION);
+  }
+}
+
+int MusicModel::PulseChannel::sample() const {
+  uint32_t top = 1u << (phase_bits - 1);
+  uint32_t bits = pulse_width ? top | (top >> 1) : top;
+  int out = 0;
+  if ((phase1 & bits) == bits) out += amplitude;
+  if ((phase2 & bits) == bits) out += amplitude;
+  return out;
+}
+
+int MusicModel::channelSample(int track) const {
+  if (track == SONG_SNARE) {
+    return noise_.sample(noise_config_);
+  }
+  return pulse_[track].sample();
+}
+
+int MusicModel::sample() const {
+  int sum = channelSample(SONG_SNARE);
+  for (const PulseChannel& ch : pulse_) {
+    sum += ch.sample();
+  }
+  return sum & 0x1fff;
+}
+
+}  // namespace fm
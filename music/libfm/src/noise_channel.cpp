@@ -0,0 +1,251 @@
+#include "libfm/noise_channel.hpp"
+#include <algorithm>
+
+namespace fm {
+
+namespace {
+// Steps from one window of upcoming() to the next: the register at step s + k
+// needs bits k .. k + 15 of the window at s.
+constexpr int MAX_RUN = 48;
+
+// noise_channel.v: lfsr <= {lfsr[0], lfsr[0] ^ lfsr[14], lfsr[13:1]}, i.e. a
+// right-shifting Galois LFSR feeding back bit 0.
+constexpr uint32_t chipStep(uint32_t lfsr) {
+  uint32_t bit = lfsr & 1;
+  return (bit << 14) | ((bit ^ (lfsr >> 14)) << 13) | ((lfsr >> 1) & 0x1fff);
+}
+
+// synth.snare: left-shifting, feeding back bit 15.
+constexpr uint32_t snareStep(uint32_t lfsr) {
+  return ((lfsr & 0x8000) ? ((lfsr << 1) ^ 0x8016) : (lfsr << 1)) & 0xffff;
+}
+
+struct Variant {
+  int bits;
+  int feedback_bit;
+  uint32_t seed;
+  int trigger_volume;
+  int silent_volume;
+};
+
+constexpr Variant variants[] = {
+    {15, 0, 0x7fff, 0, 15},   // NOISE_CHIP
+    {16, 15, 0x1caf, 1, 16},  // NOISE_SNARE
+};
+
+// Words generated serially on reset(): the 15 words of history the recurrences
+// below need, plus one because the snare's seed sets bit 0, which the
+// recurrence only describes once it has been shifted out.
+constexpr int SEED_WORDS = 16;
+
+// Register as a function of the next `bits` feedback bits, one table per byte
+// of them.
+struct Unpack {
+  uint16_t table[2][256];
+
+  constexpr uint32_t operator()(uint64_t window) const {
+    return table[0][window & 0xff] ^ table[1][(window >> 8) & 0xff];
+  }
+};
+
+// The feedback bits are a linear function of the register. Inverting it
+// (Gauss-Jordan over GF(2), with the identity alongside in bits 16..31 of
+// each row) gives every register bit as an XOR of feedback bits.
+template <class Step>
+constexpr Unpack makeUnpack(Step step, int bits, int feedback_bit) {
+  uint32_t rows[16] = {};
+  for (int b = 0; b < bits; b++) {
+    uint32_t x = 1u << b;
+    for (int t = 0; t < bits; t++) {
+      rows[t] |= ((x >> feedback_bit) & 1) << b;
+      x = step(x);
+    }
+  }
+  for (int t = 0; t < bits; t++) {
+    rows[t] |= 1u << (16 + t);
+  }
+  for (int col = 0; col < bits; col++) {
+    int pivot = col;
+    while (!((rows[pivot] >> col) & 1)) {
+      pivot++;
+    }
+    uint32_t row = rows[pivot];
+    rows[pivot] = rows[col];
+    rows[col] = row;
+    for (int r = 0; r < bits; r++) {
+      if (r != col && ((rows[r] >> col) & 1)) {
+        rows[r] ^= row;
+      }
+    }
+  }
+
+  uint32_t columns[16] = {};  // register bits set by each feedback bit
+  for (int b = 0; b < bits; b++) {
+    for (int t = 0; t < bits; t++) {
+      columns[t] |= ((rows[b] >> (16 + t)) & 1) << b;
+    }
+  }
+  Unpack unpack{};
+  for (int half = 0; half < 2; half++) {
+    for (int i = 0; i < 256; i++) {
+      uint32_t x = 0;
+      for (int j = 0; j < 8; j++) {
+        if ((i >> j) & 1) {
+          x ^= columns[half * 8 + j];
+        }
+      }
+      unpack.table[half][i] = static_cast<uint16_t>(x);
+    }
+  }
+  return unpack;
+}
+
+constexpr Unpack chip_unpack = makeUnpack(chipStep, 15, 0);
+constexpr Unpack snare_unpack = makeUnpack(snareStep, 16, 15);
+
+}  // namespace
+
+NoiseState::NoiseState(const NoiseConfig& config) {
+  reset(config);
+}
+
+void NoiseState::reset(const NoiseConfig& config) {
+  const Variant& v = variants[config.variant];
+  volume_ = v.silent_volume;
+  tick_count_ = 0;
+  tick_sample_ = 0;
+  uint32_t x = v.seed;
+  for (int k = 0; k < SEED_WORDS; k++) {
+    uint64_t word = 0;
+    for (int i = 0; i < 64; i++) {
+      word |= static_cast<uint64_t>((x >> v.feedback_bit) & 1) << i;
+      x = config.variant == NOISE_CHIP ? chipStep(x) : snareStep(x);
+    }
+    stream_[k] = word;
+  }
+  words_ = SEED_WORDS;
+  step_ = 0;
+  fill(config.variant);
+}
+
+void NoiseState::trigger(const NoiseConfig& config) {
+  volume_ = variants[config.variant].trigger_volume;
+}
+
+void NoiseState::tickEnvelopes(const NoiseConfig& config) {
+  tick_sample_ = 0;
+  if (++tick_count_ >= config.decay) {
+    tick_count_ = 0;
+    if (volume_ < variants[config.variant].silent_volume) {
+      volume_++;
+    }
+  }
+}
+
+bool NoiseState::silent(const NoiseConfig&) const {
+  // the chip mutes at 15; the snare's 16-bit register is shifted out by then
+  return volume_ >= 15;
+}
+
+void NoiseState::render(int16_t* buffer, int num_samples, const NoiseConfig& config) {
+  if (silent(config)) {
+    advance(num_samples, config);
+  } else if (config.variant == NOISE_CHIP) {
+    renderChip(buffer, num_samples);
+  } else {
+    renderSnare(buffer, num_samples);
+  }
+}
+
+void NoiseState::renderChip(int16_t* buffer, int num_samples) {
+  // one window covers the next MAX_RUN steps, one per sample
+  const int shift = volume_ >> 1;
+  for (int i = 0; i < num_samples;) {
+    uint64_t window = upcoming();
+    int run = std::min(num_samples - i, MAX_RUN);
+    for (int s = 1; s <= run; s++, i++) {
+      // bits 0..13 of the register are the next 14 feedback bits as they are
+      buffer[i] += static_cast<int>((window >> s) & 0xff) >> shift;
+    }
+    step_ += run;
+    fill(NOISE_CHIP);
+  }
+}
+
+void NoiseState::renderSnare(int16_t* buffer, int num_samples) {
+  // the register steps on even phases and holds for the odd one after, so a
+  // window lasts up to twice as many samples
+  const int shift = volume_ + 1;
+  for (int i = 0; i < num_samples;) {
+    uint64_t window = upcoming();
+    int end = i + std::min(num_samples - i, 2 * MAX_RUN);
+    int start = i;
+    if (tick_sample_ & 1) {
+      buffer[i++] += static_cast<int>(snare_unpack(window)) >> shift;
+    }
+    int steps = 0;
+    while (i < end) {
+      int level = static_cast<int>(snare_unpack(window >> ++steps)) >> shift;
+      buffer[i++] += level;
+      if (i < end) {
+        buffer[i++] += level;
+      }
+    }
+    tick_sample_ += end - start;
+    step_ += steps;
+    fill(NOISE_SNARE);
+  }
+}
+
+void NoiseState::advance(int num_samples, const NoiseConfig& config) {
+  if (config.variant == NOISE_CHIP) {
+    step_ += num_samples;
+  } else {
+    // even sample phases in [tick_sample_, tick_sample_ + num_samples)
+    step_ += (tick_sample_ + num_samples + 1) / 2 - (tick_sample_ + 1) / 2;
+    tick_sample_ += num_samples;
+  }
+  fill(config.variant);
+}
+
+int NoiseState::sample(const NoiseConfig& config) const {
+  if (silent(config)) {
+    return 0;
+  }
+  if (config.variant == NOISE_CHIP) {
+    return static_cast<int>(upcoming() & 0xff) >> (volume_ >> 1);
+  }
+  return static_cast<int>(snare_unpack(upcoming())) >> (volume_ + 1);
+}
+
+uint32_t NoiseState::lfsr(const NoiseConfig& config) const {
+  return config.variant == NOISE_CHIP ? chip_unpack(upcoming()) : snare_unpack(upcoming());
+}
+
+uint64_t NoiseState::upcoming() const {
+  uint64_t k = step_ >> 6;
+  int offset = step_ & 63;
+  uint64_t lo = stream_[k % WORDS];
+  if (offset == 0) {
+    return lo;
+  }
+  return (lo >> offset) | (stream_[(k + 1) % WORDS] << (64 - offset));
+}
+
+// The feedback bits follow the register's characteristic polynomial: each is
+// the XOR of the bits 14 and 15 steps back for the chip, and 1, 12, 14 and 15
+// back for the snare. Raised to the 64th power the lags become that many
+// words, so word k is the XOR of the words those lags back.
+void NoiseState::fill(NoiseVariant variant) {
+  uint64_t needed = (step_ >> 6) + 2;
+  for (; words_ < needed; words_++) {
+    uint64_t k = words_;
+    uint64_t word = stream_[(k - 14) % WORDS] ^ stream_[(k - 15) % WORDS];
+    if (variant == NOISE_SNARE) {
+      word ^= stream_[(k - 1) % WORDS] ^ stream_[(k - 12) % WORDS];
+    }
+    stream_[k % WORDS] = word;
+  }
+}
+
+}  // namespace fm
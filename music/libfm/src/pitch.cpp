@@ -0,0 +1,40 @@
+#include "libfm/pitch.hpp"
+#include "pitch_tables.hpp"
+
+namespace fm {
+
+namespace {
+
+using namespace pitch_tables;
+
+// 16 octaves below the table down to 4 above (for transposed notes), which
+// keeps the shift below within 0..63 for phase_bits up to 32.
+constexpr int MIN_NOTE = TOP_NOTE - 12 * 16;
+constexpr int MAX_NOTE = TOP_NOTE + 12 * 5 - 1;
+
+uint64_t topOctaveInc(float sample_rate, int semitone) {
+  for (const RateTable& table : RATES) {
+    if (sample_rate == table.sample_rate) {
+      return table.top_octave[semitone];
+    }
+  }
+  uint64_t rate = static_cast<uint64_t>(sample_rate + 0.5f);
+  return (TOP_OCTAVE_HZ[semitone] << (TOP_BITS - FREQ_BITS)) / rate;
+}
+
+}  // namespace
+
+uint32_t notePhaseInc(int note, int phase_bits, float sample_rate, PitchRounding rounding) {
+  note = note < MIN_NOTE ? MIN_NOTE : note > MAX_NOTE ? MAX_NOTE : note;
+  int octave = (note - MIN_NOTE) / 12 - (TOP_NOTE - MIN_NOTE) / 12;  // relative to the table
+  int semitone = (note - MIN_NOTE) % 12;
+  int shift = TOP_BITS - phase_bits - octave;
+
+  uint64_t inc = topOctaveInc(sample_rate, semitone);
+  if (rounding == PITCH_NEAREST && shift > 0) {
+    inc += uint64_t(1) << (shift - 1);
+  }
+  return static_cast<uint32_t>(inc >> shift);
+}
+
+}  // namespace fm
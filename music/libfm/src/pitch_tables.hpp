@@ -0,0 +1,43 @@
+#pragma once
+// Generated by music/gen_pitch_tables.py; do not edit.
+
+#include <cstdint>
+
+namespace fm {
+namespace pitch_tables {
+
+// Increment at P phase bits for MIDI note TOP_NOTE + s is
+// top_octave[s] >> (TOP_BITS - P), one more bit of shift per octave down.
+constexpr int TOP_NOTE = 120;
+constexpr int TOP_BITS = 36;
+
+struct RateTable {
+  uint32_t sample_rate;
+  uint64_t top_octave[12];
+};
+
+constexpr RateTable RATES[] = {
+    {30000, {0x4770f3dc8ull, 0x4bb078656ull, 0x5030a7b9cull, 0x54f55a3ffull, 0x5a02a2e74ull, 0x5f5cd2a30ull, 0x65087c1aeull, 0x6b0a7792eull, 0x7167e70eeull, 0x78263ab59ull, 0x7f4b3575aull, 0x86dcf1f21ull}},
+    {44100, {0x309976df2ull, 0x337d45b62ull, 0x368d12511ull, 0x39cb7a58cull, 0x3d3b4347full, 0x40df5cc97ull, 0x44bae33a6ull, 0x48d122528ull, 0x4d2597f53ull, 0x51bbf72d2ull, 0x56982b554ull, 0x5bbe5b722ull}},
+    {48000, {0x2ca69869dull, 0x2f4e4b3f6ull, 0x321e68d42ull, 0x35195867full, 0x3841a5d08ull, 0x3b9a03a5eull, 0x3f254d90dull, 0x42e68abbdull, 0x46e0f0695ull, 0x4b17e4b17ull, 0x4f8f01698ull, 0x544a17374ull}},
+};
+
+// Top-octave frequencies in Hz << FREQ_BITS, for sample rates without a
+// table.
+constexpr int FREQ_BITS = 24;
+constexpr uint64_t TOP_OCTAVE_HZ[12] = {0x20b404a185ull, 0x22a5d81cebull, 0x24b545c75eull, 0x26e410402aull, 0x293414f23cull, 0x2ba74dac01ull, 0x2e3fd24f94ull, 0x30ffda9c8full, 0x33e9c01523ull, 0x3700000000ull, 0x3a453d88cbull, 0x3dbc4400feull};
+
+// -log2(velocity / 127) * 64, truncated; velocity 0 is fully attenuated.
+constexpr uint16_t VELOCITY_LOGATTEN[128] = {
+    511, 447, 383, 345, 319, 298, 281, 267, 255, 244, 234, 225, 217, 210, 203, 197,
+    191, 185, 180, 175, 170, 166, 161, 157, 153, 150, 146, 142, 139, 136, 133, 130,
+    127, 124, 121, 119, 116, 113, 111, 109, 106, 104, 102, 99, 97, 95, 93, 91,
+    89, 87, 86, 84, 82, 80, 78, 77, 75, 73, 72, 70, 69, 67, 66, 64,
+    63, 61, 60, 59, 57, 56, 55, 53, 52, 51, 49, 48, 47, 46, 45, 43,
+    42, 41, 40, 39, 38, 37, 35, 34, 33, 32, 31, 30, 29, 28, 27, 26,
+    25, 24, 23, 22, 22, 21, 20, 19, 18, 17, 16, 15, 14, 14, 13, 12,
+    11, 10, 9, 9, 8, 7, 6, 6, 5, 4, 3, 2, 2, 1, 0, 0,
+};
+
+}  // namespace pitch_tables
+}  // namespace fm
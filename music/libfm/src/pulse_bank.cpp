@@ -0,0 +1,162 @@
+#include "libfm/pulse_bank.hpp"
+#include "pulse_bank_kernel.hpp"
+#include "pulse_envelope.hpp"
+
+namespace fm {
+
+namespace {
+constexpr int PHASEBITS = PULSE_PHASEBITS;
+constexpr int LANE_ALIGN = 8;  // one AVX2 register of int32
+
+struct ScalarOps {
+  using Vec = int32_t;
+  using Shift = int;
+  static constexpr int kWidth = 1;
+
+  static Vec load(const int32_t* p) { return *p; }
+  static void store(int32_t* p, Vec v) { *p = v; }
+  static Vec set1(int32_t x) { return x; }
+  static Vec add(Vec a, Vec b) { return a + b; }
+  static Vec sub(Vec a, Vec b) { return a - b; }
+  static Vec andv(Vec a, Vec b) { return a & b; }
+  static Vec cmpeq(Vec a, Vec b) { return a == b ? -1 : 0; }
+  static Vec select(Vec m, Vec a, Vec b) { return m ? a : b; }
+  static Shift shiftCount(int k) { return k; }
+  static Vec sra(Vec v, Shift k) { return v >> k; }
+  static int32_t hsum(Vec v) { return v; }
+};
+}  // namespace
+
+void renderPulseLanesScalar(const PulseLanes& lanes, const PulseLaneParams& params,
+                            int16_t* buffer, int num_samples) {
+  if (params.lpf_enabled) {
+    renderPulseLanes<ScalarOps, true>(lanes, params, buffer, num_samples);
+  } else {
+    renderPulseLanes<ScalarOps, false>(lanes, params, buffer, num_samples);
+  }
+}
+
+PulseBank::PulseBank(int num_voices)
+    : num_voices_(num_voices),
+      num_lanes_((num_voices + LANE_ALIGN - 1) / LANE_ALIGN * LANE_ALIGN),
+      simd_level_(detectSimdLevel()),
+      note_(num_lanes_, 0),
+      octave_(num_lanes_, 0),
+      primary_phase_(num_lanes_, 0),
+      secondary_phase_(num_lanes_, 0),
+      volume_(num_lanes_, 0),
+      phase_inc_(num_lanes_, 0),
+      vibrato_sin_(num_lanes_, 0),
+      vibrato_cos_(num_lanes_, 1023),
+      adsr_state_(num_lanes_, 0),
+      vibrato_level_(num_lanes_, 0),
+      lpf_y_(num_lanes_, 0),
+      lpf_v_(num_lanes_, 0),
+      primary_step_(num_lanes_, 0),
+      secondary_step_(num_lanes_, 0) {}
+
+void PulseBank::setSimdLevel(SimdLevel level) {
+  SimdLevel supported = detectSimdLevel();
+  simd_level_ = level > supported ? supported : level;
+}
+
+void PulseBank::noteOn(int voice, int note, int, const PulseConfig& config) {
+  note_[voice] = note;
+  octave_[voice] = note / 12;
+  phase_inc_[voice] = pulsePhaseInc(note, config);
+  adsr_state_[voice] = 2;
+  volume_[voice] = 4095;
+  vibrato_sin_[voice] = 0;
+  vibrato_cos_[voice] = 1023;
+  vibrato_level_[voice] = 0;
+
+  primary_phase_[voice] = 0;
+  secondary_phase_[voice] = 0;
+}
+
+void PulseBank::noteOff(int voice, const PulseConfig&) {
+  adsr_state_[voice] = 4;
+}
+
+void PulseBank::tickEnvelopes(const PulseConfig& config) {
+  for (int i = 0; i < num_voices_; i++) {
+    tickPulseEnvelope(config, adsr_state_[i], volume_[i], vibrato_sin_[i], vibrato_cos_[i],
+                      vibrato_level_[i]);
+  }
+}
+
+void PulseBank::render(int16_t* buffer, int num_samples, const PulseConfig& config) {
+  // vibrato only moves on envelope ticks, so both phase steps are constant
+  // for the whole call
+  for (int i = 0; i < num_voices_; i++) {
+    int vibrato_inc = vibrato_level_[i] * vibrato_cos_[i] >> 10;
+    primary_step_[i] = phase_inc_[i] + vibrato_inc;
+    secondary_step_[i] = (phase_inc_[i] + vibrato_inc) * config.carrier_multiplier + config.detune;
+  }
+
+  PulseLanes lanes;
+  lanes.primary_phase = primary_phase_.data();
+  lanes.secondary_phase = secondary_phase_.data();
+  lanes.lpf_y = lpf_y_.data();
+  lanes.lpf_v = lpf_v_.data();
+  lanes.volume = volume_.data();
+  lanes.primary_step = primary_step_.data();
+  lanes.secondary_step = secondary_step_.data();
+  lanes.num_lanes = num_lanes_;
+
+  PulseLaneParams params;
+  params.mask = (1<<(PHASEBITS-1));
+  if (config.pulse_width & 1) {
+    params.mask |= (1<<(PHASEBITS-2));
+  }
+  params.phase_mask = (1<<PHASEBITS)-1;
+  params.lpf_enabled = config.lpf_enabled;
+  params.lpf_k1 = config.lpf_k1;
+  params.lpf_k2 = config.lpf_k2;
+
+  switch (simd_level_) {
+#if defined(LIBFM_X86_SIMD)
+    case SIMD_AVX2:
+      renderPulseLanesAvx2(lanes, params, buffer, num_samples);
+      break;
+    case SIMD_SSE41:
+      renderPulseLanesSse41(lanes, params, buffer, num_samples);
+      break;
+#endif
+    default:
+      renderPulseLanesScalar(lanes, params, buffer, num_samples);
+      break;
+  }
+}
+
+void PulseBank::loadVoice(int voice, const PulseState& state) {
+  note_[voice] = state.note;
+  octave_[voice] = state.octave;
+  primary_phase_[voice] = state.primary_phase;
+  secondary_phase_[voice] = state.secondary_phase;
+  volume_[voice] = state.volume;
+  phase_inc_[voice] = state.phase_inc;
+  vibrato_sin_[voice] = state.vibrato_sin;
+  vibrato_cos_[voice] = state.vibrato_cos;
+  adsr_state_[voice] = state.adsr_state;
+  vibrato_level_[voice] = state.vibrato_level;
+  lpf_y_[voice] = state.lpf_y;
+  lpf_v_[voice] = state.lpf_v;
+}
+
+void PulseBank::storeVoice(int voice, PulseState* state) const {
+  state->note = note_[voice];
+  state->octave = octave_[voice];
+  state->primary_phase = primary_phase_[voice];
+  state->secondary_phase = secondary_phase_[voice];
+  state->volume = volume_[voice];
+  state->phase_inc = phase_inc_[voice];
+  state->vibrato_sin = vibrato_sin_[voice];
+  state->vibrato_cos = vibrato_cos_[voice];
+  state->adsr_state = adsr_state_[voice];
+  state->vibrato_level = vibrato_level_[voice];
+  state->lpf_y = lpf_y_[voice];
+  state->lpf_v = lpf_v_[voice];
+}
+
+}  // namespace fm
@@ -0,0 +1,40 @@
+#include "pulse_bank_kernel.hpp"
+#include <immintrin.h>
+
+namespace fm {
+
+namespace {
+struct Avx2Ops {
+  using Vec = __m256i;
+  using Shift = __m128i;
+  static constexpr int kWidth = 8;
+
+  static Vec load(const int32_t* p) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)); }
+  static void store(int32_t* p, Vec v) { _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), v); }
+  static Vec set1(int32_t x) { return _mm256_set1_epi32(x); }
+  static Vec add(Vec a, Vec b) { return _mm256_add_epi32(a, b); }
+  static Vec sub(Vec a, Vec b) { return _mm256_sub_epi32(a, b); }
+  static Vec andv(Vec a, Vec b) { return _mm256_and_si256(a, b); }
+  static Vec cmpeq(Vec a, Vec b) { return _mm256_cmpeq_epi32(a, b); }
+  static Vec select(Vec m, Vec a, Vec b) { return _mm256_blendv_epi8(b, a, m); }
+  static Shift shiftCount(int k) { return _mm_cvtsi32_si128(k); }
+  static Vec sra(Vec v, Shift k) { return _mm256_sra_epi32(v, k); }
+  static int32_t hsum(Vec v) {
+    __m128i x = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    x = _mm_add_epi32(x, _mm_shuffle_epi32(x, _MM_SHUFFLE(1, 0, 3, 2)));
+    x = _mm_add_epi32(x, _mm_shuffle_epi32(x, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(x);
+  }
+};
+}  // namespace
+
+void renderPulseLanesAvx2(const PulseLanes& lanes, const PulseLaneParams& params,
+                          int16_t* buffer, int num_samples) {
+  if (params.lpf_enabled) {
+    renderPulseLanes<Avx2Ops, true>(lanes, params, buffer, num_samples);
+  } else {
+    renderPulseLanes<Avx2Ops, false>(lanes, params, buffer, num_samples);
+  }
+}
+
+}  // namespace fm
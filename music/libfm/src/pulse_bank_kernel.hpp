@@ -0,0 +1,102 @@
+#pragma once
+#include <cstdint>
+
+// Shared by the scalar, SSE4.1 and AVX2 PulseBank kernels. Each kernel
+// translation unit is built with its own -m flags and instantiates
+// renderPulseLanes with vector ops declared in an anonymous namespace, so no
+// ISA-specific code can leak into another translation unit through COMDAT
+// folding. Keep std:: helpers out of this header for the same reason.
+
+namespace fm {
+
+struct PulseLanes {
+  int32_t* primary_phase;
+  int32_t* secondary_phase;
+  int32_t* lpf_y;
+  int32_t* lpf_v;
+  const int32_t* volume;
+  const int32_t* primary_step;
+  const int32_t* secondary_step;
+  int num_lanes;  // multiple of the widest vector
+};
+
+struct PulseLaneParams {
+  int32_t mask;        // pulse width mask, both MSBs set for 25% duty
+  int32_t phase_mask;  // (1 << PHASEBITS) - 1
+  bool lpf_enabled;
+  int lpf_k1;
+  int lpf_k2;
+};
+
+void renderPulseLanesScalar(const PulseLanes& lanes, const PulseLaneParams& params,
+                            int16_t* buffer, int num_samples);
+void renderPulseLanesSse41(const PulseLanes& lanes, const PulseLaneParams& params,
+                           int16_t* buffer, int num_samples);
+void renderPulseLanesAvx2(const PulseLanes& lanes, const PulseLaneParams& params,
+                          int16_t* buffer, int num_samples);
+
+// Renders V::kWidth voices at a time, sample by sample, accumulating every
+// group into a per-chunk mix of vectors which is reduced once per sample at the
+// end. This mirrors PulseState::render exactly, including the int16 wrap of
+// buffer[i] += sample (the sum of all voices wraps the same way).
+template <class V, bool kLpf>
+void renderPulseLanes(const PulseLanes& lanes, const PulseLaneParams& params,
+                      int16_t* buffer, int num_samples) {
+  constexpr int W = V::kWidth;
+  constexpr int CHUNK = 64;
+  alignas(32) int32_t mix[CHUNK * W];
+
+  const typename V::Vec mask = V::set1(params.mask);
+  const typename V::Vec phase_mask = V::set1(params.phase_mask);
+  const typename V::Shift k1 = V::shiftCount(params.lpf_k1);
+  const typename V::Shift k2 = V::shiftCount(params.lpf_k2);
+
+  for (int start = 0; start < num_samples; start += CHUNK) {
+    int n = num_samples - start;
+    if (n > CHUNK) {
+      n = CHUNK;
+    }
+    for (int i = 0; i < n * W; i++) {
+      mix[i] = 0;
+    }
+
+    for (int g = 0; g < lanes.num_lanes; g += W) {
+      typename V::Vec p1 = V::load(lanes.primary_phase + g);
+      typename V::Vec p2 = V::load(lanes.secondary_phase + g);
+      typename V::Vec y = V::load(lanes.lpf_y + g);
+      typename V::Vec v = V::load(lanes.lpf_v + g);
+      const typename V::Vec vol = V::load(lanes.volume + g);
+      const typename V::Vec neg_vol = V::sub(V::set1(0), vol);
+      const typename V::Vec step1 = V::load(lanes.primary_step + g);
+      const typename V::Vec step2 = V::load(lanes.secondary_step + g);
+
+      for (int i = 0; i < n; i++) {
+        typename V::Vec on1 = V::cmpeq(V::andv(p1, mask), mask);
+        typename V::Vec on2 = V::cmpeq(V::andv(p2, mask), mask);
+        typename V::Vec sample = V::add(V::select(on1, vol, neg_vol),
+                                        V::select(on2, vol, neg_vol));
+        if (kLpf) {
+          y = V::add(y, V::sra(v, k2));
+          v = V::sub(v, V::sra(v, k1));
+          v = V::add(v, V::sub(sample, y));
+          sample = y;
+        }
+        V::store(mix + i * W, V::add(V::load(mix + i * W), sample));
+
+        p1 = V::andv(V::add(p1, step1), phase_mask);
+        p2 = V::andv(V::add(p2, step2), phase_mask);
+      }
+
+      V::store(lanes.primary_phase + g, p1);
+      V::store(lanes.secondary_phase + g, p2);
+      V::store(lanes.lpf_y + g, y);
+      V::store(lanes.lpf_v + g, v);
+    }
+
+    for (int i = 0; i < n; i++) {
+      buffer[start + i] += V::hsum(V::load(mix + i * W));
+    }
+  }
+}
+
+}  // namespace fm
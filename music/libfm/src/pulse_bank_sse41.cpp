@@ -0,0 +1,39 @@
+#include "pulse_bank_kernel.hpp"
+#include <smmintrin.h>
+
+namespace fm {
+
+namespace {
+struct Sse41Ops {
+  using Vec = __m128i;
+  using Shift = __m128i;
+  static constexpr int kWidth = 4;
+
+  static Vec load(const int32_t* p) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+  static void store(int32_t* p, Vec v) { _mm_storeu_si128(reinterpret_cast<__m128i*>(p), v); }
+  static Vec set1(int32_t x) { return _mm_set1_epi32(x); }
+  static Vec add(Vec a, Vec b) { return _mm_add_epi32(a, b); }
+  static Vec sub(Vec a, Vec b) { return _mm_sub_epi32(a, b); }
+  static Vec andv(Vec a, Vec b) { return _mm_and_si128(a, b); }
+  static Vec cmpeq(Vec a, Vec b) { return _mm_cmpeq_epi32(a, b); }
+  static Vec select(Vec m, Vec a, Vec b) { return _mm_blendv_epi8(b, a, m); }
+  static Shift shiftCount(int k) { return _mm_cvtsi32_si128(k); }
+  static Vec sra(Vec v, Shift k) { return _mm_sra_epi32(v, k); }
+  static int32_t hsum(Vec v) {
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(v);
+  }
+};
+}  // namespace
+
+void renderPulseLanesSse41(const PulseLanes& lanes, const PulseLaneParams& params,
+                           int16_t* buffer, int num_samples) {
+  if (params.lpf_enabled) {
+    renderPulseLanes<Sse41Ops, true>(lanes, params, buffer, num_samples);
+  } else {
+    renderPulseLanes<Sse41Ops, false>(lanes, params, buffer, num_samples);
+  }
+}
+
+}  // namespace fm
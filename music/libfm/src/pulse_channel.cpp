@@ -1,26 +1,28 @@
 #include "libfm/pulse_channel.hpp"
 #include "libfm/tables.hpp"
-#include <cmath>
+#include "pulse_envelope.hpp"
+#include <array>
+#include <utility>
 
 namespace fm {
 
 namespace {
-// at 30kHz this gives a frequency resolution of 1.8Hz
-constexpr int PHASEBITS = 18;
+constexpr int PHASEBITS = PULSE_PHASEBITS;
 }  // namespace
 
 PulseState::PulseState() = default;
 
 PulseConfig::PulseConfig() = default;
 
+int pulsePhaseInc(int note, const PulseConfig& config) {
+  return notePhaseInc(note + 12 * config.octave_transpose, PHASEBITS, config.sample_rate,
+                      config.pitch_rounding);
+}
+
 void PulseState::noteOn(int note, int velocity, const PulseConfig& config) {
   this->note = note;
   this->octave = note / 12;
-
-  // TODO: optimize phase increments to use a 12-entry table and mux the octave
-  // from the phase bits
-
-  this->phase_inc = (1 << PHASEBITS) * 440 * pow(2, (note - 69 + (12 * config.octave_transpose)) / 12.0) / config.sample_rate;
+  this->phase_inc = pulsePhaseInc(note, config);
   this->adsr_state = 2;
   this->volume = 4095;
   this->vibrato_sin = 0;
@@ -35,94 +37,171 @@ void PulseState::noteOff(const PulseConfig& config) {
   this->adsr_state = 4;
 }
 
+void PulseState::retrigger(int phase_inc, const PulseConfig&) {
+  this->phase_inc = phase_inc;
+  this->adsr_state = 2;
+  this->volume = 4095;
+  this->vibrato_level = 0;
+}
+
 
 void PulseState::tickEnvelopes(const PulseConfig& config) {
-  vibrato_cos -= vibrato_sin >> config.vibrato_rate;
-  vibrato_sin += vibrato_cos >> config.vibrato_rate;
-
-  switch (adsr_state) {
-    case 0:
-      return;
-    case 1:
-      // attack is always instantaneous
-      volume = 4095;
-      adsr_state = 2;
-      break;
-    case 2:
-    {
-      int dv = volume - config.sustain;
-      int rounding = (1<<config.decay) - 1;
-      volume -= (dv + rounding) >> config.decay;
-      if (volume <= config.sustain) {
-        volume = config.sustain;
-        adsr_state = 3;
-      }
-      if (config.vibrato_envelope) {
-        int dl = config.vibrato_depth - vibrato_level;
-        int rounding = (1<<config.vibrato_envelope) - 1;
-        vibrato_level += (dl + rounding) >> config.vibrato_envelope;
-      }
-      break;
-    }
-    case 3:
-      volume = config.sustain;
-      break;
-    case 4:
-    {
-      int dv = volume;
-      int rounding = (1<<config.release) - 1;
-      volume -= (dv + rounding) >> config.release;
-      if (volume <= 0) {
-        volume = 0;
-        adsr_state = 0;
-      }
-      break;
-    }
-  }
+  tickPulseEnvelope(config, adsr_state, volume, vibrato_sin, vibrato_cos, vibrato_level);
 
   // TODO: vibrato
 }
 
+void PulseState::advance(int num_samples, const PulseConfig& config) {
+  if (config.lpf_enabled) {
+    int16_t scratch[256];
+    while (num_samples > 0) {
+      int n = num_samples < 256 ? num_samples : 256;
+      render(scratch, n, config);
+      num_samples -= n;
+    }
+    return;
+  }
+  if (num_samples <= 0) {
+    return;
+  }
+  const uint32_t mask = (1u << PHASEBITS) - 1;
+  const uint32_t n = num_samples;
+  int step = phase_inc + (vibrato_level * vibrato_cos >> 10);
+  int secondary_step = step * config.carrier_multiplier + config.detune;
+  primary_phase = (primary_phase + static_cast<uint32_t>(step) * n) & mask;
+  secondary_phase = (secondary_phase + static_cast<uint32_t>(secondary_step) * n) & mask;
+}
+
+void PulseState::advanceTicks(int num_ticks, const PulseConfig& config) {
+  for (int i = 0; i < num_ticks; i++) {
+    tickEnvelopes(config);
+  }
+}
 
-void PulseState::render(int16_t* buffer, int num_samples, const PulseConfig& config) {
+void pulseRenderGeneric(PulseState& s, int16_t* buffer, int num_samples, const PulseConfig& config) {
   for (int i = 0; i < num_samples; i++) {
     int sample = 0;
     int mask = (1<<(PHASEBITS-1));
     if (config.pulse_width & 1) {
       mask |= (1<<(PHASEBITS-2));
     }
-    if ((primary_phase & mask) == mask) {
-      sample += volume;
+    if ((s.primary_phase & mask) == mask) {
+      sample += s.volume;
     } else {
-      sample -= volume;
+      sample -= s.volume;
     }
-    if ((secondary_phase & mask) == mask) {
-      sample += volume;
+    if ((s.secondary_phase & mask) == mask) {
+      sample += s.volume;
     } else {
-      sample -= volume;
+      sample -= s.volume;
     }
     if (config.lpf_enabled) {
-      lpf_y += lpf_v >> config.lpf_k2;
-      lpf_v -= lpf_v >> config.lpf_k1;
-      lpf_v += sample - lpf_y;
-      sample = lpf_y;
+      s.lpf_y += s.lpf_v >> config.lpf_k2;
+      s.lpf_v -= s.lpf_v >> config.lpf_k1;
+      s.lpf_v += sample - s.lpf_y;
+      sample = s.lpf_y;
     }
     buffer[i] += sample;
 
-    int vibrato_inc = vibrato_level * vibrato_cos >> 10;
+    int vibrato_inc = s.vibrato_level * s.vibrato_cos >> 10;
+
+    s.primary_phase += s.phase_inc + vibrato_inc;
+    s.secondary_phase += (s.phase_inc + vibrato_inc) * config.carrier_multiplier + config.detune;
+    s.primary_phase &= (1<<PHASEBITS)-1;
+    s.secondary_phase &= (1<<PHASEBITS)-1;
+  }
+}
 
-    primary_phase += phase_inc + vibrato_inc;
-    // synchronize scope buffer to primary phase
-    if (scope_index >= 1024 && primary_phase & (1<<PHASEBITS)) {
-      scope_index = 0;
+namespace {
+
+// Same loop as pulseRenderGeneric with every per-sample config check resolved
+// at compile time. Vibrato only moves on envelope ticks, so both phase steps
+// are constant for the call and the multiplier/detune/vibrato bits only shape
+// how they are computed; the LPF and duty bits shape the loop itself.
+template <unsigned F>
+void renderPulseKernel(PulseState& s, int16_t* buffer, int num_samples, const PulseConfig& config) {
+  constexpr bool kLpf = F & PULSE_KERNEL_LPF;
+  constexpr int mask = (F & PULSE_KERNEL_QUARTER_DUTY)
+      ? (1<<(PHASEBITS-1)) | (1<<(PHASEBITS-2))
+      : (1<<(PHASEBITS-1));
+
+  int step = s.phase_inc;
+  if (F & PULSE_KERNEL_VIBRATO) {
+    step += s.vibrato_level * s.vibrato_cos >> 10;
+  }
+  int secondary_step = (F & PULSE_KERNEL_UNIT_MULTIPLIER) ? step : step * config.carrier_multiplier;
+  if (!(F & PULSE_KERNEL_NO_DETUNE)) {
+    secondary_step += config.detune;
+  }
+  const int volume = s.volume;
+  const int k1 = config.lpf_k1;
+  const int k2 = config.lpf_k2;
+
+  int primary_phase = s.primary_phase;
+  int secondary_phase = s.secondary_phase;
+  int lpf_y = s.lpf_y;
+  int lpf_v = s.lpf_v;
+
+  for (int i = 0; i < num_samples; i++) {
+    int sample = (primary_phase & mask) == mask ? volume : -volume;
+    sample += (secondary_phase & mask) == mask ? volume : -volume;
+    if (kLpf) {
+      lpf_y += lpf_v >> k2;
+      lpf_v -= lpf_v >> k1;
+      lpf_v += sample - lpf_y;
+      sample = lpf_y;
     }
-    secondary_phase += (phase_inc + vibrato_inc) * config.carrier_multiplier + config.detune;
+    buffer[i] += sample;
+
+    primary_phase += step;
+    secondary_phase += secondary_step;
     primary_phase &= (1<<PHASEBITS)-1;
     secondary_phase &= (1<<PHASEBITS)-1;
-    if (scope_index < 1024) {
-      scope_buffer[scope_index++] = sample / 4096.0f;
-    }
   }
+
+  s.primary_phase = primary_phase;
+  s.secondary_phase = secondary_phase;
+  s.lpf_y = lpf_y;
+  s.lpf_v = lpf_v;
+}
+
+template <unsigned... F>
+constexpr std::array<PulseRenderFn, PULSE_KERNEL_COUNT> makePulseKernels(
+    std::integer_sequence<unsigned, F...>) {
+  return {{&renderPulseKernel<F>...}};
+}
+
+constexpr std::array<PulseRenderFn, PULSE_KERNEL_COUNT> pulse_kernels =
+    makePulseKernels(std::make_integer_sequence<unsigned, PULSE_KERNEL_COUNT>());
+
+}  // namespace
+
+unsigned pulseKernelFeatures(const PulseState& state, const PulseConfig& config) {
+  unsigned features = 0;
+  if (config.lpf_enabled) {
+    features |= PULSE_KERNEL_LPF;
+  }
+  if (config.pulse_width & 1) {
+    features |= PULSE_KERNEL_QUARTER_DUTY;
+  }
+  if (config.carrier_multiplier == 1) {
+    features |= PULSE_KERNEL_UNIT_MULTIPLIER;
+  }
+  if (config.detune == 0) {
+    features |= PULSE_KERNEL_NO_DETUNE;
+  }
+  if (state.vibrato_level != 0) {
+    features |= PULSE_KERNEL_VIBRATO;
+  }
+  return features;
+}
+
+PulseRenderFn pulseRenderKernel(unsigned features) {
+  return pulse_kernels[features & (PULSE_KERNEL_COUNT - 1)];
+}
+
+void PulseState::render(int16_t* buffer, int num_samples, const PulseConfig& config) {
+  pulseRenderKernel(pulseKernelFeatures(*this, config))(*this, buffer, num_samples, config);
 }
 
 }  // namespace fm
\ No newline at end of file
@@ -0,0 +1,54 @@
+#pragma once
+#include "libfm/pulse_channel.hpp"
+
+namespace fm {
+
+// Per-tick envelope and vibrato update, shared by PulseState and PulseBank so
+// both stay in lockstep.
+inline void tickPulseEnvelope(const PulseConfig& config, int& adsr_state, int& volume,
+                              int& vibrato_sin, int& vibrato_cos, int& vibrato_level) {
+  vibrato_cos -= vibrato_sin >> config.vibrato_rate;
+  vibrato_sin += vibrato_cos >> config.vibrato_rate;
+
+  switch (adsr_state) {
+    case 0:
+      return;
+    case 1:
+      // attack is always instantaneous
+      volume = 4095;
+      adsr_state = 2;
+      break;
+    case 2:
+    {
+      int dv = volume - config.sustain;
+      int rounding = (1<<config.decay) - 1;
+      volume -= (dv + rounding) >> config.decay;
+      if (volume <= config.sustain) {
+        volume = config.sustain;
+        adsr_state = 3;
+      }
+      if (config.vibrato_envelope) {
+        int dl = config.vibrato_depth - vibrato_level;
+        int rounding = (1<<config.vibrato_envelope) - 1;
+        vibrato_level += (dl + rounding) >> config.vibrato_envelope;
+      }
+      break;
+    }
+    case 3:
+      volume = config.sustain;
+      break;
+    case 4:
+    {
+      int dv = volume;
+      int rounding = (1<<config.release) - 1;
+      volume -= (dv + rounding) >> config.release;
+      if (volume <= 0) {
+        volume = 0;
+        adsr_state = 0;
+      }
+      break;
+    }
+  }
+}
+
+}  // namespace fm
@@ -0,0 +1,148 @@
+#include "libfm/render_pool.hpp"
+#include <algorithm>
+#include <chrono>
+
+namespace fm {
+
+namespace {
+
+// How long an idle worker keeps spinning before it sleeps. Longer than an
+// audio block, so workers stay awake while blocks keep getting split.
+constexpr auto SPIN_TIME = std::chrono::milliseconds(2);
+// Spinning threads yield every this many iterations in case they are keeping
+// the thread they wait for off the CPU.
+constexpr int YIELD_SPINS = 256;
+
+inline void cpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__)
+  asm volatile("yield");
+#endif
+}
+
+void emptyJob(void*, int) {}
+
+}  // namespace
+
+RenderPool::RenderPool(int workers, StartFn on_start) {
+  workers = std::max(workers, 0);
+  queues_.reset(new Queue[workers + 1]);
+  threads_.reserve(workers);
+  for (int i = 0; i < workers; i++) {
+    threads_.emplace_back(&RenderPool::workerThread, this, i + 1, on_start);
+  }
+  dispatch_overhead_ns_ = measureDispatchOverhead();
+}
+
+RenderPool::~RenderPool() {
+  {
+    std::lock_guard<std::mutex> lock(sleep_mutex_);
+    stop_ = true;
+    generation_++;
+  }
+  wake_.notify_all();
+  for (auto& thread : threads_) {
+    thread.join();
+  }
+}
+
+void RenderPool::run(JobFn fn, void* context, int jobs) {
+  if (jobs <= 0) {
+    return;
+  }
+  if (threads_.empty()) {
+    for (int job = 0; job < jobs; job++) {
+      fn(context, job);
+    }
+    return;
+  }
+
+  // split the jobs into one contiguous run per participant
+  int participants = workers() + 1;
+  for (int p = 0; p < participants; p++) {
+    queues_[p].next.store(jobs * p / participants, std::memory_order_relaxed);
+    queues_[p].end = jobs * (p + 1) / participants;
+  }
+  fn_ = fn;
+  context_ = context;
+  pending_.store(participants, std::memory_order_relaxed);
+
+  // seq_cst pairs with the sleeper count in workerThread so a worker going to
+  // sleep either sees this generation or gets notified
+  generation_++;
+  if (sleepers_ > 0) {
+    std::lock_guard<std::mutex> lock(sleep_mutex_);
+    wake_.notify_all();
+  }
+
+  drain(0);
+  pending_.fetch_sub(1, std::memory_order_release);
+  // workers that have not checked in yet may be sharing our core; give them
+  // the CPU if they are slow to show up
+  for (int spins = 1; pending_.load(std::memory_order_acquire) != 0; spins++) {
+    cpuRelax();
+    if (spins % YIELD_SPINS == 0) {
+      std::this_thread::yield();
+    }
+  }
+}
+
+void RenderPool::drain(int self) {
+  int participants = workers() + 1;
+  for (int k = 0; k < participants; k++) {
+    Queue& queue = queues_[(self + k) % participants];
+    int job;
+    while ((job = queue.next.fetch_add(1, std::memory_order_relaxed)) < queue.end) {
+      fn_(context_, job);
+    }
+  }
+}
+
+void RenderPool::workerThread(int self, StartFn on_start) {
+  if (on_start) {
+    on_start();
+  }
+  uint32_t seen = 0;
+  for (;;) {
+    uint32_t generation;
+    auto idle_since = std::chrono::steady_clock::now();
+    int spins = 0;
+    while ((generation = generation_.load(std::memory_order_acquire)) == seen) {
+      cpuRelax();
+      if (++spins % YIELD_SPINS != 0) {
+        continue;
+      }
+      std::this_thread::yield();
+      if (std::chrono::steady_clock::now() - idle_since > SPIN_TIME) {
+        std::unique_lock<std::mutex> lock(sleep_mutex_);
+        sleepers_++;
+        wake_.wait(lock, [&] { return generation_ != seen; });
+        sleepers_--;
+      }
+    }
+    if (stop_) {
+      return;
+    }
+    seen = generation;
+    drain(self);
+    pending_.fetch_sub(1, std::memory_order_release);
+  }
+}
+
+int64_t RenderPool::measureDispatchOverhead() {
+  if (threads_.empty()) {
+    return 0;
+  }
+  constexpr int RUNS = 201;
+  std::vector<int64_t> times(RUNS);
+  for (int64_t& t : times) {
+    auto start = std::chrono::steady_clock::now();
+    run(emptyJob, nullptr, 2 * (workers() + 1));
+    t = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+  }
+  std::nth_element(times.begin(), times.begin() + RUNS / 2, times.end());
+  return times[RUNS / 2];
+}
+
+}  // namespace fm
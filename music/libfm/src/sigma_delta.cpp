@@ -0,0 +1,187 @@
+#include "libfm/sigma_delta.hpp"
+#include <cmath>
+#include "sigma_delta_kernel.hpp"
+
+namespace fm {
+
+namespace {
+constexpr int CIC_ORDER = 3;
+constexpr int CIC_DECIMATION = 32;
+constexpr int CIC_BYTES = CIC_DECIMATION / 8;
+constexpr int CIC_GAIN = CIC_DECIMATION * CIC_DECIMATION * CIC_DECIMATION;  // 2^15
+constexpr int FIR_DECIMATION = SIGMA_DELTA_DECIMATION / CIC_DECIMATION;
+constexpr int FIR_TAPS = 32 * FIR_DECIMATION;  // a multiple of the AVX2 kernel's step
+constexpr double FIR_CUTOFF = 0.47;            // of the output sample rate
+constexpr double PI = 3.14159265358979323846;
+
+static_assert(SIGMA_DELTA_DECIMATION % CIC_DECIMATION == 0, "CIC must divide the decimation");
+
+// Advancing the integrators over 8 bits at once: with b_i the bit at clock i
+// of the byte, the first gains the count of ones, the second sum(b_i * (8 - i))
+// on top of 8 times the first, and the third sum(b_i * T(8 - i)), T(n) being
+// n(n+1)/2, on top of 8 and 36 times the second and first.
+struct ByteMoments {
+  uint8_t count[256];
+  uint8_t first[256];
+  uint8_t second[256];
+};
+
+constexpr ByteMoments makeByteMoments() {
+  ByteMoments m{};
+  for (int b = 0; b < 256; b++) {
+    for (int i = 0; i < 8; i++) {
+      if ((b >> i) & 1) {
+        int n = 8 - i;
+        m.count[b] += 1;
+        m.first[b] += n;
+        m.second[b] += n * (n + 1) / 2;
+      }
+    }
+  }
+  return m;
+}
+
+constexpr ByteMoments byte_moments = makeByteMoments();
+
+// CIC magnitude response at f cycles per CIC output sample; 1 at DC.
+double cicResponse(double f) {
+  if (f == 0) {
+    return 1;
+  }
+  double r = std::sin(PI * f) / (CIC_DECIMATION * std::sin(PI * f / CIC_DECIMATION));
+  return r * r * r;
+}
+
+// Blackman-windowed low-pass whose passband is 1 / cicResponse, in Q15
+// summing to exactly 1. The ideal response is the plain sinc plus the
+// transform of the (small, smooth) compensation term 1 / cicResponse - 1.
+std::vector<int16_t> designTaps() {
+  const double cutoff = FIR_CUTOFF / FIR_DECIMATION;  // cycles per CIC output
+  const int steps = 64;
+  const double centre = (FIR_TAPS - 1) / 2.0;
+
+  std::vector<double> h(FIR_TAPS);
+  double sum = 0;
+  for (int n = 0; n < FIR_TAPS; n++) {
+    double t = n - centre;
+    double ideal = 2 * cutoff * std::sin(2 * PI * cutoff * t) / (2 * PI * cutoff * t);
+    for (int s = 0; s < steps; s++) {
+      double f = (s + 0.5) * cutoff / steps;
+      ideal += 2 * (1 / cicResponse(f) - 1) * std::cos(2 * PI * f * t) * cutoff / steps;
+    }
+    double x = 2 * PI * n / (FIR_TAPS - 1);
+    h[n] = ideal * (0.42 - 0.5 * std::cos(x) + 0.08 * std::cos(2 * x));
+    sum += h[n];
+  }
+
+  std::vector<int16_t> taps(FIR_TAPS);
+  int total = 0;
+  for (int n = 0; n < FIR_TAPS; n++) {
+    taps[n] = static_cast<int16_t>(std::lround(h[n] / sum * 32768));
+    total += taps[n];
+  }
+  taps[FIR_TAPS / 2] += 32768 - total;  // rounding, so DC passes exactly
+  return taps;
+}
+
+struct ScalarOps {
+  using Vec = int32_t;
+  using Acc = int32_t;
+  static constexpr int kWidth = 1;
+
+  static Vec load(const int16_t* p) { return *p; }
+  static Acc zero() { return 0; }
+  static Acc madd(Vec a, Vec b) { return a * b; }
+  static Acc add(Acc a, Acc b) { return a + b; }
+  static int32_t hsum(Acc v) { return v; }
+};
+}  // namespace
+
+int32_t firDotScalar(const int16_t* x, const int16_t* taps, int num_taps) {
+  return firDot<ScalarOps>(x, taps, num_taps);
+}
+
+SigmaDeltaDecimator::SigmaDeltaDecimator()
+    : simd_level_(detectSimdLevel()), taps_(designTaps()), history_(2 * FIR_TAPS) {
+  reset();
+}
+
+void SigmaDeltaDecimator::reset() {
+  for (int s = 0; s < CIC_ORDER; s++) {
+    integrator_[s] = 0;
+    comb_[s] = 0;
+  }
+  cic_phase_ = 0;
+  fir_phase_ = 0;
+  // CIC outputs are centred, so all zeros reads as -CIC_GAIN / 2
+  for (int16_t& x : history_) {
+    x = -CIC_GAIN / 2;
+  }
+  history_pos_ = 0;
+}
+
+void SigmaDeltaDecimator::setSimdLevel(SimdLevel level) {
+  SimdLevel supported = detectSimdLevel();
+  simd_level_ = level > supported ? supported : level;
+}
+
+double SigmaDeltaDecimator::delayClocks() {
+  return CIC_ORDER * (CIC_DECIMATION - 1) / 2.0 + (FIR_TAPS - 1) / 2.0 * CIC_DECIMATION;
+}
+
+int SigmaDeltaDecimator::process(const uint8_t* bits, int num_bytes, int16_t* out) {
+  int32_t (*dot)(const int16_t*, const int16_t*, int) = firDotScalar;
+#if defined(LIBFM_X86_SIMD)
+  if (simd_level_ >= SIMD_AVX2) {
+    dot = firDotAvx2;
+  }
+#endif
+
+  // Integrators and combs wrap mod 2^32; the CIC output itself is at most
+  // CIC_GAIN, so the wrap cancels out.
+  uint32_t i1 = integrator_[0];
+  uint32_t i2 = integrator_[1];
+  uint32_t i3 = integrator_[2];
+  int written = 0;
+  for (int k = 0; k < num_bytes; k++) {
+    uint8_t b = bits[k];
+    i3 += 8 * i2 + 36 * i1 + byte_moments.second[b];
+    i2 += 8 * i1 + byte_moments.first[b];
+    i1 += byte_moments.count[b];
+    if (++cic_phase_ < CIC_BYTES) {
+      continue;
+    }
+    cic_phase_ = 0;
+
+    uint32_t x = i3;
+    for (int s = 0; s < CIC_ORDER; s++) {
+      uint32_t d = x - comb_[s];
+      comb_[s] = x;
+      x = d;
+    }
+    // 0..CIC_GAIN, centred to fit int16
+    int16_t centred = static_cast<int16_t>(static_cast<int32_t>(x) - CIC_GAIN / 2);
+    history_[history_pos_] = centred;
+    history_[history_pos_ + FIR_TAPS] = centred;
+    if (++history_pos_ == FIR_TAPS) {
+      history_pos_ = 0;
+    }
+    if (++fir_phase_ < FIR_DECIMATION) {
+      continue;
+    }
+    fir_phase_ = 0;
+
+    // |centred| <= 2^14 and the taps' absolute sum is a little over 2^15, so
+    // the dot product stays well inside int32. It is in Q15 of the centred
+    // CIC output, which is half the PCM scale.
+    int32_t acc = dot(history_.data() + history_pos_, taps_.data(), FIR_TAPS);
+    int32_t sample = (acc + (1 << 13)) >> 14;
+    out[written++] = static_cast<int16_t>(sample > 32767 ? 32767 : sample < -32768 ? -32768 : sample);
+  }
+  integrator_[0] = i1;
+  integrator_[1] = i2;
+  integrator_[2] = i3;
+  return written;
+}
+
+}  // namespace fm
@@ -0,0 +1,29 @@
+#include "sigma_delta_kernel.hpp"
+#include <immintrin.h>
+
+namespace fm {
+
+namespace {
+struct Avx2Ops {
+  using Vec = __m256i;  // 16 x int16
+  using Acc = __m256i;  // 8 x int32
+  static constexpr int kWidth = 16;
+
+  static Vec load(const int16_t* p) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)); }
+  static Acc zero() { return _mm256_setzero_si256(); }
+  static Acc madd(Vec a, Vec b) { return _mm256_madd_epi16(a, b); }
+  static Acc add(Acc a, Acc b) { return _mm256_add_epi32(a, b); }
+  static int32_t hsum(Acc v) {
+    __m128i x = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    x = _mm_add_epi32(x, _mm_shuffle_epi32(x, _MM_SHUFFLE(1, 0, 3, 2)));
+    x = _mm_add_epi32(x, _mm_shuffle_epi32(x, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(x);
+  }
+};
+}  // namespace
+
+int32_t firDotAvx2(const int16_t* x, const int16_t* taps, int num_taps) {
+  return firDot<Avx2Ops>(x, taps, num_taps);
+}
+
+}  // namespace fm
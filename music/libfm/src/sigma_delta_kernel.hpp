@@ -0,0 +1,29 @@
+#pragma once
+#include <cstdint>
+
+// Shared by the scalar and AVX2 SigmaDeltaDecimator FIR kernels; see
+// pulse_bank_kernel.hpp for why the vector ops live in anonymous namespaces
+// and std:: is avoided here.
+
+namespace fm {
+
+int32_t firDotScalar(const int16_t* x, const int16_t* taps, int num_taps);
+int32_t firDotAvx2(const int16_t* x, const int16_t* taps, int num_taps);
+
+// sum(x[i] * taps[i]) over num_taps, a multiple of 2 * V::kWidth. V::madd
+// multiplies int16 lanes and adds adjacent products into int32 lanes; the
+// sum never overflows int32 (see sigma_delta.cpp), so the order of the
+// additions does not change the result.
+template <class V>
+int32_t firDot(const int16_t* x, const int16_t* taps, int num_taps) {
+  constexpr int W = V::kWidth;
+  typename V::Acc acc0 = V::zero();
+  typename V::Acc acc1 = V::zero();
+  for (int i = 0; i < num_taps; i += 2 * W) {
+    acc0 = V::add(acc0, V::madd(V::load(x + i), V::load(taps + i)));
+    acc1 = V::add(acc1, V::madd(V::load(x + i + W), V::load(taps + i + W)));
+  }
+  return V::hsum(V::add(acc0, acc1));
+}
+
+}  // namespace fm
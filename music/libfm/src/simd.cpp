@@ -0,0 +1,37 @@
+#include "libfm/simd.hpp"
+
+namespace fm {
+
+namespace {
+SimdLevel probeSimdLevel() {
+#if defined(LIBFM_X86_SIMD)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return SIMD_AVX2;
+  }
+  if (__builtin_cpu_supports("sse4.1")) {
+    return SIMD_SSE41;
+  }
+#endif
+  return SIMD_SCALAR;
+}
+}  // namespace
+
+SimdLevel detectSimdLevel() {
+  static const SimdLevel level = probeSimdLevel();
+  return level;
+}
+
+const char* simdLevelName(SimdLevel level) {
+  switch (level) {
+    case SIMD_AVX2:
+      return "avx2";
+    case SIMD_SSE41:
+      return "sse4.1";
+    case SIMD_SCALAR:
+      break;
+  }
+  return "scalar";
+}
+
+}  // namespace fm
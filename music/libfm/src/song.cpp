@@ -0,0 +1,180 @@
+#include "libfm/song.hpp"
+#include "libfm/song_file.hpp"
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <utility>
+
+namespace fm {
+
+namespace {
+constexpr int MELODY_PHASEBITS = 14;
+
+bool loadTable(const std::string& path, std::vector<uint8_t>* table, std::string* error) {
+  std::vector<uint32_t> values;
+  if (!readMemHex(path, &values)) {
+    *error = path;
+    return false;
+  }
+  table->assign(values.begin(), values.end());
+  return true;
+}
+}  // namespace
+
+const char* songTrackName(int track) {
+  switch (track) {
+    case SONG_BASS:
+      return "bass";
+    case SONG_MELODY:
+      return "melody";
+    case SONG_BACKUP:
+      return "backup";
+    case SONG_SNARE:
+      return "snare";
+  }
+  return "?";
+}
+
+bool readMemHex(const std::string& path, std::vector<uint32_t>* values) {
+  FILE* file = fopen(path.c_str(), "r");
+  if (!file) return false;
+
+  values->clear();
+  size_t address = 0;
+  char token[64];
+  while (fscanf(file, "%63s", token) == 1) {
+    if (token[0] == '/' && token[1] == '/') {
+      int c;
+      while ((c = fgetc(file)) != EOF && c != '\n') {
+      }
+      continue;
+    }
+    if (token[0] == '@') {
+      address = strtoul(token + 1, nullptr, 16);
+      continue;
+    }
+    if (!isxdigit(static_cast<unsigned char>(token[0])) || address >= MEMHEX_MAX_WORDS) {
+      fclose(file);
+      return false;
+    }
+    if (values->size() <= address) {
+      values->resize(address + 1, 0);
+    }
+    (*values)[address++] = strtoul(token, nullptr, 16);
+  }
+  fclose(file);
+  return true;
+}
+
+int SongData::length() const {
+  return file ? file->length() : static_cast<int>(tracks[SONG_BASS].trigger.size());
+}
+
+int SongData::snareLength() const {
+  return file ? file->snareLength() : static_cast<int>(snare.size());
+}
+
+bool SongData::on(int track, int position) const {
+  return file ? file->on(track, position) : tracks[track].on[position] & 1;
+}
+
+bool SongData::trigger(int track, int position) const {
+  return file ? file->trigger(track, position) : tracks[track].trigger[position] & 1;
+}
+
+uint32_t SongData::pitch(int track, int position) const {
+  return file ? file->pitch(track, position) : tracks[track].pitch[position];
+}
+
+bool SongData::snareHit(int position) const {
+  return file ? file->snare(position) : snare[position] & 1;
+}
+
+bool loadSong(const std::string& data_dir, SongData* song, std::string* error) {
+  *song = SongData();
+  if (isSongFile(data_dir)) {
+    // nothing is decoded up front; lookups read the mapping
+    auto file = std::make_shared<SongFile>();
+    if (!file->open(data_dir, error)) {
+      return false;
+    }
+    song->file = std::move(file);
+    return true;
+  }
+  for (int track = 0; track < SONG_PULSE_TRACKS; track++) {
+    std::string prefix = data_dir + "/" + songTrackName(track);
+    SongTrack& t = song->tracks[track];
+    if (!loadTable(prefix + "_on.hex", &t.on, error) ||
+        !loadTable(prefix + "_trigger.hex", &t.trigger, error)) {
+      return false;
+    }
+    if (!readMemHex(prefix + "_pitch.hex", &t.pitch)) {
+      *error = prefix + "_pitch.hex";
+      return false;
+    }
+    if (t.on.size() != t.trigger.size() || t.pitch.size() != t.trigger.size() ||
+        t.trigger.size() != song->tracks[SONG_BASS].trigger.size() || t.trigger.empty()) {
+      *error = prefix + "_*.hex: table lengths differ";
+      return false;
+    }
+  }
+  if (!loadTable(data_dir + "/drum_snare.hex", &song->snare, error)) {
+    return false;
+  }
+  if (song->snare.empty()) {
+    *error = data_dir + "/drum_snare.hex: empty";
+    return false;
+  }
+  return true;
+}
+
+PulseConfig songTrackConfig(int track) {
+  PulseConfig config;
+  config.sample_rate = SONG_SAMPLE_RATE;
+  switch (track) {
+    case SONG_BASS:
+      config.pulse_width = 1;
+      config.octave_transpose = -2;
+      config.detune = 4;
+      config.carrier_multiplier = 2;
+      config.decay = 2;
+      config.sustain = 1024;
+      config.release = 3;
+      config.vibrato_depth = 0;
+      config.vibrato_rate = 0;
+      config.vibrato_envelope = 0;
+      break;
+    case SONG_MELODY:
+      config.pulse_width = 1;
+      config.octave_transpose = 2;
+      // 2 in the melody's 14-bit phase units
+      config.detune = 2 << (PULSE_PHASEBITS - MELODY_PHASEBITS);
+      config.carrier_multiplier = 1;
+      config.decay = 4;
+      config.sustain = 1024;
+      config.release = 4;
+      config.vibrato_depth = 0;
+      config.vibrato_rate = 2;
+      config.vibrato_envelope = 6;
+      break;
+    case SONG_BACKUP:
+      config.pulse_width = 0;
+      config.octave_transpose = 0;
+      config.detune = 8;
+      config.carrier_multiplier = 2;
+      config.decay = 2;
+      config.sustain = 1024;
+      config.release = 2;
+      break;
+  }
+  return config;
+}
+
+int songPhaseInc(int track, uint32_t pitch) {
+  if (track == SONG_MELODY) {
+    return pitch << (PULSE_PHASEBITS - MELODY_PHASEBITS);
+  }
+  return pitch;
+}
+
+}  // namespace fm
@@ -0,0 +1,228 @@
+#include "libfm/song_file.hpp"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+namespace fm {
+
+namespace {
+constexpr char MAGIC[4] = {'F', 'M', 'S', 'G'};
+constexpr size_t HEADER_SIZE = 24;
+constexpr size_t TRACK_ENTRY_SIZE = 16;
+constexpr size_t INDEX_END = HEADER_SIZE + SONG_PULSE_TRACKS * TRACK_ENTRY_SIZE;
+constexpr size_t RUN_SIZE = 8;
+
+uint32_t get16(const uint8_t* p) {
+  return p[0] | (p[1] << 8);
+}
+
+uint32_t get32(const uint8_t* p) {
+  return get16(p) | (get16(p + 2) << 16);
+}
+
+void put16(uint8_t* p, uint32_t v) {
+  p[0] = v & 0xff;
+  p[1] = (v >> 8) & 0xff;
+}
+
+void put32(uint8_t* p, uint32_t v) {
+  put16(p, v & 0xffff);
+  put16(p + 2, v >> 16);
+}
+
+size_t bitmapBytes(size_t positions) {
+  return (positions + 7) / 8;
+}
+
+// Appends a bitmap of flag(p) for the first `positions` positions, padded to
+// a multiple of 4 bytes; returns its offset.
+template <class Flag>
+uint32_t appendBitmap(std::vector<uint8_t>* out, int positions, Flag flag) {
+  uint32_t offset = out->size();
+  out->resize(offset + ((bitmapBytes(positions) + 3) & ~size_t(3)), 0);
+  for (int p = 0; p < positions; p++) {
+    if (flag(p)) {
+      (*out)[offset + p / 8] |= 1 << (p % 8);
+    }
+  }
+  return offset;
+}
+}  // namespace
+
+SongFile::~SongFile() {
+  close();
+}
+
+void SongFile::close() {
+  if (data_) {
+    munmap(const_cast<uint8_t*>(data_), size_);
+  }
+  data_ = nullptr;
+  size_ = 0;
+  length_ = 0;
+  snare_length_ = 0;
+}
+
+bool SongFile::open(const std::string& path, std::string* error) {
+  close();
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    *error = path + ": " + strerror(errno);
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(INDEX_END)) {
+    ::close(fd);
+    *error = path + ": too short for a song file";
+    return false;
+  }
+  void* map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (map == MAP_FAILED) {
+    *error = path + ": " + strerror(errno);
+    return false;
+  }
+  data_ = static_cast<const uint8_t*>(map);
+  size_ = st.st_size;
+  if (!validate(error)) {
+    *error = path + ": " + *error;
+    close();
+    return false;
+  }
+  return true;
+}
+
+// Checks everything lookups rely on, so they need no checks of their own.
+bool SongFile::validate(std::string* error) {
+  if (memcmp(data_, MAGIC, sizeof(MAGIC)) != 0) {
+    *error = "not a song file";
+    return false;
+  }
+  if (get16(data_ + 4) != SONG_FILE_VERSION) {
+    *error = "unsupported version " + std::to_string(get16(data_ + 4));
+    return false;
+  }
+  if (get16(data_ + 6) != SONG_PULSE_TRACKS || get32(data_ + 20) != size_) {
+    *error = "corrupt header";
+    return false;
+  }
+  length_ = get32(data_ + 8);
+  snare_length_ = get32(data_ + 12);
+  if (length_ <= 0 || snare_length_ <= 0) {
+    *error = "empty song";
+    return false;
+  }
+
+  auto in_file = [&](uint32_t offset, size_t bytes) {
+    return offset >= INDEX_END && offset <= size_ && bytes <= size_ - offset;
+  };
+  uint32_t snare_offset = get32(data_ + 16);
+  if (!in_file(snare_offset, bitmapBytes(snare_length_))) {
+    *error = "snare table out of bounds";
+    return false;
+  }
+  snare_ = data_ + snare_offset;
+
+  for (int track = 0; track < SONG_PULSE_TRACKS; track++) {
+    const uint8_t* entry = data_ + HEADER_SIZE + track * TRACK_ENTRY_SIZE;
+    uint32_t on = get32(entry);
+    uint32_t trigger = get32(entry + 4);
+    uint32_t runs = get32(entry + 8);
+    uint32_t run_count = get32(entry + 12);
+    if (!in_file(on, bitmapBytes(length_)) || !in_file(trigger, bitmapBytes(length_)) ||
+        run_count == 0 || !in_file(runs, size_t(run_count) * RUN_SIZE)) {
+      *error = std::string(songTrackName(track)) + " tables out of bounds";
+      return false;
+    }
+    uint32_t start = 0;
+    for (uint32_t r = 0; r < run_count; r++) {
+      uint32_t next = get32(data_ + runs + r * RUN_SIZE);
+      if (r == 0 ? next != 0 : next <= start || next >= static_cast<uint32_t>(length_)) {
+        *error = std::string(songTrackName(track)) + " pitch runs out of order";
+        return false;
+      }
+      start = next;
+    }
+    tracks_[track] = {data_ + on, data_ + trigger, data_ + runs, run_count};
+  }
+  return true;
+}
+
+uint32_t SongFile::pitch(int track, int position) const {
+  // last run starting at or before position
+  const Track& t = tracks_[track];
+  uint32_t lo = 0;
+  uint32_t hi = t.run_count;
+  while (hi - lo > 1) {
+    uint32_t mid = (lo + hi) / 2;
+    if (get32(t.runs + mid * RUN_SIZE) <= static_cast<uint32_t>(position)) {
+      lo = mid;
+    } else {
+      hi = mid;
+    }
+  }
+  return get32(t.runs + lo * RUN_SIZE + 4);
+}
+
+bool isSongFile(const std::string& path) {
+  FILE* file = fopen(path.c_str(), "rb");
+  if (!file) return false;
+  char magic[sizeof(MAGIC)];
+  bool match = fread(magic, 1, sizeof(magic), file) == sizeof(magic) &&
+      memcmp(magic, MAGIC, sizeof(MAGIC)) == 0;
+  fclose(file);
+  return match;
+}
+
+bool writeSongFile(const std::string& path, const SongData& song, std::string* error) {
+  std::vector<uint8_t> out(INDEX_END, 0);
+  memcpy(out.data(), MAGIC, sizeof(MAGIC));
+  put16(&out[4], SONG_FILE_VERSION);
+  put16(&out[6], SONG_PULSE_TRACKS);
+  const int length = song.length();
+  put32(&out[8], length);
+  put32(&out[12], song.snareLength());
+
+  for (int track = 0; track < SONG_PULSE_TRACKS; track++) {
+    size_t entry = HEADER_SIZE + track * TRACK_ENTRY_SIZE;
+    uint32_t on = appendBitmap(&out, length, [&](int p) { return song.on(track, p); });
+    uint32_t trigger = appendBitmap(&out, length, [&](int p) { return song.trigger(track, p); });
+    put32(&out[entry], on);
+    put32(&out[entry + 4], trigger);
+    put32(&out[entry + 8], out.size());
+    uint32_t run_count = 0;
+    for (int p = 0; p < length; p++) {
+      uint32_t pitch = song.pitch(track, p);
+      if (p == 0 || pitch != song.pitch(track, p - 1)) {
+        size_t run = out.size();
+        out.resize(run + RUN_SIZE);
+        put32(&out[run], p);
+        put32(&out[run + 4], pitch);
+        run_count++;
+      }
+    }
+    put32(&out[entry + 12], run_count);
+  }
+  uint32_t snare = appendBitmap(&out, song.snareLength(), [&](int p) { return song.snareHit(p); });
+  put32(&out[16], snare);
+  put32(&out[20], out.size());
+
+  FILE* file = fopen(path.c_str(), "wb");
+  if (!file) {
+    *error = path + ": " + strerror(errno);
+    return false;
+  }
+  bool ok = fwrite(out.data(), 1, out.size(), file) == out.size();
+  ok = fclose(file) == 0 && ok;
+  if (!ok) {
+    *error = path + ": write failed";
+  }
+  return ok;
+}
+
+}  // namespace fm
@@ -0,0 +1,126 @@
+#include "libfm/song_player.hpp"
+
+namespace fm {
+
+TrackPlayer::TrackPlayer(const SongData& song, int track, int sample_rate)
+    : song_(&song), track_(track), sample_rate_(sample_rate), config_(trackConfig()) {}
+
+PulseConfig TrackPlayer::trackConfig() const {
+  PulseConfig config = songTrackConfig(track_);
+  config.sample_rate = sample_rate_;
+  config.detune = scalePhaseInc(config.detune);
+  return config;
+}
+
+int TrackPlayer::scalePhaseInc(int phase_inc) const {
+  return static_cast<int>(static_cast<int64_t>(phase_inc) * SONG_SAMPLE_RATE / sample_rate_);
+}
+
+void TrackPlayer::render(int16_t* buffer, int num_samples) {
+  while (num_samples > 0) {
+    if (tick_sample_ == 0) {
+      tick();
+    }
+    int runlength = SONG_SAMPLES_PER_TICK - tick_sample_;
+    if (runlength > num_samples) {
+      runlength = num_samples;
+    }
+    renderVoice(buffer, runlength);
+    buffer += runlength;
+    num_samples -= runlength;
+    tick_sample_ += runlength;
+    if (tick_sample_ >= SONG_SAMPLES_PER_TICK) {
+      tick_sample_ = 0;
+    }
+  }
+}
+
+void TrackPlayer::advance(int num_samples) {
+  while (num_samples > 0) {
+    if (tick_sample_ == 0) {
+      tick();
+    }
+    int runlength = SONG_SAMPLES_PER_TICK - tick_sample_;
+    if (runlength > num_samples) {
+      runlength = num_samples;
+    }
+    advanceVoice(runlength);
+    num_samples -= runlength;
+    tick_sample_ += runlength;
+    if (tick_sample_ >= SONG_SAMPLES_PER_TICK) {
+      tick_sample_ = 0;
+    }
+  }
+}
+
+void TrackPlayer::seek(int position) {
+  tick_sample_ = 0;
+  tick_ = 0;
+  position_ = 0;
+  config_ = trackConfig();
+  voice_ = PulseState();
+  noise_.reset(noise_config_);
+  for (int p = 0; p < position; p++) {
+    advance(SONG_SAMPLES_PER_POSITION);
+  }
+}
+
+void TrackPlayer::tick() {
+  if (tick_ == 0) {
+    stepSong(position_);
+    position_++;
+  }
+
+  if (track_ == SONG_SNARE) {
+    noise_.tickEnvelopes(noise_config_);
+  } else {
+    voice_.tickEnvelopes(config_);
+  }
+
+  tick_++;
+  if (tick_ >= SONG_TICKS_PER_POSITION) {
+    tick_ = 0;
+  }
+}
+
+// An empty song (one that never loaded) plays silence.
+void TrackPlayer::stepSong(int p) {
+  if (track_ == SONG_SNARE) {
+    int snare_length = song_->snareLength();
+    if (snare_length > 0 && song_->snareHit(p % snare_length)) {
+      noise_.trigger(noise_config_);
+    }
+    return;
+  }
+
+  // undo track.py's rotation of the pitch and on tables
+  int length = song_->length();
+  if (length == 0) {
+    return;
+  }
+  int cur = p % length;
+  int next = (cur + 1) % length;
+  if (song_->trigger(track_, cur)) {
+    voice_.retrigger(scalePhaseInc(songPhaseInc(track_, song_->pitch(track_, next))), config_);
+  } else if (!song_->on(track_, next) && song_->on(track_, cur)) {
+    voice_.noteOff(config_);
+  }
+}
+
+void TrackPlayer::renderVoice(int16_t* buffer, int num_samples) {
+  if (track_ == SONG_SNARE) {
+    noise_.render(buffer, num_samples, noise_config_);
+  } else {
+    voice_.render(buffer, num_samples, config_);
+  }
+}
+
+void TrackPlayer::advanceVoice(int num_samples) {
+  if (track_ == SONG_SNARE) {
+    noise_.advance(num_samples, noise_config_);
+  } else {
+    voice_.advance(num_samples, config_);
+  }
+}
+
+}  // namespace fm
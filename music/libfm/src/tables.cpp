@@ -2,7 +2,7 @@
 
 namespace fm {
 
-static const uint16_t logsin_tbl[128] = {
+const uint16_t logsin_tbl[128] = {
     406, 342, 304, 278, 257, 240, 226, 214, 203, 193, 185, 177, 169, 163, 156,
     150, 145, 140, 135, 130, 126, 122, 118, 114, 110, 107, 103, 100, 97,  94,
     91,  88,  86,  83,  80,  78,  76,  73,  71,  69,  67,  65,  63,  61,  59,
@@ -13,7 +13,7 @@ static const uint16_t logsin_tbl[128] = {
     3,   3,   2,   2,   2,   2,   1,   1,   1,   1,   1,   0,   0,   0,   0,
     0,   0,   0,   0,   0,   0,   0,   0};
 
-static const uint16_t mantissa_tbl[64] = {
+const uint16_t mantissa_tbl[64] = {
     2047, 2024, 2003, 1981, 1960, 1939, 1918, 1897, 1877, 1856, 1836,
     1817, 1797, 1778, 1759, 1740, 1721, 1702, 1684, 1666, 1648, 1630,
     1613, 1595, 1578, 1561, 1544, 1527, 1511, 1495, 1479, 1463, 1447,
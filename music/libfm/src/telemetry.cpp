@@ -0,0 +1,42 @@
+#include "libfm/telemetry.hpp"
+
+#if LIBFM_TELEMETRY
+
+namespace fm {
+
+namespace {
+constexpr uint32_t RING_MASK = TelemetryTap::CAPACITY - 1;
+}  // namespace
+
+void TelemetryTap::subscribe() {
+  read_.store(write_.load(std::memory_order_acquire), std::memory_order_release);
+  listening_.store(true, std::memory_order_relaxed);
+}
+
+int TelemetryTap::read(int16_t* samples, int max_samples) {
+  uint32_t r = read_.load(std::memory_order_relaxed);
+  uint32_t available = write_.load(std::memory_order_acquire) - r;
+  int n = available < static_cast<uint32_t>(max_samples) ? available : max_samples;
+  for (int i = 0; i < n; i++) {
+    samples[i] = ring_[(r + i) & RING_MASK];
+  }
+  read_.store(r + n, std::memory_order_release);
+  return n;
+}
+
+void TelemetryTap::push(const int16_t* samples, int num_samples) {
+  uint32_t w = write_.load(std::memory_order_relaxed);
+  uint32_t used = w - read_.load(std::memory_order_acquire);
+  if (used + num_samples > static_cast<uint32_t>(CAPACITY)) {
+    dropped_.fetch_add(num_samples, std::memory_order_relaxed);
+    return;
+  }
+  for (int i = 0; i < num_samples; i++) {
+    ring_[(w + i) & RING_MASK] = samples[i];
+  }
+  write_.store(w + num_samples, std::memory_order_release);
+}
+
+}  // namespace fm
+
+#endif
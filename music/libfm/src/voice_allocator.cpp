@@ -0,0 +1,166 @@
+#include "libfm/voice_allocator.hpp"
+
+namespace fm {
+
+namespace {
+// Held voices rank above any released one; levels are clamped below this.
+constexpr int HELD_PRIORITY = 1 << 24;
+constexpr int MAX_LEVEL = HELD_PRIORITY - 1;
+}  // namespace
+
+VoiceAllocator::VoiceAllocator(int capacity)
+    : active_pos_(capacity, -1),
+      heap_pos_(capacity, -1),
+      voice_note_(capacity, -1),
+      level_(capacity, 0),
+      released_(capacity, false) {
+  free_.reserve(capacity);
+  active_.reserve(capacity);
+  heap_.reserve(capacity);
+  // lowest slot on top, so voices fill up from 0
+  for (int voice = capacity - 1; voice >= 0; voice--) {
+    free_.push_back(voice);
+  }
+  for (int& voice : note_voice_) {
+    voice = -1;
+  }
+}
+
+int VoiceAllocator::noteOn(int note) {
+  if (note < 0 || note >= NUM_NOTES) {
+    return -1;
+  }
+
+  int voice = note_voice_[note];
+  if (voice < 0) {
+    if (!free_.empty()) {
+      voice = free_.back();
+      free_.pop_back();
+      active_pos_[voice] = static_cast<int>(active_.size());
+      active_.push_back(voice);
+      heap_pos_[voice] = static_cast<int>(heap_.size());
+      heap_.push_back(voice);
+    } else if (!heap_.empty()) {
+      voice = heap_[0];
+      int old_note = voice_note_[voice];
+      if (old_note >= 0 && note_voice_[old_note] == voice) {
+        note_voice_[old_note] = -1;
+      }
+    } else {
+      return -1;
+    }
+  }
+
+  note_voice_[note] = voice;
+  voice_note_[voice] = note;
+  released_[voice] = false;
+  level_[voice] = MAX_LEVEL;
+  heapUpdate(voice);
+  return voice;
+}
+
+int VoiceAllocator::noteOff(int note) {
+  int voice = voiceForNote(note);
+  if (voice < 0) {
+    return -1;
+  }
+  note_voice_[note] = -1;
+  released_[voice] = true;
+  heapUpdate(voice);
+  return voice;
+}
+
+void VoiceAllocator::free(int voice) {
+  int pos = active_pos_[voice];
+  if (pos < 0) {
+    return;
+  }
+  int last = active_.back();
+  active_[pos] = last;
+  active_pos_[last] = pos;
+  active_.pop_back();
+  active_pos_[voice] = -1;
+  heapRemove(voice);
+
+  int note = voice_note_[voice];
+  if (note >= 0 && note_voice_[note] == voice) {
+    note_voice_[note] = -1;
+  }
+  released_[voice] = false;
+  free_.push_back(voice);
+}
+
+void VoiceAllocator::setLevel(int voice, int level) {
+  level_[voice] = level < 0 ? 0 : level > MAX_LEVEL ? MAX_LEVEL : level;
+  heapUpdate(voice);
+}
+
+int VoiceAllocator::priority(int voice) const {
+  return (released_[voice] ? 0 : HELD_PRIORITY) + level_[voice];
+}
+
+void VoiceAllocator::heapSwap(int a, int b) {
+  int va = heap_[a];
+  int vb = heap_[b];
+  heap_[a] = vb;
+  heap_[b] = va;
+  heap_pos_[vb] = a;
+  heap_pos_[va] = b;
+}
+
+void VoiceAllocator::siftUp(int pos) {
+  while (pos > 0) {
+    int parent = (pos - 1) / 2;
+    if (priority(heap_[parent]) <= priority(heap_[pos])) {
+      break;
+    }
+    heapSwap(pos, parent);
+    pos = parent;
+  }
+}
+
+void VoiceAllocator::siftDown(int pos) {
+  int n = static_cast<int>(heap_.size());
+  for (;;) {
+    int smallest = pos;
+    int left = 2 * pos + 1;
+    int right = left + 1;
+    if (left < n && priority(heap_[left]) < priority(heap_[smallest])) {
+      smallest = left;
+    }
+    if (right < n && priority(heap_[right]) < priority(heap_[smallest])) {
+      smallest = right;
+    }
+    if (smallest == pos) {
+      break;
+    }
+    heapSwap(pos, smallest);
+    pos = smallest;
+  }
+}
+
+void VoiceAllocator::heapUpdate(int voice) {
+  int pos = heap_pos_[voice];
+  if (pos < 0) {
+    return;
+  }
+  siftUp(pos);
+  siftDown(heap_pos_[voice]);
+}
+
+void VoiceAllocator::heapRemove(int voice) {
+  int pos = heap_pos_[voice];
+  int last = static_cast<int>(heap_.size()) - 1;
+  if (pos != last) {
+    heapSwap(pos, last);
+  }
+  heap_.pop_back();
+  heap_pos_[voice] = -1;
+  if (pos != last) {
+    int moved = heap_[pos];
+    siftUp(pos);
+    siftDown(heap_pos_[moved]);
+  }
+}
+
+}  // namespace fm
@@ -0,0 +1,82 @@
+#include "libfm/wav_writer.hpp"
+
+namespace fm {
+
+namespace {
+void put16(uint8_t* p, uint32_t v) {
+  p[0] = v & 0xff;
+  p[1] = (v >> 8) & 0xff;
+}
+
+void put32(uint8_t* p, uint32_t v) {
+  put16(p, v & 0xffff);
+  put16(p + 2, v >> 16);
+}
+
+void fillHeader(uint8_t* h, int sample_rate, int channels, uint32_t data_bytes) {
+  const uint8_t riff[] = {'R', 'I', 'F', 'F'};
+  const uint8_t wave_fmt[] = {'W', 'A', 'V', 'E', 'f', 'm', 't', ' '};
+  const uint8_t data[] = {'d', 'a', 't', 'a'};
+  for (int i = 0; i < 4; i++) h[i] = riff[i];
+  put32(h + 4, 36 + data_bytes);
+  for (int i = 0; i < 8; i++) h[8 + i] = wave_fmt[i];
+  put32(h + 16, 16);  // fmt chunk size
+  put16(h + 20, 1);   // PCM
+  put16(h + 22, channels);
+  put32(h + 24, sample_rate);
+  put32(h + 28, sample_rate * channels * 2);
+  put16(h + 32, channels * 2);
+  put16(h + 34, 16);
+  for (int i = 0; i < 4; i++) h[36 + i] = data[i];
+  put32(h + 40, data_bytes);
+}
+
+constexpr int HEADER_SIZE = 44;
+}  // namespace
+
+WavWriter::~WavWriter() {
+  close();
+}
+
+bool WavWriter::open(const char* filename, int sample_rate, int channels) {
+  close();
+  file_ = fopen(filename, "wb");
+  if (!file_) return false;
+
+  sample_rate_ = sample_rate;
+  channels_ = channels;
+  frames_written_ = 0;
+  uint8_t header[HEADER_SIZE];
+  fillHeader(header, sample_rate, channels, 0);
+  if (fwrite(header, 1, HEADER_SIZE, file_) != HEADER_SIZE) {
+    fclose(file_);
+    file_ = nullptr;
+    return false;
+  }
+  return true;
+}
+
+bool WavWriter::write(const int16_t* samples, int num_frames) {
+  if (!file_) return false;
+  // WAV is little-endian, as is every host this runs on
+  size_t n = static_cast<size_t>(num_frames) * channels_;
+  if (fwrite(samples, sizeof(int16_t), n, file_) != n) {
+    return false;
+  }
+  frames_written_ += num_frames;
+  return true;
+}
+
+bool WavWriter::close() {
+  if (!file_) return true;
+
+  uint8_t header[HEADER_SIZE];
+  fillHeader(header, sample_rate_, channels_, frames_written_ * channels_ * 2);
+  bool ok = fseek(file_, 0, SEEK_SET) == 0 &&
+            fwrite(header, 1, HEADER_SIZE, file_) == HEADER_SIZE;
+  ok = fclose(file_) == 0 && ok;
+  file_ = nullptr;
+  return ok;
+}
+
+}  // namespace fm
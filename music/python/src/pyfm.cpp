@@ -0,0 +1,632 @@
+// pyfm: Python bindings for libfm, so scripts like track.py can render with
+// the C++ engine instead of per-sample Python loops.
+//
+// Every render call takes a writable, contiguous int16 buffer (a NumPy int16
+// array, array.array('h'), ...) and fills it in one call. The GIL stays held:
+// renders write the state of the object they are called on, which another
+// thread could otherwise be using. Voice and config objects mirror the C++
+// structs field for field.
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <structmember.h>
+
+#include <climits>
+#include <cstddef>
+#include <cstring>
+#include <iterator>
+#include <new>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "libfm/fm_channel.hpp"
+#include "libfm/pulse_channel.hpp"
+#include "libfm/song.hpp"
+#include "libfm/song_player.hpp"
+
+namespace {
+
+template <class T>
+struct Wrapper {
+  PyObject_HEAD
+  T value;
+};
+
+template <class T>
+PyObject* wrapperNew(PyTypeObject* type, PyObject*, PyObject*) {
+  auto* self = reinterpret_cast<Wrapper<T>*>(type->tp_alloc(type, 0));
+  if (self) {
+    new (&self->value) T();
+  }
+  return reinterpret_cast<PyObject*>(self);
+}
+
+template <class T>
+void wrapperDealloc(PyObject* object) {
+  reinterpret_cast<Wrapper<T>*>(object)->value.~T();
+  Py_TYPE(object)->tp_free(object);
+}
+
+template <class T>
+T& unwrap(PyObject* object) {
+  return reinterpret_cast<Wrapper<T>*>(object)->value;
+}
+
+// Borrows obj's memory as int16 samples; release with PyBuffer_Release.
+bool getSamples(PyObject* obj, Py_buffer* view) {
+  if (PyObject_GetBuffer(obj, view, PyBUF_WRITABLE | PyBUF_FORMAT | PyBUF_C_CONTIGUOUS) < 0) {
+    return false;
+  }
+  const char* format = view->format;
+  if (*format == '<' || *format == '=' || *format == '@') {
+    format++;
+  }
+  if (view->itemsize != 2 || strcmp(format, "h") != 0) {
+    PyBuffer_Release(view);
+    PyErr_SetString(PyExc_TypeError, "expected a writable int16 buffer");
+    return false;
+  }
+  return true;
+}
+
+// Calls render(samples, n) over the whole buffer, in pieces that fit an int.
+template <class Render>
+void renderBuffer(Py_buffer* view, Render render) {
+  auto* samples = static_cast<int16_t*>(view->buf);
+  Py_ssize_t remaining = view->len / 2;
+  while (remaining > 0) {
+    int n = remaining < INT_MAX ? static_cast<int>(remaining) : INT_MAX;
+    render(samples, n);
+    samples += n;
+    remaining -= n;
+  }
+}
+
+#define FIELD(Type, py_type, name, field) \
+  {const_cast<char*>(name), py_type, offsetof(Wrapper<Type>, value) + offsetof(Type, field), 0, nullptr}
+
+// A config field and the values libfm handles for it. Most fields end up as
+// shift amounts or table indexes in the render loops, so the setters refuse
+// anything else rather than letting it reach them.
+struct ConfigField {
+  const char* name;
+  int type;  // T_INT, T_FLOAT or T_BOOL
+  size_t offset;
+  int min;
+  int max;
+};
+
+#define CONFIG_FIELD(Type, py_type, name, field, min, max) \
+  {name, py_type, offsetof(Wrapper<Type>, value) + offsetof(Type, field), min, max}
+
+// Shift amounts: far past where the envelopes and filters stop moving, and
+// well inside an int.
+constexpr int MAX_SHIFT = 15;
+constexpr int MAX_OCTAVE_TRANSPOSE = 8;
+constexpr int MAX_SAMPLE_RATE = 1000000;
+
+PyObject* getConfigField(PyObject* self, void* closure) {
+  const auto* field = static_cast<const ConfigField*>(closure);
+  const char* p = reinterpret_cast<const char*>(self) + field->offset;
+  switch (field->type) {
+    case T_FLOAT:
+      return PyFloat_FromDouble(*reinterpret_cast<const float*>(p));
+    case T_BOOL:
+      return PyBool_FromLong(*reinterpret_cast<const bool*>(p));
+    default:
+      return PyLong_FromLong(*reinterpret_cast<const int*>(p));
+  }
+}
+
+int setConfigField(PyObject* self, PyObject* value, void* closure) {
+  const auto* field = static_cast<const ConfigField*>(closure);
+  char* p = reinterpret_cast<char*>(self) + field->offset;
+  if (!value) {
+    PyErr_Format(PyExc_AttributeError, "cannot delete %s", field->name);
+    return -1;
+  }
+  if (field->type == T_BOOL) {
+    if (!PyBool_Check(value)) {
+      PyErr_Format(PyExc_TypeError, "%s must be a bool", field->name);
+      return -1;
+    }
+    *reinterpret_cast<bool*>(p) = value == Py_True;
+    return 0;
+  }
+  if (field->type == T_INT && !PyLong_Check(value)) {
+    PyErr_Format(PyExc_TypeError, "%s must be an int", field->name);
+    return -1;
+  }
+  double number = field->type == T_FLOAT ? PyFloat_AsDouble(value) : PyLong_AsDouble(value);
+  if (number == -1.0 && PyErr_Occurred()) {
+    return -1;
+  }
+  // written so that NaN fails too
+  if (!(number >= field->min && number <= field->max)) {
+    PyErr_Format(PyExc_ValueError, "%s must be between %d and %d", field->name, field->min, field->max);
+    return -1;
+  }
+  if (field->type == T_FLOAT) {
+    *reinterpret_cast<float*>(p) = static_cast<float>(number);
+  } else {
+    *reinterpret_cast<int*>(p) = static_cast<int>(number);
+  }
+  return 0;
+}
+
+// Fills getset (one longer than fields, for the sentinel) with accessors for
+// fields.
+template <size_t N>
+void initConfigGetSet(ConfigField (&fields)[N], PyGetSetDef (&getset)[N + 1]) {
+  for (size_t i = 0; i < N; i++) {
+    getset[i] = {fields[i].name, getConfigField, setConfigField, nullptr, &fields[i]};
+  }
+  getset[N] = {};
+}
+
+// PulseConfig
+
+PyTypeObject PulseConfigType{};
+
+static_assert(sizeof(fm::PitchRounding) == sizeof(int), "pitch_rounding is set as an int");
+
+ConfigField pulse_config_fields[] = {
+    CONFIG_FIELD(fm::PulseConfig, T_FLOAT, "sample_rate", sample_rate, 1, MAX_SAMPLE_RATE),
+    CONFIG_FIELD(fm::PulseConfig, T_INT, "pulse_width", pulse_width, 0, 7),
+    CONFIG_FIELD(fm::PulseConfig, T_INT, "octave_transpose", octave_transpose, -MAX_OCTAVE_TRANSPOSE,
+                 MAX_OCTAVE_TRANSPOSE),
+    CONFIG_FIELD(fm::PulseConfig, T_INT, "pitch_rounding", pitch_rounding, fm::PITCH_TRUNCATE, fm::PITCH_NEAREST),
+    CONFIG_FIELD(fm::PulseConfig, T_INT, "detune", detune, -(1 << fm::PULSE_PHASEBITS), 1 << fm::PULSE_PHASEBITS),
+    CONFIG_FIELD(fm::PulseConfig, T_INT, "carrier_multiplier", carrier_multiplier, 0, 16),
+    CONFIG_FIELD(fm::PulseConfig, T_INT, "decay", decay, 0, MAX_SHIFT),
+    CONFIG_FIELD(fm::PulseConfig, T_INT, "sustain", sustain, 0, 4095),
+    CONFIG_FIELD(fm::PulseConfig, T_INT, "release", release, 0, MAX_SHIFT),
+    CONFIG_FIELD(fm::PulseConfig, T_INT, "vibrato_depth", vibrato_depth, 0, 4095),
+    CONFIG_FIELD(fm::PulseConfig, T_INT, "vibrato_rate", vibrato_rate, 0, MAX_SHIFT),
+    CONFIG_FIELD(fm::PulseConfig, T_INT, "vibrato_envelope", vibrato_envelope, 0, MAX_SHIFT),
+    CONFIG_FIELD(fm::PulseConfig, T_BOOL, "lpf_enabled", lpf_enabled, 0, 1),
+    CONFIG_FIELD(fm::PulseConfig, T_INT, "lpf_k1", lpf_k1, 0, MAX_SHIFT),
+    CONFIG_FIELD(fm::PulseConfig, T_INT, "lpf_k2", lpf_k2, 0, MAX_SHIFT),
+};
+
+PyGetSetDef pulse_config_getset[std::size(pulse_config_fields) + 1];
+
+// PulseState
+
+PyTypeObject PulseStateType{};
+
+PyMemberDef pulse_state_members[] = {
+    FIELD(fm::PulseState, T_INT, "note", note),
+    FIELD(fm::PulseState, T_INT, "octave", octave),
+    FIELD(fm::PulseState, T_INT, "primary_phase", primary_phase),
+    FIELD(fm::PulseState, T_INT, "secondary_phase", secondary_phase),
+    FIELD(fm::PulseState, T_INT, "volume", volume),
+    FIELD(fm::PulseState, T_INT, "phase_inc", phase_inc),
+    FIELD(fm::PulseState, T_INT, "vibrato_sin", vibrato_sin),
+    FIELD(fm::PulseState, T_INT, "vibrato_cos", vibrato_cos),
+    FIELD(fm::PulseState, T_INT, "adsr_state", adsr_state),
+    FIELD(fm::PulseState, T_INT, "vibrato_level", vibrato_level),
+    FIELD(fm::PulseState, T_INT, "lpf_y", lpf_y),
+    FIELD(fm::PulseState, T_INT, "lpf_v", lpf_v),
+    FIELD(fm::PulseState, T_INT, "sample_count", sample_count),
+    {},
+};
+
+PyObject* pulseNoteOn(PyObject* self, PyObject* args) {
+  int note, velocity;
+  PyObject* config;
+  if (!PyArg_ParseTuple(args, "iiO!", &note, &velocity, &PulseConfigType, &config)) {
+    return nullptr;
+  }
+  unwrap<fm::PulseState>(self).noteOn(note, velocity, unwrap<fm::PulseConfig>(config));
+  Py_RETURN_NONE;
+}
+
+PyObject* pulseNoteOff(PyObject* self, PyObject* args) {
+  PyObject* config;
+  if (!PyArg_ParseTuple(args, "O!", &PulseConfigType, &config)) {
+    return nullptr;
+  }
+  unwrap<fm::PulseState>(self).noteOff(unwrap<fm::PulseConfig>(config));
+  Py_RETURN_NONE;
+}
+
+PyObject* pulseRetrigger(PyObject* self, PyObject* args) {
+  int phase_inc;
+  PyObject* config;
+  if (!PyArg_ParseTuple(args, "iO!", &phase_inc, &PulseConfigType, &config)) {
+    return nullptr;
+  }
+  unwrap<fm::PulseState>(self).retrigger(phase_inc, unwrap<fm::PulseConfig>(config));
+  Py_RETURN_NONE;
+}
+
+PyObject* pulseTickEnvelopes(PyObject* self, PyObject* args) {
+  PyObject* config;
+  if (!PyArg_ParseTuple(args, "O!", &PulseConfigType, &config)) {
+    return nullptr;
+  }
+  unwrap<fm::PulseState>(self).tickEnvelopes(unwrap<fm::PulseConfig>(config));
+  Py_RETURN_NONE;
+}
+
+PyObject* pulseRender(PyObject* self, PyObject* args) {
+  PyObject* buffer;
+  PyObject* config;
+  Py_buffer view;
+  if (!PyArg_ParseTuple(args, "OO!", &buffer, &PulseConfigType, &config) || !getSamples(buffer, &view)) {
+    return nullptr;
+  }
+  fm::PulseState& state = unwrap<fm::PulseState>(self);
+  const fm::PulseConfig& c = unwrap<fm::PulseConfig>(config);
+  renderBuffer(&view, [&](int16_t* samples, int n) { state.render(samples, n, c); });
+  PyBuffer_Release(&view);
+  Py_RETURN_NONE;
+}
+
+PyObject* pulseAdvance(PyObject* self, PyObject* args) {
+  int num_samples;
+  PyObject* config;
+  if (!PyArg_ParseTuple(args, "iO!", &num_samples, &PulseConfigType, &config)) {
+    return nullptr;
+  }
+  unwrap<fm::PulseState>(self).advance(num_samples, unwrap<fm::PulseConfig>(config));
+  Py_RETURN_NONE;
+}
+
+PyMethodDef pulse_state_methods[] = {
+    {"note_on", pulseNoteOn, METH_VARARGS, "note_on(note, velocity, config)"},
+    {"note_off", pulseNoteOff, METH_VARARGS, "note_off(config)"},
+    {"retrigger", pulseRetrigger, METH_VARARGS,
+     "retrigger(phase_inc, config): start a note at a raw phase increment, as the song sequencer does"},
+    {"tick_envelopes", pulseTickEnvelopes, METH_VARARGS, "tick_envelopes(config)"},
+    {"render", pulseRender, METH_VARARGS, "render(buffer, config): add the next len(buffer) samples into buffer"},
+    {"advance", pulseAdvance, METH_VARARGS, "advance(num_samples, config): skip samples without rendering"},
+    {},
+};
+
+// FMConfig
+
+PyTypeObject FMConfigType{};
+
+// ADSR sustain is an attenuation of 1 << sustain; 9 is already below the
+// envelope's floor of 511.
+ConfigField fm_config_fields[] = {
+    CONFIG_FIELD(fm::FMConfig, T_FLOAT, "sample_rate", sample_rate, 1, MAX_SAMPLE_RATE),
+    CONFIG_FIELD(fm::FMConfig, T_INT, "modulation_index", modulation_index, 0, MAX_SHIFT),
+    CONFIG_FIELD(fm::FMConfig, T_INT, "modulation_depth", modulation_depth, 0, MAX_SHIFT),
+    CONFIG_FIELD(fm::FMConfig, T_INT, "modulation_feedback", modulation_feedback, 0, MAX_SHIFT + 1),
+    CONFIG_FIELD(fm::FMConfig, T_INT, "octave_transpose", octave_transpose, -MAX_OCTAVE_TRANSPOSE,
+                 MAX_OCTAVE_TRANSPOSE),
+    CONFIG_FIELD(fm::FMConfig, T_INT, "carrier_decay", carrier_decay, 0, MAX_SHIFT),
+    CONFIG_FIELD(fm::FMConfig, T_INT, "carrier_attack_speed", carrier_adsr.attack_speed, 0, MAX_SHIFT),
+    CONFIG_FIELD(fm::FMConfig, T_INT, "carrier_decay_speed", carrier_adsr.decay_speed, 0, MAX_SHIFT),
+    CONFIG_FIELD(fm::FMConfig, T_INT, "carrier_release_speed", carrier_adsr.release_speed, 0, MAX_SHIFT),
+    CONFIG_FIELD(fm::FMConfig, T_INT, "carrier_sustain", carrier_adsr.sustain, 0, 9),
+    CONFIG_FIELD(fm::FMConfig, T_INT, "modulator_attack_speed", modulator_adsr.attack_speed, 0, MAX_SHIFT),
+    CONFIG_FIELD(fm::FMConfig, T_INT, "modulator_decay_speed", modulator_adsr.decay_speed, 0, MAX_SHIFT),
+    CONFIG_FIELD(fm::FMConfig, T_INT, "modulator_release_speed", modulator_adsr.release_speed, 0, MAX_SHIFT),
+    CONFIG_FIELD(fm::FMConfig, T_INT, "modulator_sustain", modulator_adsr.sustain, 0, 9),
+};
+
+PyGetSetDef fm_config_getset[std::size(fm_config_fields) + 1];
+
+// FMState
+
+PyTypeObject FMStateType{};
+
+PyMemberDef fm_state_members[] = {
+    FIELD(fm::FMState, T_INT, "note", note),
+    FIELD(fm::FMState, T_INT, "carrier_velocity", carrier_velocity),
+    FIELD(fm::FMState, T_INT, "carrier_phase", carrier_phase),
+    FIELD(fm::FMState, T_INT, "modulator_phase", modulator_phase),
+    FIELD(fm::FMState, T_INT, "carrier_phase_inc", carrier_phase_inc),
+    FIELD(fm::FMState, T_INT, "modulator_phase_inc", modulator_phase_inc),
+    FIELD(fm::FMState, T_INT, "modulator_sample", modulator_sample),
+    FIELD(fm::FMState, T_INT, "carrier_envelope", carrier_adsr.value),
+    FIELD(fm::FMState, T_INT, "modulator_envelope", modulator_adsr.value),
+    FIELD(fm::FMState, T_INT, "sample_count", sample_count),
+    {},
+};
+
+PyObject* fmNoteOn(PyObject* self, PyObject* args) {
+  int note, velocity;
+  PyObject* config;
+  if (!PyArg_ParseTuple(args, "iiO!", &note, &velocity, &FMConfigType, &config)) {
+    return nullptr;
+  }
+  unwrap<fm::FMState>(self).noteOn(note, velocity, unwrap<fm::FMConfig>(config));
+  Py_RETURN_NONE;
+}
+
+PyObject* fmNoteOff(PyObject* self, PyObject* args) {
+  PyObject* config;
+  if (!PyArg_ParseTuple(args, "O!", &FMConfigType, &config)) {
+    return nullptr;
+  }
+  unwrap<fm::FMState>(self).noteOff(unwrap<fm::FMConfig>(config));
+  Py_RETURN_NONE;
+}
+
+PyObject* fmRender(PyObject* self, PyObject* args) {
+  PyObject* buffer;
+  PyObject* config;
+  Py_buffer view;
+  if (!PyArg_ParseTuple(args, "OO!", &buffer, &FMConfigType, &config) || !getSamples(buffer, &view)) {
+    return nullptr;
+  }
+  fm::FMState& state = unwrap<fm::FMState>(self);
+  const fm::FMConfig& c = unwrap<fm::FMConfig>(config);
+  renderBuffer(&view, [&](int16_t* samples, int n) { state.render(samples, n, c); });
+  PyBuffer_Release(&view);
+  Py_RETURN_NONE;
+}
+
+PyObject* fmAdvance(PyObject* self, PyObject* args) {
+  int num_samples;
+  PyObject* config;
+  if (!PyArg_ParseTuple(args, "iO!", &num_samples, &FMConfigType, &config)) {
+    return nullptr;
+  }
+  unwrap<fm::FMState>(self).advance(num_samples, unwrap<fm::FMConfig>(config));
+  Py_RETURN_NONE;
+}
+
+PyMethodDef fm_state_methods[] = {
+    {"note_on", fmNoteOn, METH_VARARGS, "note_on(note, velocity, config)"},
+    {"note_off", fmNoteOff, METH_VARARGS, "note_off(config)"},
+    {"render", fmRender, METH_VARARGS, "render(buffer, config): add the next len(buffer) samples into buffer"},
+    {"advance", fmAdvance, METH_VARARGS, "advance(num_samples, config): skip samples without rendering"},
+    {},
+};
+
+// Song
+
+PyTypeObject SongType{};
+
+int songInit(PyObject* self, PyObject* args, PyObject*) {
+  const char* path;
+  if (!PyArg_ParseTuple(args, "s", &path)) {
+    return -1;
+  }
+  // loadSong can fail halfway, so keep the old tables until it succeeds
+  fm::SongData song;
+  std::string error;
+  if (!fm::loadSong(path, &song, &error)) {
+    PyErr_Format(PyExc_OSError, "failed to load song: %s", error.c_str());
+    return -1;
+  }
+  unwrap<fm::SongData>(self) = std::move(song);
+  return 0;
+}
+
+PyObject* songLength(PyObject* self, void*) {
+  return PyLong_FromLong(unwrap<fm::SongData>(self).length());
+}
+
+PyGetSetDef song_getset[] = {
+    {const_cast<char*>("length"), songLength, nullptr, const_cast<char*>("number of song positions"), nullptr},
+    {},
+};
+
+// SongPlayer: every track of a Song, mixed.
+
+struct SongPlayerObject {
+  PyObject_HEAD
+  PyObject* song;
+  std::vector<fm::TrackPlayer> players;
+  std::vector<int32_t> mix;
+  std::vector<int16_t> track;
+};
+
+PyTypeObject SongPlayerType{};
+
+PyObject* songPlayerNew(PyTypeObject* type, PyObject*, PyObject*) {
+  auto* self = reinterpret_cast<SongPlayerObject*>(type->tp_alloc(type, 0));
+  if (self) {
+    self->song = nullptr;
+    new (&self->players) std::vector<fm::TrackPlayer>();
+    new (&self->mix) std::vector<int32_t>();
+    new (&self->track) std::vector<int16_t>();
+  }
+  return reinterpret_cast<PyObject*>(self);
+}
+
+void songPlayerDealloc(PyObject* object) {
+  auto* self = reinterpret_cast<SongPlayerObject*>(object);
+  self->players.~vector();
+  self->mix.~vector();
+  self->track.~vector();
+  Py_XDECREF(self->song);
+  Py_TYPE(object)->tp_free(object);
+}
+
+int songPlayerInit(PyObject* object, PyObject* args, PyObject* kwargs) {
+  static const char* keywords[] = {"song", "position", "sample_rate", nullptr};
+  auto* self = reinterpret_cast<SongPlayerObject*>(object);
+  PyObject* song;
+  int position = 0;
+  int sample_rate = fm::SONG_SAMPLE_RATE;
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O!|ii", const_cast<char**>(keywords), &SongType, &song,
+                                   &position, &sample_rate)) {
+    return -1;
+  }
+  if (position < 0 || sample_rate <= 0) {
+    PyErr_SetString(PyExc_ValueError, "position must be non-negative and sample_rate positive");
+    return -1;
+  }
+  const fm::SongData& data = unwrap<fm::SongData>(song);
+  if (data.length() == 0 || data.snareLength() == 0) {
+    PyErr_SetString(PyExc_ValueError, "song is not loaded");
+    return -1;
+  }
+  Py_INCREF(song);
+  Py_XSETREF(self->song, song);
+  self->players.clear();
+  for (int track = 0; track < fm::SONG_TRACK_COUNT; track++) {
+    self->players.emplace_back(unwrap<fm::SongData>(song), track, sample_rate);
+    self->players.back().seek(position);
+  }
+  return 0;
+}
+
+PyObject* songPlayerRender(PyObject* object, PyObject* args) {
+  auto* self = reinterpret_cast<SongPlayerObject*>(object);
+  PyObject* buffer;
+  Py_buffer view;
+  if (!PyArg_ParseTuple(args, "O", &buffer) || !getSamples(buffer, &view)) {
+    return nullptr;
+  }
+  constexpr int CHUNK = 4096;
+  self->mix.resize(CHUNK);
+  self->track.resize(CHUNK);
+  renderBuffer(&view, [&](int16_t* samples, int n) {
+    for (int offset = 0; offset < n; offset += CHUNK) {
+      int length = n - offset < CHUNK ? n - offset : CHUNK;
+      std::fill(self->mix.begin(), self->mix.begin() + length, 0);
+      for (fm::TrackPlayer& player : self->players) {
+        std::fill(self->track.begin(), self->track.begin() + length, 0);
+        player.render(self->track.data(), length);
+        for (int i = 0; i < length; i++) {
+          self->mix[i] += self->track[i];
+        }
+      }
+      for (int i = 0; i < length; i++) {
+        int32_t x = self->mix[i];
+        samples[offset + i] = x > 32767 ? 32767 : x < -32768 ? -32768 : x;
+      }
+    }
+  });
+  PyBuffer_Release(&view);
+  Py_RETURN_NONE;
+}
+
+PyObject* songPlayerAdvance(PyObject* object, PyObject* args) {
+  auto* self = reinterpret_cast<SongPlayerObject*>(object);
+  int num_samples;
+  if (!PyArg_ParseTuple(args, "i", &num_samples)) {
+    return nullptr;
+  }
+  for (fm::TrackPlayer& player : self->players) {
+    player.advance(num_samples);
+  }
+  Py_RETURN_NONE;
+}
+
+PyObject* songPlayerSeek(PyObject* object, PyObject* args) {
+  auto* self = reinterpret_cast<SongPlayerObject*>(object);
+  int position;
+  if (!PyArg_ParseTuple(args, "i", &position)) {
+    return nullptr;
+  }
+  if (position < 0) {
+    PyErr_SetString(PyExc_ValueError, "position must be non-negative");
+    return nullptr;
+  }
+  for (fm::TrackPlayer& player : self->players) {
+    player.seek(position);
+  }
+  Py_RETURN_NONE;
+}
+
+PyObject* songPlayerPosition(PyObject* object, void*) {
+  auto* self = reinterpret_cast<SongPlayerObject*>(object);
+  return PyLong_FromLong(self->players.empty() ? 0 : self->players[0].position());
+}
+
+PyMethodDef song_player_methods[] = {
+    {"render", songPlayerRender, METH_VARARGS,
+     "render(buffer): fill buffer with the next len(buffer) samples of all tracks, mixed and saturated"},
+    {"advance", songPlayerAdvance, METH_VARARGS, "advance(num_samples): skip samples without rendering"},
+    {"seek", songPlayerSeek, METH_VARARGS, "seek(position): continue from the start of a song position"},
+    {},
+};
+
+PyGetSetDef song_player_getset[] = {
+    {const_cast<char*>("position"), songPlayerPosition, nullptr,
+     const_cast<char*>("song positions started so far"), nullptr},
+    {},
+};
+
+PyModuleDef module_def = {
+    PyModuleDef_HEAD_INIT, "pyfm", "Python bindings for libfm", -1, nullptr, nullptr, nullptr, nullptr, nullptr,
+};
+
+// The type objects start out zeroed and are filled in here rather than by
+// aggregate initialization, which would leave most fields implicit.
+void initType(PyTypeObject* type, const char* name, const char* doc, Py_ssize_t basicsize) {
+  static const PyVarObject head[] = {PyVarObject_HEAD_INIT(nullptr, 0)};
+  type->ob_base = head[0];
+  type->tp_name = name;
+  type->tp_doc = doc;
+  type->tp_basicsize = basicsize;
+  type->tp_flags = Py_TPFLAGS_DEFAULT;
+}
+
+template <class T>
+void initWrapperType(PyTypeObject* type, const char* name, const char* doc) {
+  initType(type, name, doc, sizeof(Wrapper<T>));
+  type->tp_new = wrapperNew<T>;
+  type->tp_dealloc = wrapperDealloc<T>;
+}
+
+bool addType(PyObject* module, PyTypeObject* type, const char* name) {
+  if (PyType_Ready(type) < 0) {
+    return false;
+  }
+  Py_INCREF(type);
+  if (PyModule_AddObject(module, name, reinterpret_cast<PyObject*>(type)) < 0) {
+    Py_DECREF(type);
+    return false;
+  }
+  return true;
+}
+
+}  // namespace
+
+PyMODINIT_FUNC PyInit_pyfm() {
+  initWrapperType<fm::PulseConfig>(&PulseConfigType, "pyfm.PulseConfig", "Pulse voice settings (fm::PulseConfig)");
+  initConfigGetSet(pulse_config_fields, pulse_config_getset);
+  PulseConfigType.tp_getset = pulse_config_getset;
+
+  initWrapperType<fm::PulseState>(&PulseStateType, "pyfm.PulseState", "Pulse voice (fm::PulseState)");
+  PulseStateType.tp_members = pulse_state_members;
+  PulseStateType.tp_methods = pulse_state_methods;
+
+  initWrapperType<fm::FMConfig>(&FMConfigType, "pyfm.FMConfig", "FM voice settings (fm::FMConfig)");
+  initConfigGetSet(fm_config_fields, fm_config_getset);
+  FMConfigType.tp_getset = fm_config_getset;
+
+  initWrapperType<fm::FMState>(&FMStateType, "pyfm.FMState", "FM voice (fm::FMState)");
+  FMStateType.tp_members = fm_state_members;
+  FMStateType.tp_methods = fm_state_methods;
+
+  initWrapperType<fm::SongData>(&SongType, "pyfm.Song",
+                                "Song(path): song tables from a data directory or song file");
+  SongType.tp_init = songInit;
+  SongType.tp_getset = song_getset;
+
+  initType(&SongPlayerType, "pyfm.SongPlayer",
+           "SongPlayer(song, position=0, sample_rate=30000): plays every track of a song",
+           sizeof(SongPlayerObject));
+  SongPlayerType.tp_new = songPlayerNew;
+  SongPlayerType.tp_init = songPlayerInit;
+  SongPlayerType.tp_dealloc = songPlayerDealloc;
+  SongPlayerType.tp_methods = song_player_methods;
+  SongPlayerType.tp_getset = song_player_getset;
+
+  PyObject* module = PyModule_Create(&module_def);
+  if (!module) {
+    return nullptr;
+  }
+  if (!addType(module, &PulseConfigType, "PulseConfig") || !addType(module, &PulseStateType, "PulseState") ||
+      !addType(module, &FMConfigType, "FMConfig") || !addType(module, &FMStateType, "FMState") ||
+      !addType(module, &SongType, "Song") || !addType(module, &SongPlayerType, "SongPlayer") ||
+      PyModule_AddIntConstant(module, "SONG_SAMPLE_RATE", fm::SONG_SAMPLE_RATE) < 0 ||
+      PyModule_AddIntConstant(module, "PULSE_PHASEBITS", fm::PULSE_PHASEBITS) < 0) {
+    Py_DECREF(module);
+    return nullptr;
+  }
+  return module;
+}
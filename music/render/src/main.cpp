@@ -0,0 +1,145 @@
+// Headless song renderer: plays the chip's song tables (data/*.hex) through
+// libfm's pulse voices and the snare, faster than real time, into a WAV file.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "libfm/song.hpp"
+#include "libfm/song_player.hpp"
+#include "libfm/wav_writer.hpp"
+
+namespace {
+
+struct Options {
+  std::string data_dir{"../data"};
+  std::string output{"song.wav"};
+  int loops{1};
+  int start{0};  // song position to start from
+  bool threaded{true};
+};
+
+void usage(const char* argv0) {
+  fprintf(stderr,
+          "usage: %s [options]\n"
+          "  -d, --data DIR     directory with the song .hex tables (default ../data)\n"
+          "  -o, --output FILE  WAV file to write (default song.wav)\n"
+          "  -l, --loops N      number of times to play the song (default 1)\n"
+          "  -s, --start POS    start at song position POS instead of the beginning\n"
+          "  --serial           render tracks one after another on one thread\n",
+          argv0);
+}
+
+bool parseArgs(int argc, char** argv, Options* options) {
+  for (int i = 1; i < argc; i++) {
+    const char* arg = argv[i];
+    bool has_value = i + 1 < argc;
+    if ((!strcmp(arg, "-d") || !strcmp(arg, "--data")) && has_value) {
+      options->data_dir = argv[++i];
+    } else if ((!strcmp(arg, "-o") || !strcmp(arg, "--output")) && has_value) {
+      options->output = argv[++i];
+    } else if ((!strcmp(arg, "-l") || !strcmp(arg, "--loops")) && has_value) {
+      options->loops = atoi(argv[++i]);
+    } else if ((!strcmp(arg, "-s") || !strcmp(arg, "--start")) && has_value) {
+      options->start = atoi(argv[++i]);
+    } else if (!strcmp(arg, "--serial")) {
+      options->threaded = false;
+    } else {
+      return false;
+    }
+  }
+  return options->loops > 0 && options->start >= 0;
+}
+
+int16_t saturate(int32_t x) {
+  return x > 32767 ? 32767 : x < -32768 ? -32768 : x;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  Options options;
+  if (!parseArgs(argc, argv, &options)) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  fm::SongData song;
+  std::string error;
+  if (!fm::loadSong(options.data_dir, &song, &error)) {
+    fprintf(stderr, "Failed to load song: %s\n", error.c_str());
+    return 1;
+  }
+
+  fm::WavWriter wav;
+  if (!wav.open(options.output.c_str(), fm::SONG_SAMPLE_RATE)) {
+    fprintf(stderr, "Failed to open %s\n", options.output.c_str());
+    return 1;
+  }
+
+  // Each loop of the song is one segment: every track renders its segment
+  // into a private buffer (on its own thread), then the segment is mixed and
+  // appended to the file.
+  const int segment_samples = song.length() * fm::SONG_SAMPLES_PER_POSITION;
+  std::vector<std::unique_ptr<fm::TrackPlayer>> players;
+  std::vector<std::vector<int16_t>> track_buffers(fm::SONG_TRACK_COUNT);
+  for (int track = 0; track < fm::SONG_TRACK_COUNT; track++) {
+    players.emplace_back(new fm::TrackPlayer(song, track));
+    players.back()->seek(options.start);
+    track_buffers[track].resize(segment_samples);
+  }
+  std::vector<int16_t> mix(segment_samples);
+
+  auto start = std::chrono::steady_clock::now();
+  for (int loop = 0; loop < options.loops; loop++) {
+    auto render_track = [&](int track) {
+      std::vector<int16_t>& buffer = track_buffers[track];
+      std::fill(buffer.begin(), buffer.end(), 0);
+      players[track]->render(buffer.data(), segment_samples);
+    };
+
+    if (options.threaded) {
+      std::vector<std::thread> threads;
+      for (int track = 0; track < fm::SONG_TRACK_COUNT; track++) {
+        threads.emplace_back(render_track, track);
+      }
+      for (auto& thread : threads) {
+        thread.join();
+      }
+    } else {
+      for (int track = 0; track < fm::SONG_TRACK_COUNT; track++) {
+        render_track(track);
+      }
+    }
+
+    for (int i = 0; i < segment_samples; i++) {
+      int32_t sum = 0;
+      for (int track = 0; track < fm::SONG_TRACK_COUNT; track++) {
+        sum += track_buffers[track][i];
+      }
+      mix[i] = saturate(sum);
+    }
+    if (!wav.write(mix.data(), segment_samples)) {
+      fprintf(stderr, "Failed to write %s\n", options.output.c_str());
+      return 1;
+    }
+  }
+  if (!wav.close()) {
+    fprintf(stderr, "Failed to write %s\n", options.output.c_str());
+    return 1;
+  }
+  auto end = std::chrono::steady_clock::now();
+
+  double seconds = std::chrono::duration<double>(end - start).count();
+  int64_t samples = wav.framesWritten();
+  double audio_seconds = static_cast<double>(samples) / fm::SONG_SAMPLE_RATE;
+  fprintf(stderr, "%s: %lld samples (%.1f s of audio) in %.3f s: %.0f samples/sec, %.0fx real time\n",
+          options.output.c_str(), static_cast<long long>(samples), audio_seconds, seconds,
+          samples / seconds, audio_seconds / seconds);
+  return 0;
+}
@@ -0,0 +1,110 @@
+// Converts song tables (the data/*.hex files track.py writes) to a binary
+// song file (see libfm/song_file.hpp), and checks that it reads back the same.
+
+#include <sys/stat.h>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include "libfm/song.hpp"
+#include "libfm/song_file.hpp"
+
+namespace {
+
+struct Options {
+  std::string data_dir{"../data"};
+  std::string output{"song.fmsong"};
+};
+
+void usage(const char* argv0) {
+  fprintf(stderr,
+          "usage: %s [options]\n"
+          "  -d, --data DIR     directory with the song .hex tables (default ../data)\n"
+          "  -o, --output FILE  song file to write (default song.fmsong)\n",
+          argv0);
+}
+
+bool parseArgs(int argc, char** argv, Options* options) {
+  for (int i = 1; i < argc; i++) {
+    const char* arg = argv[i];
+    bool has_value = i + 1 < argc;
+    if ((!strcmp(arg, "-d") || !strcmp(arg, "--data")) && has_value) {
+      options->data_dir = argv[++i];
+    } else if ((!strcmp(arg, "-o") || !strcmp(arg, "--output")) && has_value) {
+      options->output = argv[++i];
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+long fileSize(const std::string& path) {
+  struct stat st;
+  return stat(path.c_str(), &st) == 0 ? static_cast<long>(st.st_size) : 0;
+}
+
+// Total size of the .hex files loadSong() reads.
+long tableBytes(const std::string& data_dir) {
+  long bytes = fileSize(data_dir + "/drum_snare.hex");
+  for (int track = 0; track < fm::SONG_PULSE_TRACKS; track++) {
+    std::string prefix = data_dir + "/" + fm::songTrackName(track);
+    bytes += fileSize(prefix + "_on.hex") + fileSize(prefix + "_trigger.hex") + fileSize(prefix + "_pitch.hex");
+  }
+  return bytes;
+}
+
+bool sameSong(const fm::SongData& a, const fm::SongData& b) {
+  if (a.length() != b.length() || a.snareLength() != b.snareLength()) {
+    return false;
+  }
+  for (int track = 0; track < fm::SONG_PULSE_TRACKS; track++) {
+    for (int p = 0; p < a.length(); p++) {
+      if (a.on(track, p) != b.on(track, p) || a.trigger(track, p) != b.trigger(track, p) ||
+          a.pitch(track, p) != b.pitch(track, p)) {
+        return false;
+      }
+    }
+  }
+  for (int p = 0; p < a.snareLength(); p++) {
+    if (a.snareHit(p) != b.snareHit(p)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  Options options;
+  if (!parseArgs(argc, argv, &options)) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  fm::SongData song;
+  std::string error;
+  if (!fm::loadSong(options.data_dir, &song, &error)) {
+    fprintf(stderr, "Failed to load song: %s\n", error.c_str());
+    return 1;
+  }
+  if (!fm::writeSongFile(options.output, song, &error)) {
+    fprintf(stderr, "Failed to write song: %s\n", error.c_str());
+    return 1;
+  }
+
+  fm::SongData packed;
+  if (!fm::loadSong(options.output, &packed, &error)) {
+    fprintf(stderr, "Failed to read back song: %s\n", error.c_str());
+    return 1;
+  }
+  if (!sameSong(song, packed)) {
+    fprintf(stderr, "%s does not read back the same as %s\n", options.output.c_str(), options.data_dir.c_str());
+    return 1;
+  }
+
+  fprintf(stderr, "%s: %d positions, %ld bytes (tables were %ld bytes)\n", options.output.c_str(),
+          packed.length(), fileSize(options.output), tableBytes(options.data_dir));
+  return 0;
+}
@@ -1,10 +1,14 @@
 #include "audio.hpp"
 #include <imgui.h>
+#include <algorithm>
+#include <chrono>
 #include <cstring>
+#include <thread>
 #include <stdexcept>
 
 constexpr int SAMPLE_RATE = 48000;
 constexpr int VSYNC_SAMPLES = 525;
+constexpr size_t STACK_PREFAULT_BYTES = 64 * 1024;
 
 void* Audio::AudioThreadEntry(void* arg) {
   Audio* audio = static_cast<Audio*>(arg);
@@ -12,7 +16,15 @@ void* Audio::AudioThreadEntry(void* arg) {
   return NULL;
 }
 
-Audio::Audio() {
+void Audio::RenderJobEntry(void* arg, int job) {
+  static_cast<Audio*>(arg)->renderJob(job);
+}
+
+Audio::Audio(const AudioOptions& options)
+    : mmap_(options.mmap),
+      period_size_(std::min(std::max(options.period_size, 16), MAX_PERIOD_SIZE)),
+      realtime_(options.realtime),
+      pulse_state_(MAX_VOICES) {
   int err = snd_pcm_open(&pcm_handle_, "default", SND_PCM_STREAM_PLAYBACK, SND_PCM_NONBLOCK);
   if (err < 0) {
     throw std::runtime_error("Failed to open PCM device");
@@ -22,15 +34,21 @@ Audio::Audio() {
   snd_pcm_hw_params_alloca(&hw_params);
   snd_pcm_hw_params_any(pcm_handle_, hw_params);
 
-  snd_pcm_hw_params_set_access(pcm_handle_, hw_params, SND_PCM_ACCESS_RW_INTERLEAVED);
+  if (mmap_ && snd_pcm_hw_params_set_access(pcm_handle_, hw_params, SND_PCM_ACCESS_MMAP_INTERLEAVED) < 0) {
+    fprintf(stderr, "PCM device does not support mmap access, using snd_pcm_writei\n");
+    mmap_ = false;
+  }
+  if (!mmap_) {
+    snd_pcm_hw_params_set_access(pcm_handle_, hw_params, SND_PCM_ACCESS_RW_INTERLEAVED);
+  }
   snd_pcm_hw_params_set_format(pcm_handle_, hw_params, SND_PCM_FORMAT_S16_LE);
   snd_pcm_hw_params_set_channels(pcm_handle_, hw_params, 1);
 
   unsigned int sample_rate = SAMPLE_RATE;
   snd_pcm_hw_params_set_rate_near(pcm_handle_, hw_params, &sample_rate, 0);
 
-  snd_pcm_uframes_t buffer_size = 256;
-  snd_pcm_uframes_t period_size = 64;
+  snd_pcm_uframes_t buffer_size = 4 * period_size_;
+  snd_pcm_uframes_t period_size = period_size_;
 
   snd_pcm_hw_params_set_buffer_size_near(pcm_handle_, hw_params, &buffer_size);
   snd_pcm_hw_params_set_period_size_near(pcm_handle_, hw_params, &period_size, 0);
@@ -39,12 +57,88 @@ Audio::Audio() {
   if (err < 0) {
     throw std::runtime_error("Failed to set hardware parameters");
   }
+  period_size_ = std::min<int>(period_size, MAX_PERIOD_SIZE);
+
+  if (mmap_) {
+    // wake up once a period is free; start explicitly once the ring is full
+    snd_pcm_sw_params_t* sw_params;
+    snd_pcm_sw_params_alloca(&sw_params);
+    snd_pcm_sw_params_current(pcm_handle_, sw_params);
+    snd_pcm_sw_params_set_avail_min(pcm_handle_, sw_params, period_size_);
+    snd_pcm_sw_params_set_start_threshold(pcm_handle_, sw_params, buffer_size);
+    if (snd_pcm_sw_params(pcm_handle_, sw_params) < 0) {
+      throw std::runtime_error("Failed to set software parameters");
+    }
+  }
 
-  pulse_config_.sample_rate = sample_rate;
+  gui_config_.sample_rate = sample_rate;
+  sequencer_ = std::make_unique<Sequencer>(sample_rate);
+  if (!options.song_dir.empty()) {
+    std::string error;
+    if (!sequencer_->load(options.song_dir, &error)) {
+      throw std::runtime_error("Failed to load song: " + error);
+    }
+  }
+  loadParameters("params.txt");
+  target_config_ = gui_config_;
+  config_ = gui_config_;
 
   snd_pcm_nonblock(pcm_handle_, 0);
+  startRenderPool(options.render_threads);
+
+  // Everything the audio loop touches is allocated by now: lock it in and
+  // fault it in so the loop never waits on the pager.
+  RealtimeStatus status;
+  if (realtime_.enabled) {
+    status.memory_locked = lockMemory(&status.memory_error);
+    prefault(this, sizeof(*this));
+    prefault(pulse_state_.data(), pulse_state_.size() * sizeof(fm::PulseState));
+  }
   pthread_create(&audio_thread_, NULL, AudioThreadEntry, this);
-  loadParameters("params.txt");
+  if (realtime_.enabled) {
+    makeThreadRealtime(audio_thread_, realtime_, &status);
+    status.report(realtime_);
+
+    // workers get the same priority, pinned to the cores after the audio
+    // thread's
+    int realtime_workers = 0;
+    int workers = render_pool_ ? render_pool_->workers() : 0;
+    for (int i = 0; i < workers; i++) {
+      RealtimeOptions worker = realtime_;
+      worker.cpu = realtime_.cpu >= 0 ? realtime_.cpu + 1 + i : -1;
+      RealtimeStatus worker_status;
+      makeThreadRealtime(render_pool_->worker(i).native_handle(), worker, &worker_status);
+      realtime_workers += worker_status.scheduling && (worker.cpu < 0 || worker_status.affinity);
+    }
+    if (workers > 0) {
+      fprintf(stderr, "rt: render workers: %d/%d real-time\n", realtime_workers, workers);
+    }
+  }
+}
+
+// Splitting a run across the pool only pays off when rendering it serially
+// would take well over the pool's round trip, so the cost of one voice sample
+// is measured here to decide that per run.
+void Audio::startRenderPool(int threads) {
+  if (threads < 0) {
+    // leave a core each for the audio thread and the GUI
+    int cores = std::thread::hardware_concurrency();
+    threads = std::min(std::max(cores - 2, 0), MAX_JOBS - 1);
+  }
+  if (threads > 0) {
+    render_pool_ = std::make_unique<fm::RenderPool>(threads, enterRealtimeThread);
+  }
+
+  fm::PulseState voice;
+  voice.noteOn(69, 127, config_);
+  int16_t samples[MAX_PERIOD_SIZE] = {};
+  constexpr int CALIBRATION_RUNS = 64;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < CALIBRATION_RUNS; i++) {
+    voice.render(samples, MAX_PERIOD_SIZE, config_);
+  }
+  auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start);
+  voice_sample_ns_ = elapsed.count() / (CALIBRATION_RUNS * MAX_PERIOD_SIZE);
 }
 
 Audio::~Audio() {
@@ -53,30 +147,119 @@ Audio::~Audio() {
   snd_pcm_close(pcm_handle_);
 }
 
-void Audio::noteOn(int note, int velocity) {
-  int channel = stealChannel();
-  pulse_state_[channel].noteOn(note, velocity, pulse_config_);
+void Audio::noteOn(int note, int velocity, int64_t time_ns) {
+  if (!events_.push({time_ns, NoteEvent::NOTE_ON, static_cast<uint8_t>(note), static_cast<uint8_t>(velocity)})) {
+    dropped_events_++;
+  }
+}
+
+void Audio::noteOff(int note, int64_t time_ns) {
+  if (!events_.push({time_ns, NoteEvent::NOTE_OFF, static_cast<uint8_t>(note), 0})) {
+    dropped_events_++;
+  }
 }
 
-void Audio::noteOff(int note) {
-  for (auto& channel : pulse_state_) {
-    if (channel.note == note) {
-      channel.noteOff(pulse_config_);
+void Audio::applyEvent(const NoteEvent& event) {
+  if (event.type == NoteEvent::NOTE_ON) {
+    int voice = voices_.noteOn(event.note);
+    if (voice < 0) {
+      return;
+    }
+    pulse_state_[voice].noteOn(event.note, event.velocity, config_);
+    voices_.setLevel(voice, pulse_state_[voice].volume);
+  } else {
+    int voice = voices_.noteOff(event.note);
+    if (voice >= 0) {
+      pulse_state_[voice].noteOff(config_);
     }
   }
 }
 
+void Audio::publishConfig() {
+  config_updates_.back() = gui_config_;
+  config_updates_.publish();
+}
+
+// Steps a smoothed parameter toward its target, covering a quarter of the
+// distance per block (about 5ms to settle at 48kHz) and at least one unit.
+static int rampToward(int value, int target) {
+  int step = (target - value) / 4;
+  if (step == 0) {
+    step = target > value ? 1 : target < value ? -1 : 0;
+  }
+  return value + step;
+}
+
+// Block start: adopt the latest parameters from the GUI. Everything switches
+// at once except sustain and detune, which ramp so that dragging their sliders
+// does not click: across the block they glide from where the last block left
+// them to the next rampToward() step (see rampConfig()).
+void Audio::updateConfig() {
+  if (const fm::PulseConfig* next = config_updates_.read()) {
+    target_config_ = *next;
+  }
+  sustain_ramp_ = {config_.sustain, rampToward(config_.sustain, target_config_.sustain)};
+  detune_ramp_ = {config_.detune, rampToward(config_.detune, target_config_.detune)};
+  config_ = target_config_;
+  config_.sustain = sustain_ramp_.from;
+  config_.detune = detune_ramp_.from;
+
+  metronome_running_ = metronome_on_.load(std::memory_order_acquire);
+  metronome_ticks_per_beat_ = tempo_ticks_per_beat_.load(std::memory_order_relaxed);
+  if (metronome_restart_.exchange(false, std::memory_order_relaxed)) {
+    metronome_beat_count_ = -1;
+    metronome_tick_count_ = -1;
+  }
+}
+
+// Sets sustain and detune for a run starting `offset` samples into a block of
+// `frames`, to their ramps' value at the end of its RAMP_SAMPLES sub-block, and
+// returns how many samples may be rendered before they change again.
+int Audio::rampConfig(int offset, int frames) {
+  if (!sustain_ramp_.moving() && !detune_ramp_.moving()) {
+    return frames - offset;
+  }
+  int end = std::min((offset / RAMP_SAMPLES + 1) * RAMP_SAMPLES, frames);
+  config_.sustain = sustain_ramp_.at(end, frames);
+  config_.detune = detune_ramp_.at(end, frames);
+  return end - offset;
+}
+
+// Keeps clock_origin_ns_ such that sample n is rendered around
+// clock_origin_ns_ + n / sample_rate. Blocks are paced by the PCM device, so
+// the estimate follows it slowly and wakeup jitter averages out.
+void Audio::syncSampleClock(uint64_t block_start) {
+  int64_t now = monotonicNowNs();
+  int64_t predicted = clock_origin_ns_ + static_cast<int64_t>(block_start * 1e9 / config_.sample_rate);
+  if (block_start == 0) {
+    clock_origin_ns_ = now;
+  } else {
+    clock_origin_ns_ += (now - predicted) / 16;
+  }
+}
+
+// Sample at which an event stamped time_ns plays. Everything is delayed by one
+// period, so an event that arrives while a block is being rendered lands in the
+// next one at the same offset it had in real time.
+uint64_t Audio::eventSample(int64_t time_ns) const {
+  int64_t offset = static_cast<int64_t>((time_ns - clock_origin_ns_) * 1e-9 * config_.sample_rate);
+  offset += period_size_;
+  return offset < 0 ? 0 : offset;
+}
+
 void Audio::gui() {
   int val;
 
-  bool metronome_on = metronome_on_;
-  ImGui::Checkbox("Metronome", &metronome_on_);
-  ImGui::SliderInt("Tempo", &tempo_ticks_per_beat_, 1, 12);
-  if (metronome_on_ && !metronome_on) {
+  bool metronome_on = gui_metronome_on_;
+  ImGui::Checkbox("Metronome", &gui_metronome_on_);
+  ImGui::SliderInt("Tempo", &gui_tempo_ticks_per_beat_, 1, 12);
+  if (gui_metronome_on_ && !metronome_on) {
     // reset metronome when initially enabled
-    metronome_beat_count_ = -1;
-    metronome_tick_count_ = -1;
+    metronome_restart_.store(true, std::memory_order_relaxed);
   }
+  tempo_ticks_per_beat_.store(gui_tempo_ticks_per_beat_, std::memory_order_relaxed);
+  // release: a block that sees the metronome on also sees the restart
+  metronome_on_.store(gui_metronome_on_, std::memory_order_release);
   
   /*
   ImGui::SliderInt("Octave Transpose", &fm_config_.octave_transpose, -4, 4);
@@ -107,105 +290,283 @@ void Audio::gui() {
   }
   */
 
-  ImGui::SliderInt("Pulse Width", &pulse_config_.pulse_width, 0, 7);
-  ImGui::SliderInt("Octave Transpose", &pulse_config_.octave_transpose, -4, 4);
-  ImGui::SliderInt("Detune", &pulse_config_.detune, -100, 100);
-  ImGui::SliderInt("Carrier Multiplier", &pulse_config_.carrier_multiplier, 1, 10);
-  ImGui::SliderInt("Decay", &pulse_config_.decay, 0, 11);
-  ImGui::SliderInt("Sustain", &pulse_config_.sustain, 0, 4095);
-  ImGui::SliderInt("Release", &pulse_config_.release, 0, 11);
-  ImGui::Checkbox("LPF", &pulse_config_.lpf_enabled);
-  ImGui::SliderInt("LPF K1 (resonance)", &pulse_config_.lpf_k1, 0, 10);
-  ImGui::SliderInt("LPF K2 (cutoff)", &pulse_config_.lpf_k2, 0, 10);
-  ImGui::SliderInt("Vibrato Depth", &pulse_config_.vibrato_depth, 0, 16);
-  ImGui::SliderInt("Vibrato Rate", &pulse_config_.vibrato_rate, 0, 5);
-  ImGui::SliderInt("Vibrato Envelope", &pulse_config_.vibrato_envelope, 0, 10);
+  bool changed = false;
+  changed |= ImGui::SliderInt("Pulse Width", &gui_config_.pulse_width, 0, 7);
+  changed |= ImGui::SliderInt("Octave Transpose", &gui_config_.octave_transpose, -4, 4);
+  changed |= ImGui::SliderInt("Detune", &gui_config_.detune, -100, 100);
+  changed |= ImGui::SliderInt("Carrier Multiplier", &gui_config_.carrier_multiplier, 1, 10);
+  changed |= ImGui::SliderInt("Decay", &gui_config_.decay, 0, 11);
+  changed |= ImGui::SliderInt("Sustain", &gui_config_.sustain, 0, 4095);
+  changed |= ImGui::SliderInt("Release", &gui_config_.release, 0, 11);
+  changed |= ImGui::Checkbox("LPF", &gui_config_.lpf_enabled);
+  changed |= ImGui::SliderInt("LPF K1 (resonance)", &gui_config_.lpf_k1, 0, 10);
+  changed |= ImGui::SliderInt("LPF K2 (cutoff)", &gui_config_.lpf_k2, 0, 10);
+  changed |= ImGui::SliderInt("Vibrato Depth", &gui_config_.vibrato_depth, 0, 16);
+  changed |= ImGui::SliderInt("Vibrato Rate", &gui_config_.vibrato_rate, 0, 5);
+  changed |= ImGui::SliderInt("Vibrato Envelope", &gui_config_.vibrato_envelope, 0, 10);
+  if (changed) {
+    publishConfig();
+  }
+
+  sequencer_->gui();
 
   // Visualizations
-  for (auto& channel : pulse_state_) {
-    ImGui::Text("Note: %d", channel.note);
-    ImGui::PlotLines("", channel.scope_buffer, 1024, 0, NULL, -1.0f, 1.0f, ImVec2(1024, 100));
+  ImGui::Text("Voices: %d/%d", active_voices_.load(std::memory_order_relaxed), voices_.capacity());
+  if (dropped_events_ > 0) {
+    ImGui::SameLine();
+    ImGui::Text("(%u MIDI events dropped)", dropped_events_.load());
+  }
+  if (ImGui::CollapsingHeader("Scopes", ImGuiTreeNodeFlags_DefaultOpen)) {
+    for (int i = 0; i < SCOPE_VOICES; i++) {
+      updateScope(i);
+      ImGui::PushID(i);
+      ImGui::Text("Note: %d", scope_notes_[i].load(std::memory_order_relaxed));
+      ImGui::PlotLines("", scope_plot_[i], SCOPE_SAMPLES, 0, NULL, -1.0f, 1.0f, ImVec2(1024, 100));
+      ImGui::PopID();
+    }
+  } else {
+    for (auto& tap : scope_taps_) {
+      tap.unsubscribe();
+    }
+  }
+}
+
+void Audio::updateScope(int voice) {
+  fm::TelemetryTap& tap = scope_taps_[voice];
+  int16_t* history = scope_history_[voice];
+  if (!tap.listening()) {
+    tap.subscribe();
+  }
+
+  int16_t incoming[SCOPE_HISTORY];
+  int n;
+  while ((n = tap.read(incoming, SCOPE_HISTORY)) > 0) {
+    memmove(history, history + n, (SCOPE_HISTORY - n) * sizeof(int16_t));
+    memcpy(history + SCOPE_HISTORY - n, incoming, n * sizeof(int16_t));
+  }
+
+  // trigger on the latest rising zero crossing that still leaves a full window
+  int start = SCOPE_HISTORY - SCOPE_SAMPLES;
+  for (int i = start; i > 0; i--) {
+    if (history[i - 1] < 0 && history[i] >= 0) {
+      start = i;
+      break;
+    }
+  }
+  for (int i = 0; i < SCOPE_SAMPLES; i++) {
+    scope_plot_[voice][i] = history[start + i] / 4096.0f;
   }
 }
 
 void Audio::audioThread() {
-  const int BUFFER_SIZE = 64;
-  int16_t buffer[BUFFER_SIZE];
-  int vsync_counter = 0;
+  if (realtime_.enabled) {
+    prefaultStack(STACK_PREFAULT_BYTES);
+  }
 
-  int metronome_volume = 0;
-  int metronome_pitch = 0;
-  int metronome_phase = 0;
+  // Nothing in here allocates: the voice allocator and event ring are sized
+  // up front, and RealtimeSection aborts debug builds that do (the render
+  // workers enter the same check when they start). It still makes
+  // syscalls that can block:
+  //  - the PCM calls: snd_pcm_writei, or snd_pcm_avail_update, snd_pcm_wait
+  //    and the mmap begin/commit, plus snd_pcm_recover after an xrun;
+  //  - RenderPool::run: locking sleep_mutex_ and wake_.notify_all() (a futex
+  //    wake) when workers have gone to sleep, and sched_yield while it waits
+  //    for workers that are slow to show up.
+  // clock_gettime goes through the vDSO.
+  RealtimeSection realtime_section;
+  if (mmap_) {
+    mmapLoop();
+  } else {
+    writeLoop();
+  }
+}
 
+void Audio::writeLoop() {
+  int16_t buffer[MAX_PERIOD_SIZE];
   while (running_) {
-    memset(buffer, 0, sizeof(buffer));
-    int samples_to_render = BUFFER_SIZE;
-    int offset = 0;
-    while (samples_to_render > 0) {
-      int runlength = samples_to_render;
-      if (vsync_counter + BUFFER_SIZE > VSYNC_SAMPLES) {
-        runlength = VSYNC_SAMPLES - vsync_counter;
-      }
-      for (int i = 0; i < 4; i++) {
-        pulse_state_[i].render(buffer+offset, runlength, pulse_config_);
-      }
-      if (metronome_on_) {
-        for (int i = 0; i < runlength; i++) {
-          buffer[offset+i] += metronome_volume * (metronome_phase & 0x8000 ? 1 : -1);
-          metronome_phase += metronome_pitch;
+    renderBlock(buffer, period_size_);
+    snd_pcm_sframes_t frames = snd_pcm_writei(pcm_handle_, buffer, period_size_);
+    if (frames < 0) {
+      frames = snd_pcm_recover(pcm_handle_, frames, 0);
+    }
+  }
+}
+
+// Renders each period in place in the device's ring buffer. Blocks are only
+// started when a whole period is free, so the device keeps three periods
+// queued once running.
+void Audio::mmapLoop() {
+  while (running_) {
+    snd_pcm_sframes_t avail = snd_pcm_avail_update(pcm_handle_);
+    if (avail < 0) {
+      snd_pcm_recover(pcm_handle_, avail, 0);
+      continue;
+    }
+    if (avail < period_size_) {
+      if (snd_pcm_state(pcm_handle_) == SND_PCM_STATE_PREPARED) {
+        snd_pcm_start(pcm_handle_);
+      } else {
+        int err = snd_pcm_wait(pcm_handle_, 100);
+        if (err < 0) {
+          snd_pcm_recover(pcm_handle_, err, 0);
         }
       }
-      samples_to_render -= runlength;
-      offset += runlength;
-      vsync_counter += runlength;
-      if (vsync_counter >= VSYNC_SAMPLES) {
-        for (int i = 0; i < 4; i++) {
-          pulse_state_[i].tickEnvelopes(pulse_config_);
+      continue;
+    }
+
+    const snd_pcm_channel_area_t* areas;
+    snd_pcm_uframes_t offset;
+    snd_pcm_uframes_t frames = period_size_;
+    int err = snd_pcm_mmap_begin(pcm_handle_, &areas, &offset, &frames);
+    if (err < 0) {
+      snd_pcm_recover(pcm_handle_, err, 0);
+      continue;
+    }
+    // mono S16, so consecutive frames are consecutive samples; frames may be
+    // short where the ring wraps
+    int16_t* out = reinterpret_cast<int16_t*>(static_cast<char*>(areas[0].addr) + areas[0].first / 8) + offset;
+    renderBlock(out, frames);
+    snd_pcm_sframes_t committed = snd_pcm_mmap_commit(pcm_handle_, offset, frames);
+    if (committed < 0) {
+      snd_pcm_recover(pcm_handle_, committed, 0);
+    }
+  }
+}
+
+void Audio::renderBlock(int16_t* buffer, int frames) {
+  int samples_to_render = frames;
+  int offset = 0;
+  const uint64_t block_start = sample_clock_;
+  syncSampleClock(block_start);
+  updateConfig();
+  while (samples_to_render > 0) {
+    int runlength = std::min(samples_to_render, rampConfig(offset, frames));
+    if (vsync_counter_ + runlength > VSYNC_SAMPLES) {
+      runlength = VSYNC_SAMPLES - vsync_counter_;
+    }
+    // apply events that are due and stop this run at the next one, so notes
+    // start on their exact sample
+    const uint64_t now = block_start + offset;
+    while (const NoteEvent* event = events_.front()) {
+      uint64_t at = eventSample(event->time_ns);
+      if (at > now) {
+        if (at < now + runlength) {
+          runlength = static_cast<int>(at - now);
         }
-        vsync_counter = 0;
-        if (metronome_on_) {
-          metronome_volume -= (metronome_volume + 0x3) >> 2;
-          metronome_tick_count_++;
-          if (metronome_tick_count_ >= tempo_ticks_per_beat_) {
-            metronome_tick_count_ = 0;
-            metronome_beat_count_++;
-            // every 4 ticks, play a tick
-            if ((metronome_beat_count_ & 0x3) == 0) {
-              metronome_pitch = (1 << 15) * 440 / pulse_config_.sample_rate;
-              metronome_volume = 1024;
-            }
-            // on the downbeat, play a low pitch
-            if (metronome_beat_count_ >= 16) {
-              metronome_beat_count_ = 0;
-              metronome_pitch >>= 1;
-            }
+        break;
+      }
+      applyEvent(*event);
+      events_.pop();
+    }
+    renderVoices(runlength);
+    int jobs = (voices_.activeCount() + VOICES_PER_JOB - 1) / VOICES_PER_JOB;
+    int32_t mix[MAX_PERIOD_SIZE] = {};
+    for (int job = 0; job < jobs; job++) {
+      for (int i = 0; i < runlength; i++) {
+        mix[i] += job_mix_[job][i];
+      }
+    }
+    sequencer_->render(mix, runlength);
+    if (metronome_running_) {
+      for (int i = 0; i < runlength; i++) {
+        mix[i] += metronome_volume_ * (metronome_phase_ & 0x8000 ? 1 : -1);
+        metronome_phase_ += metronome_pitch_;
+      }
+    }
+    for (int i = 0; i < runlength; i++) {
+      buffer[offset+i] = std::min(std::max(mix[i], -32768), 32767);
+    }
+    samples_to_render -= runlength;
+    offset += runlength;
+    vsync_counter_ += runlength;
+    if (vsync_counter_ >= VSYNC_SAMPLES) {
+      reapVoices();
+      sequencer_->tick();
+      vsync_counter_ = 0;
+      if (metronome_running_) {
+        metronome_volume_ -= (metronome_volume_ + 0x3) >> 2;
+        metronome_tick_count_++;
+        if (metronome_tick_count_ >= metronome_ticks_per_beat_) {
+          metronome_tick_count_ = 0;
+          metronome_beat_count_++;
+          // every 4 ticks, play a tick
+          if ((metronome_beat_count_ & 0x3) == 0) {
+            metronome_pitch_ = (1 << 15) * 440 / config_.sample_rate;
+            metronome_volume_ = 1024;
+          }
+          // on the downbeat, play a low pitch
+          if (metronome_beat_count_ >= 16) {
+            metronome_beat_count_ = 0;
+            metronome_pitch_ >>= 1;
           }
         }
       }
     }
+  }
+  sample_clock_ += frames;
+  publishStatus();
+}
 
+void Audio::publishStatus() {
+  active_voices_.store(voices_.activeCount(), std::memory_order_relaxed);
+  for (int i = 0; i < SCOPE_VOICES; i++) {
+    scope_notes_[i].store(pulse_state_[i].note, std::memory_order_relaxed);
+  }
+}
 
-    snd_pcm_sframes_t frames = snd_pcm_writei(pcm_handle_, buffer, BUFFER_SIZE);
-    if (frames < 0) {
-      frames = snd_pcm_recover(pcm_handle_, frames, 0);
+// Renders the next num_samples of every active voice into job_mix_, on the
+// pool when the run is big enough to be worth splitting.
+void Audio::renderVoices(int num_samples) {
+  int active = voices_.activeCount();
+  int jobs = (active + VOICES_PER_JOB - 1) / VOICES_PER_JOB;
+  job_samples_ = num_samples;
+  double serial_ns = active * num_samples * voice_sample_ns_;
+  if (render_pool_ && jobs > 1 && serial_ns > 2 * render_pool_->dispatchOverheadNs()) {
+    render_pool_->run(RenderJobEntry, this, jobs);
+  } else {
+    for (int job = 0; job < jobs; job++) {
+      renderJob(job);
+    }
+  }
+}
+
+void Audio::renderJob(int job) {
+  const int num_samples = job_samples_;
+  int32_t* mix = job_mix_[job];
+  memset(mix, 0, num_samples * sizeof(int32_t));
+
+  const int* active = voices_.activeVoices();
+  int end = std::min((job + 1) * VOICES_PER_JOB, voices_.activeCount());
+  for (int k = job * VOICES_PER_JOB; k < end; k++) {
+    int v = active[k];
+    int16_t voice[MAX_PERIOD_SIZE];
+    memset(voice, 0, num_samples * sizeof(int16_t));
+    pulse_state_[v].render(voice, num_samples, config_);
+    if (v < SCOPE_VOICES && scope_taps_[v].listening()) {
+      scope_taps_[v].push(voice, num_samples);
+    }
+    for (int i = 0; i < num_samples; i++) {
+      mix[i] += voice[i];
     }
   }
 }
 
-int Audio::stealChannel() {
-  int channel = -1;
-  int min_volume = 10000;
-  for (size_t i = 0; i < 4; i++) {
-    auto s = pulse_state_[i].adsr_state;
-    auto v = pulse_state_[i].volume;
-    if (s == 0) {
-      return i;
-    } else if (s == 4 && v < min_volume) {
-      channel = i;
-      min_volume = v;
+// Ticks the envelopes of every sounding voice, then hands the ones that have
+// finished releasing back to the allocator so idle slots cost nothing to
+// render. Walks backwards because free() moves the last active voice into the
+// freed position.
+void Audio::reapVoices() {
+  const int* active = voices_.activeVoices();
+  for (int k = voices_.activeCount() - 1; k >= 0; k--) {
+    int v = active[k];
+    fm::PulseState& voice = pulse_state_[v];
+    voice.tickEnvelopes(config_);
+    if (voice.adsr_state == 0) {
+      voices_.free(v);
+    } else {
+      voices_.setLevel(v, voice.volume);
     }
   }
-  return channel;
 }
 
 void Audio::saveParameters(const char* filename) {
@@ -230,19 +591,19 @@ void Audio::saveParameters(const char* filename) {
 
   fprintf(file, "CarrierDecay=%d\n", fm_config_.carrier_decay);
 */
-  fprintf(file, "PulseWidth=%d\n", pulse_config_.pulse_width);
-  fprintf(file, "OctaveTrans=%d\n", pulse_config_.octave_transpose);
-  fprintf(file, "Detune=%d\n", pulse_config_.detune);
-  fprintf(file, "CarrierMultiplier=%d\n", pulse_config_.carrier_multiplier);
-  fprintf(file, "Decay=%d\n", pulse_config_.decay);
-  fprintf(file, "Sustain=%d\n", pulse_config_.sustain);
-  fprintf(file, "Release=%d\n", pulse_config_.release);
-  fprintf(file, "LPF=%d\n", pulse_config_.lpf_enabled);
-  fprintf(file, "LPFK1=%d\n", pulse_config_.lpf_k1);
-  fprintf(file, "LPFK2=%d\n", pulse_config_.lpf_k2);
-  fprintf(file, "VibratoDepth=%d\n", pulse_config_.vibrato_depth);
-  fprintf(file, "VibratoRate=%d\n", pulse_config_.vibrato_rate);
-  fprintf(file, "VibratoEnvelope=%d\n", pulse_config_.vibrato_envelope);
+  fprintf(file, "PulseWidth=%d\n", gui_config_.pulse_width);
+  fprintf(file, "OctaveTrans=%d\n", gui_config_.octave_transpose);
+  fprintf(file, "Detune=%d\n", gui_config_.detune);
+  fprintf(file, "CarrierMultiplier=%d\n", gui_config_.carrier_multiplier);
+  fprintf(file, "Decay=%d\n", gui_config_.decay);
+  fprintf(file, "Sustain=%d\n", gui_config_.sustain);
+  fprintf(file, "Release=%d\n", gui_config_.release);
+  fprintf(file, "LPF=%d\n", gui_config_.lpf_enabled);
+  fprintf(file, "LPFK1=%d\n", gui_config_.lpf_k1);
+  fprintf(file, "LPFK2=%d\n", gui_config_.lpf_k2);
+  fprintf(file, "VibratoDepth=%d\n", gui_config_.vibrato_depth);
+  fprintf(file, "VibratoRate=%d\n", gui_config_.vibrato_rate);
+  fprintf(file, "VibratoEnvelope=%d\n", gui_config_.vibrato_envelope);
 
   fclose(file);
 }
@@ -274,23 +635,23 @@ void Audio::loadParameters(const char* filename) {
     check_parami(line, "ModRelease=", &fm_config_.modulator_adsr.release_speed);
     check_parami(line, "CarrierDecay=", &fm_config_.carrier_decay);
     */
-    check_parami(line, "PulseWidth=", &pulse_config_.pulse_width);
-    check_parami(line, "OctaveTrans=", &pulse_config_.octave_transpose);
-    check_parami(line, "Detune=", &pulse_config_.detune);
-    check_parami(line, "CarrierMultiplier=", &pulse_config_.carrier_multiplier);
-    check_parami(line, "Decay=", &pulse_config_.decay);
-    check_parami(line, "Sustain=", &pulse_config_.sustain);
-    check_parami(line, "Release=", &pulse_config_.release);
+    check_parami(line, "PulseWidth=", &gui_config_.pulse_width);
+    check_parami(line, "OctaveTrans=", &gui_config_.octave_transpose);
+    check_parami(line, "Detune=", &gui_config_.detune);
+    check_parami(line, "CarrierMultiplier=", &gui_config_.carrier_multiplier);
+    check_parami(line, "Decay=", &gui_config_.decay);
+    check_parami(line, "Sustain=", &gui_config_.sustain);
+    check_parami(line, "Release=", &gui_config_.release);
     int lpf_enabled;
     check_parami(line, "LPF=", &lpf_enabled);
     if (lpf_enabled) {
-      pulse_config_.lpf_enabled = true;
-      check_parami(line, "LPFK1=", &pulse_config_.lpf_k1);
-      check_parami(line, "LPFK2=", &pulse_config_.lpf_k2);
+      gui_config_.lpf_enabled = true;
+      check_parami(line, "LPFK1=", &gui_config_.lpf_k1);
+      check_parami(line, "LPFK2=", &gui_config_.lpf_k2);
     }
-    check_parami(line, "VibratoDepth=", &pulse_config_.vibrato_depth);
-    check_parami(line, "VibratoRate=", &pulse_config_.vibrato_rate);
-    check_parami(line, "VibratoEnvelope=", &pulse_config_.vibrato_envelope);
+    check_parami(line, "VibratoDepth=", &gui_config_.vibrato_depth);
+    check_parami(line, "VibratoRate=", &gui_config_.vibrato_rate);
+    check_parami(line, "VibratoEnvelope=", &gui_config_.vibrato_envelope);
   }
   fclose(file);
 } 
\ No newline at end of file
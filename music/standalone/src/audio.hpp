@@ -3,15 +3,38 @@
 #include <pthread.h>
 #include <atomic>
 #include <array>
+#include <memory>
+#include <string>
+#include <vector>
+#include "event_queue.hpp"
+#include "realtime.hpp"
+#include "sequencer.hpp"
+#include "triple_buffer.hpp"
 #include "libfm/pulse_channel.hpp"
+#include "libfm/render_pool.hpp"
+#include "libfm/telemetry.hpp"
+#include "libfm/voice_allocator.hpp"
+
+struct AudioOptions {
+  // render straight into the device's ring buffer (SND_PCM_ACCESS_MMAP_*)
+  // instead of copying each block out with snd_pcm_writei
+  bool mmap{false};
+  int period_size{64};  // frames per block; the device buffer holds four
+  // threads helping the audio thread render voices; -1 for one per spare core
+  int render_threads{-1};
+  RealtimeOptions realtime;
+  std::string song_dir;  // song tables to load into the sequencer at startup
+};
 
 class Audio {
  public:
-  Audio();
+  explicit Audio(const AudioOptions& options = AudioOptions());
   ~Audio();
 
-  void noteOn(int note, int velocity);
-  void noteOff(int note);
+  // MIDI thread only: queue a note for the audio thread to play at time_ns
+  // (CLOCK_MONOTONIC).
+  void noteOn(int note, int velocity, int64_t time_ns);
+  void noteOff(int note, int64_t time_ns);
   void gui();
 
   void saveParameters(const char* filename);
@@ -19,18 +42,105 @@ class Audio {
 
  private:
   static void* AudioThreadEntry(void* arg);
+  static void RenderJobEntry(void* arg, int job);
   void audioThread();
-  int stealChannel();
+  void writeLoop();
+  void mmapLoop();
+  void renderBlock(int16_t* out, int frames);
+  void renderVoices(int num_samples);
+  void renderJob(int job);
+  void startRenderPool(int threads);
+  void publishConfig();
+  void updateConfig();
+  int rampConfig(int offset, int frames);
+  void syncSampleClock(uint64_t block_start);
+  uint64_t eventSample(int64_t time_ns) const;
+  void applyEvent(const NoteEvent& event);
+  void reapVoices();
+  void updateScope(int voice);
+  void publishStatus();
 
   snd_pcm_t* pcm_handle_;
   pthread_t audio_thread_;
   std::atomic<bool> running_{true};
+  bool mmap_;
+  int period_size_;
+  RealtimeOptions realtime_;
+
+  // The GUI edits gui_config_ and publishes copies of it; the audio thread
+  // takes the latest one at the start of a block and renders the whole block
+  // from config_, with sustain and detune ramped toward target_config_.
+  fm::PulseConfig gui_config_;
+  TripleBuffer<fm::PulseConfig> config_updates_;
+  fm::PulseConfig target_config_;
+  fm::PulseConfig config_;
+
+  // Within a block, sustain and detune move linearly from `from` to `to`,
+  // changing every RAMP_SAMPLES samples.
+  struct Ramp {
+    int from{0};
+    int to{0};
+    int at(int done, int total) const { return from + (to - from) * done / total; }
+    bool moving() const { return from != to; }
+  };
+  static constexpr int RAMP_SAMPLES = 16;
+  Ramp sustain_ramp_;
+  Ramp detune_ramp_;
+
+  static constexpr int MAX_VOICES = 64;
+  std::vector<fm::PulseState> pulse_state_;
+  fm::VoiceAllocator voices_{MAX_VOICES};
+
+  // Voices are rendered in jobs of VOICES_PER_JOB, each summed into its own
+  // row of job_mix_, and the rows are mixed in order, so the output is the
+  // same whether the jobs ran on the pool or on the audio thread.
+  static constexpr int MAX_PERIOD_SIZE = 1024;
+  static constexpr int VOICES_PER_JOB = 4;
+  static constexpr int MAX_JOBS = MAX_VOICES / VOICES_PER_JOB;
+  std::unique_ptr<fm::RenderPool> render_pool_;
+  double voice_sample_ns_{0};  // measured cost of rendering one voice sample
+  int job_samples_{0};         // length of the run being rendered
+  int32_t job_mix_[MAX_JOBS][MAX_PERIOD_SIZE];
+
+  // Note events in flight from the MIDI thread, and the audio thread's
+  // mapping from CLOCK_MONOTONIC to its running sample count.
+  SpscQueue<NoteEvent, 1024> events_;
+  std::atomic<uint32_t> dropped_events_{0};
+  uint64_t sample_clock_{0};
+  int64_t clock_origin_ns_{0};  // time at which sample 0 was rendered
+
+  std::unique_ptr<Sequencer> sequencer_;
+
+  // output of the first SCOPE_VOICES voice slots for the scopes in gui(); only
+  // fed while the GUI listens
+  static constexpr int SCOPE_VOICES = 4;
+  static constexpr int SCOPE_SAMPLES = 1024;
+  static constexpr int SCOPE_HISTORY = 2 * SCOPE_SAMPLES;
+  fm::TelemetryTap scope_taps_[SCOPE_VOICES];
+  int16_t scope_history_[SCOPE_VOICES][SCOPE_HISTORY]{};
+  float scope_plot_[SCOPE_VOICES][SCOPE_SAMPLES]{};
+
+  // what gui() shows of the voices, which only the audio thread may touch;
+  // published at the end of every block
+  std::atomic<int> active_voices_{0};
+  std::atomic<int> scope_notes_[SCOPE_VOICES]{};
+
+  // The GUI edits the gui_ metronome settings and publishes them through the
+  // atomics; switching it on also asks the audio thread to restart the count.
+  bool gui_metronome_on_{false};
+  int gui_tempo_ticks_per_beat_{5};
+  std::atomic<bool> metronome_on_{false};
+  std::atomic<int> tempo_ticks_per_beat_{5};
+  std::atomic<bool> metronome_restart_{false};
 
-  fm::PulseConfig pulse_config_;
-  fm::PulseState pulse_state_[4];
+  // audio thread only
+  int vsync_counter_{0};
+  int metronome_volume_{0};
+  int metronome_pitch_{0};
+  int metronome_phase_{0};
 
-  int tempo_ticks_per_beat_{5};
-  bool metronome_on_{false};
+  bool metronome_running_{false};
+  int metronome_ticks_per_beat_{5};
   int metronome_beat_count_{0};
   int metronome_tick_count_{0};
 }; 
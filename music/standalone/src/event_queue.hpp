@@ -0,0 +1,58 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+
+inline int64_t monotonicNowNs() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Note events from the MIDI thread, stamped with the CLOCK_MONOTONIC time at
+// which they should sound; the audio thread maps that onto its sample clock.
+struct NoteEvent {
+  enum Type : uint8_t { NOTE_ON, NOTE_OFF };
+
+  int64_t time_ns;
+  Type type;
+  uint8_t note;
+  uint8_t velocity;
+};
+
+// Wait-free single-producer/single-consumer ring. N must be a power of two.
+template <class T, size_t N>
+class SpscQueue {
+  static_assert((N & (N - 1)) == 0, "SpscQueue size must be a power of two");
+
+ public:
+  // Producer: returns false (and drops the item) when the ring is full.
+  bool push(const T& item) {
+    size_t w = write_.load(std::memory_order_relaxed);
+    if (w - read_.load(std::memory_order_acquire) == N) {
+      return false;
+    }
+    items_[w & (N - 1)] = item;
+    write_.store(w + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer: oldest item, or nullptr when empty. Valid until pop().
+  const T* front() const {
+    size_t r = read_.load(std::memory_order_relaxed);
+    if (r == write_.load(std::memory_order_acquire)) {
+      return nullptr;
+    }
+    return &items_[r & (N - 1)];
+  }
+
+  void pop() {
+    read_.store(read_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+  }
+
+ private:
+  T items_[N];
+  alignas(64) std::atomic<size_t> write_{0};
+  alignas(64) std::atomic<size_t> read_{0};
+};
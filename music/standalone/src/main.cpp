@@ -5,6 +5,8 @@
 #include <stdexcept>
 #include <memory>
 #include <csignal>
+#include <cstdlib>
+#include <cstring>
 
 #include "audio.hpp"
 #include "midi.hpp"
@@ -15,7 +17,7 @@ static void signal_handler(int);
 
 class Application {
  public:
-  Application() {
+  explicit Application(const AudioOptions& audio_options) {
     g_app = this;
     signal(SIGINT, signal_handler);
 
@@ -37,7 +39,7 @@ class Application {
     ImGui_ImplGlfw_InitForOpenGL(window_, true);
     ImGui_ImplOpenGL3_Init("#version 130");
 
-    audio_ = std::make_unique<Audio>();
+    audio_ = std::make_unique<Audio>(audio_options);
     midi_ = std::make_unique<Midi>(*audio_);
     if (!midi_->open()) {
       throw std::runtime_error("Failed to open MIDI device");
@@ -97,9 +99,60 @@ static void signal_handler(int) {
   if (g_app) g_app->quit();
 }
 
-int main() {
+static void usage(const char* argv0) {
+  fprintf(stderr,
+          "usage: %s [options]\n"
+          "  --mmap             render directly into the sound card's buffer\n"
+          "  --period N         frames per audio block (default 64, 32 works well with --mmap)\n"
+          "  --threads N        extra threads for rendering voices (default: one per spare core)\n"
+          "  --song DIR         load the song tables in DIR (e.g. ../data) into the sequencer\n"
+          "  --rt               run the audio thread in real-time mode (locked memory,\n"
+          "                     SCHED_FIFO); reports what could be enabled at startup\n"
+          "  --rt-rr            use SCHED_RR instead of SCHED_FIFO\n"
+          "  --rt-priority N    real-time priority (default 70)\n"
+          "  --rt-cpu N         pin the audio thread to cpu N\n",
+          argv0);
+}
+
+static bool parseArgs(int argc, char** argv, AudioOptions* options) {
+  for (int i = 1; i < argc; i++) {
+    const char* arg = argv[i];
+    bool has_value = i + 1 < argc;
+    if (!strcmp(arg, "--mmap")) {
+      options->mmap = true;
+    } else if (!strcmp(arg, "--period") && has_value) {
+      options->period_size = atoi(argv[++i]);
+    } else if (!strcmp(arg, "--threads") && has_value) {
+      options->render_threads = atoi(argv[++i]);
+    } else if (!strcmp(arg, "--song") && has_value) {
+      options->song_dir = argv[++i];
+    } else if (!strcmp(arg, "--rt")) {
+      options->realtime.enabled = true;
+    } else if (!strcmp(arg, "--rt-rr")) {
+      options->realtime.enabled = true;
+      options->realtime.policy = SCHED_RR;
+    } else if (!strcmp(arg, "--rt-priority") && has_value) {
+      options->realtime.enabled = true;
+      options->realtime.priority = atoi(argv[++i]);
+    } else if (!strcmp(arg, "--rt-cpu") && has_value) {
+      options->realtime.enabled = true;
+      options->realtime.cpu = atoi(argv[++i]);
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+int main(int argc, char** argv) {
+  AudioOptions audio_options;
+  if (!parseArgs(argc, argv, &audio_options)) {
+    usage(argv[0]);
+    return 1;
+  }
+
   try {
-    Application app;
+    Application app(audio_options);
     app.run();
   } catch (const std::exception& e) {
     fprintf(stderr, "Error: %s\n", e.what());
@@ -11,14 +11,38 @@ void* Midi::MidiThreadEntry(void* arg) {
 Midi::Midi(Audio& audio) : audio_(audio) {}
 
 bool Midi::open() {
-  if (snd_seq_open(&seq_handle_, "default", SND_SEQ_OPEN_INPUT, 0) < 0) {
+  // duplex so we can start the timestamping queue
+  if (snd_seq_open(&seq_handle_, "default", SND_SEQ_OPEN_DUPLEX, 0) < 0) {
     return false;
   }
 
   snd_seq_set_client_name(seq_handle_, "FM Synth");
-  port_id_ = snd_seq_create_simple_port(seq_handle_, "FM Synth Input",
-      SND_SEQ_PORT_CAP_WRITE | SND_SEQ_PORT_CAP_SUBS_WRITE,
-      SND_SEQ_PORT_TYPE_APPLICATION);
+
+  // Have the sequencer stamp incoming events with real time on our own queue,
+  // so the audio thread can place them by when they were played rather than
+  // when this thread got to them.
+  queue_id_ = snd_seq_alloc_named_queue(seq_handle_, "FM Synth");
+
+  snd_seq_port_info_t* port;
+  snd_seq_port_info_alloca(&port);
+  snd_seq_port_info_set_name(port, "FM Synth Input");
+  snd_seq_port_info_set_capability(port, SND_SEQ_PORT_CAP_WRITE | SND_SEQ_PORT_CAP_SUBS_WRITE);
+  snd_seq_port_info_set_type(port, SND_SEQ_PORT_TYPE_APPLICATION);
+  if (queue_id_ >= 0) {
+    snd_seq_port_info_set_timestamping(port, 1);
+    snd_seq_port_info_set_timestamp_real(port, 1);
+    snd_seq_port_info_set_timestamp_queue(port, queue_id_);
+  }
+  if (snd_seq_create_port(seq_handle_, port) < 0) {
+    return false;
+  }
+  port_id_ = snd_seq_port_info_get_port(port);
+
+  if (queue_id_ >= 0) {
+    snd_seq_start_queue(seq_handle_, queue_id_, NULL);
+    snd_seq_drain_output(seq_handle_);
+    queue_start_ns_ = monotonicNowNs();
+  }
 
   // Connect to first available MIDI input
   snd_seq_client_info_t* cinfo;
@@ -49,9 +73,24 @@ bool Midi::open() {
   return true;
 }
 
+// CLOCK_MONOTONIC time of an event: its queue timestamp when the sequencer
+// stamped it, otherwise the time it was read.
+int64_t Midi::eventTimeNs(const snd_seq_event_t* ev) const {
+  int64_t now = monotonicNowNs();
+  if (queue_id_ < 0 || ev->queue != queue_id_ ||
+      (ev->flags & SND_SEQ_TIME_STAMP_MASK) != SND_SEQ_TIME_STAMP_REAL) {
+    return now;
+  }
+  int64_t t = queue_start_ns_ + ev->time.time.tv_sec * 1000000000LL + ev->time.time.tv_nsec;
+  return t < now ? t : now;
+}
+
 Midi::~Midi() {
   running_ = false;
   pthread_join(midi_thread_, NULL);
+  if (queue_id_ >= 0) {
+    snd_seq_free_queue(seq_handle_, queue_id_);
+  }
   snd_seq_close(seq_handle_);
 }
 
@@ -69,10 +108,10 @@ void Midi::midiThread() {
         
         switch (ev->type) {
           case SND_SEQ_EVENT_NOTEON:
-            audio_.noteOn(ev->data.note.note, ev->data.note.velocity);
+            audio_.noteOn(ev->data.note.note, ev->data.note.velocity, eventTimeNs(ev));
             break;
           case SND_SEQ_EVENT_NOTEOFF:
-            audio_.noteOff(ev->data.note.note);
+            audio_.noteOff(ev->data.note.note, eventTimeNs(ev));
             break;
           default:
             break;
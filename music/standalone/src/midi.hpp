@@ -13,10 +13,13 @@ class Midi {
  private:
   static void* MidiThreadEntry(void* arg);
   void midiThread();
+  int64_t eventTimeNs(const snd_seq_event_t* ev) const;
 
   Audio& audio_;
   snd_seq_t* seq_handle_{nullptr};
   int port_id_{-1};
+  int queue_id_{-1};
+  int64_t queue_start_ns_{0};
   pthread_t midi_thread_;
   std::atomic<bool> running_{true};
 }; 
\ No newline at end of file
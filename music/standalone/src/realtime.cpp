@@ -0,0 +1,122 @@
+#include "realtime.hpp"
+#include <sys/mman.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+namespace {
+thread_local bool in_realtime_section = false;
+}  // namespace
+
+#ifndef NDEBUG
+// RealtimeSection's check. Array new and delete fall through to these in
+// libstdc++.
+void* operator new(size_t size) {
+  if (in_realtime_section) {
+    fputs("rt: heap allocation inside the real-time loop\n", stderr);
+    abort();
+  }
+  void* p = malloc(size ? size : 1);
+  if (!p) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void operator delete(void* p) noexcept {
+  free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+  free(p);
+}
+#endif
+
+RealtimeSection::RealtimeSection() {
+  in_realtime_section = true;
+}
+
+RealtimeSection::~RealtimeSection() {
+  in_realtime_section = false;
+}
+
+void enterRealtimeThread() {
+  in_realtime_section = true;
+}
+
+bool lockMemory(int* error) {
+  if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0) {
+    *error = errno;
+    return false;
+  }
+  return true;
+}
+
+void prefault(void* data, size_t size) {
+  const size_t page = sysconf(_SC_PAGESIZE);
+  volatile char* p = static_cast<volatile char*>(data);
+  for (size_t i = 0; i < size; i += page) {
+    p[i] = p[i];
+  }
+  if (size > 0) {
+    p[size - 1] = p[size - 1];
+  }
+}
+
+void prefaultStack(size_t size) {
+  // alloca so the touched region is below the caller's frame, where the
+  // thread's later calls will put theirs
+  void* stack = alloca(size);
+  memset(stack, 0, size);
+  asm volatile("" : : "r"(stack) : "memory");
+}
+
+void makeThreadRealtime(pthread_t thread, const RealtimeOptions& options, RealtimeStatus* status) {
+  sched_param param{};
+  int lo = sched_get_priority_min(options.policy);
+  int hi = sched_get_priority_max(options.policy);
+  param.sched_priority = options.priority < lo ? lo : options.priority > hi ? hi : options.priority;
+  status->scheduling_error = pthread_setschedparam(thread, options.policy, &param);
+  status->scheduling = status->scheduling_error == 0;
+
+  if (options.cpu >= 0) {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(options.cpu, &cpus);
+    status->affinity_error = pthread_setaffinity_np(thread, sizeof(cpus), &cpus);
+    status->affinity = status->affinity_error == 0;
+  }
+}
+
+void RealtimeStatus::report(const RealtimeOptions& options) const {
+  const char* policy = options.policy == SCHED_RR ? "SCHED_RR" : "SCHED_FIFO";
+  if (scheduling) {
+    fprintf(stderr, "rt: %s priority %d: ok\n", policy, options.priority);
+  } else {
+    fprintf(stderr, "rt: %s priority %d: FAILED (%s), running at normal priority\n",
+            policy, options.priority, strerror(scheduling_error));
+    if (scheduling_error == EPERM) {
+      fprintf(stderr, "rt:   needs CAP_SYS_NICE or an rtprio limit (see limits.conf)\n");
+    }
+  }
+
+  if (options.cpu < 0) {
+    fprintf(stderr, "rt: cpu affinity: not requested\n");
+  } else if (affinity) {
+    fprintf(stderr, "rt: cpu affinity: pinned to cpu %d\n", options.cpu);
+  } else {
+    fprintf(stderr, "rt: cpu affinity: cpu %d FAILED (%s)\n", options.cpu, strerror(affinity_error));
+  }
+
+  if (memory_locked) {
+    fprintf(stderr, "rt: memory: locked and prefaulted\n");
+  } else {
+    fprintf(stderr, "rt: memory: mlockall FAILED (%s), prefaulted only\n", strerror(memory_error));
+    if (memory_error == ENOMEM || memory_error == EPERM) {
+      fprintf(stderr, "rt:   raise the memlock limit (ulimit -l)\n");
+    }
+  }
+}
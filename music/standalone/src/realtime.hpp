@@ -0,0 +1,54 @@
+#pragma once
+#include <pthread.h>
+#include <sched.h>
+#include <cstddef>
+
+// Opt-in real-time setup for the audio thread (--rt on the command line).
+struct RealtimeOptions {
+  bool enabled{false};
+  int policy{SCHED_FIFO};  // SCHED_FIFO or SCHED_RR
+  int priority{70};
+  int cpu{-1};  // core to pin the audio thread to, -1 to leave it unpinned
+};
+
+// Which parts of the real-time setup took effect; errors are errno values.
+struct RealtimeStatus {
+  bool scheduling{false};
+  bool affinity{false};
+  bool memory_locked{false};
+  int scheduling_error{0};
+  int affinity_error{0};
+  int memory_error{0};
+
+  // Startup self-check: one line per part to stderr.
+  void report(const RealtimeOptions& options) const;
+};
+
+// Locks all current and future pages of the process into RAM (mlockall),
+// which also faults in everything mapped so far.
+bool lockMemory(int* error);
+
+// Touches every page in [data, data + size) so the first real access cannot
+// page-fault.
+void prefault(void* data, size_t size);
+
+// Touches the next `size` bytes of the calling thread's stack.
+void prefaultStack(size_t size);
+
+// Switches an already running thread to the options' policy and priority and
+// pins it, recording the outcome in status. Failures leave the thread as it
+// was.
+void makeThreadRealtime(pthread_t thread, const RealtimeOptions& options, RealtimeStatus* status);
+
+// Marks the current thread as inside its real-time loop while alive. Like
+// assert(), builds without NDEBUG check it: a heap allocation made there
+// aborts with a message. Syscalls are not checked.
+class RealtimeSection {
+ public:
+  RealtimeSection();
+  ~RealtimeSection();
+};
+
+// Same check for the rest of the calling thread's life, for threads that do
+// nothing but real-time work, like RenderPool's workers (its start hook).
+void enterRealtimeThread();
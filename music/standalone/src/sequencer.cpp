@@ -0,0 +1,211 @@
+#include "sequencer.hpp"
+#include <imgui.h>
+#include <algorithm>
+#include <cstring>
+
+namespace {
+constexpr int RENDER_CHUNK = 256;
+}  // namespace
+
+SequencerCue::SequencerCue(std::shared_ptr<const fm::SongData> song, int position, int sample_rate)
+    : song(std::move(song)),
+      position(position),
+      players{{*this->song, fm::SONG_BASS, sample_rate},
+              {*this->song, fm::SONG_MELODY, sample_rate},
+              {*this->song, fm::SONG_BACKUP, sample_rate},
+              {*this->song, fm::SONG_SNARE, sample_rate}} {
+  for (fm::TrackPlayer& player : players) {
+    player.seek(position);
+  }
+}
+
+Sequencer::Sequencer(int sample_rate) : sample_rate_(sample_rate) {}
+
+// The audio thread is gone by now, so whatever it still held is ours.
+Sequencer::~Sequencer() {
+  collectRetired();
+  while (const SequencerCommand* command = commands_.front()) {
+    delete command->cue;
+    commands_.pop();
+  }
+  delete cue_;
+  delete loop_cue_;
+}
+
+bool Sequencer::load(const std::string& data_dir, std::string* error) {
+  auto song = std::make_shared<fm::SongData>();
+  if (!fm::loadSong(data_dir, song.get(), error)) {
+    return false;
+  }
+  song_ = std::move(song);
+  looping_ = false;
+  loop_start_ = 0;
+  loop_end_ = song_->length();
+  sendLoop();
+  cue(0);
+  return true;
+}
+
+// Returns false, deleting the command's cue, when the queue is full.
+bool Sequencer::send(const SequencerCommand& command) {
+  if (!commands_.push(command)) {
+    delete command.cue;
+    return false;
+  }
+  return true;
+}
+
+void Sequencer::cue(int position) {
+  cue_pending_ = position;
+  sendPending();
+}
+
+void Sequencer::sendLoop() {
+  loop_pending_ = true;
+  sendPending();
+}
+
+// Sends the latest loop, cue and transport state that the audio thread has
+// not received yet. Whatever does not fit stays pending for the next gui().
+void Sequencer::sendPending() {
+  if (loop_pending_) {
+    SequencerCue* start = looping_ ? new SequencerCue(song_, loop_start_, sample_rate_) : nullptr;
+    if (!send({SequencerCommand::LOOP, start, loop_end_})) {
+      return;
+    }
+    loop_pending_ = false;
+  }
+  if (cue_pending_ >= 0) {
+    if (!send({SequencerCommand::CUE, new SequencerCue(song_, cue_pending_, sample_rate_), 0})) {
+      return;
+    }
+    cue_pending_ = -1;
+  }
+  if (transport_pending_) {
+    if (!send({playing_ ? SequencerCommand::PLAY : SequencerCommand::STOP, nullptr, 0})) {
+      return;
+    }
+    transport_pending_ = false;
+  }
+}
+
+void Sequencer::collectRetired() {
+  while (SequencerCue* const* cue = retired_.front()) {
+    delete *cue;
+    retired_.pop();
+  }
+}
+
+void Sequencer::gui() {
+  collectRetired();
+  sendPending();
+  if (!ImGui::CollapsingHeader("Sequencer", ImGuiTreeNodeFlags_DefaultOpen)) {
+    return;
+  }
+
+  ImGui::InputText("Song", song_dir_, sizeof(song_dir_));
+  ImGui::SameLine();
+  if (ImGui::Button("Load")) {
+    load_error_.clear();
+    load(song_dir_, &load_error_);
+  }
+  if (!load_error_.empty()) {
+    ImGui::Text("%s", load_error_.c_str());
+  }
+  if (!song_) {
+    return;
+  }
+
+  if (ImGui::Button(playing_ ? "Stop" : "Play")) {
+    playing_ = !playing_;
+    transport_pending_ = true;
+    sendPending();
+  }
+  ImGui::SameLine();
+  if (ImGui::Button("Rewind")) {
+    cue(looping_ ? loop_start_ : 0);
+  }
+
+  int length = song_->length();
+  int position = shown_position_.load(std::memory_order_relaxed);
+  if (ImGui::SliderInt("Position", &position, 0, length - 1)) {
+    cue(std::min(std::max(position, 0), length - 1));
+  }
+
+  bool loop_changed = ImGui::Checkbox("Loop", &looping_);
+  ImGui::SameLine();
+  loop_changed |= ImGui::DragIntRange2("Region", &loop_start_, &loop_end_, 1.0f, 0, length);
+  if (loop_changed) {
+    loop_start_ = std::min(std::max(loop_start_, 0), length - 1);
+    loop_end_ = std::min(std::max(loop_end_, loop_start_ + 1), length);
+    sendLoop();
+  }
+}
+
+void Sequencer::retire(SequencerCue* cue) {
+  // sized so this cannot fill up: every command retires at most one cue
+  if (cue) {
+    retired_.push(cue);
+  }
+}
+
+void Sequencer::applyCommand(const SequencerCommand& command) {
+  switch (command.type) {
+    case SequencerCommand::PLAY:
+      cue_playing_ = true;
+      break;
+    case SequencerCommand::STOP:
+      cue_playing_ = false;
+      break;
+    case SequencerCommand::CUE:
+      retire(cue_);
+      cue_ = command.cue;
+      tick_ = 0;
+      break;
+    case SequencerCommand::LOOP:
+      retire(loop_cue_);
+      loop_cue_ = command.cue;
+      cue_loop_end_ = command.loop_end;
+      break;
+  }
+}
+
+// Called at a tick boundary: the players start their next tick at the start
+// of the next render(), so this is where they can be swapped without
+// splitting one.
+void Sequencer::tick() {
+  if (cue_ && cue_playing_ && ++tick_ == fm::SONG_TICKS_PER_POSITION) {
+    tick_ = 0;
+    int length = cue_->song->length();
+    cue_->position = (cue_->position + 1) % length;
+    // the loop cue is a snapshot of the loop start; copying its players in
+    // jumps back without seeking here
+    if (loop_cue_ && loop_cue_->song == cue_->song && cue_->position == cue_loop_end_ % length) {
+      std::copy(std::begin(loop_cue_->players), std::end(loop_cue_->players), cue_->players);
+      cue_->position = loop_cue_->position;
+    }
+  }
+
+  while (const SequencerCommand* command = commands_.front()) {
+    applyCommand(*command);
+    commands_.pop();
+  }
+  shown_position_.store(cue_ ? cue_->position : 0, std::memory_order_relaxed);
+}
+
+void Sequencer::render(int32_t* mix, int num_samples) {
+  if (!cue_ || !cue_playing_) {
+    return;
+  }
+  int16_t track[RENDER_CHUNK];
+  for (fm::TrackPlayer& player : cue_->players) {
+    for (int offset = 0; offset < num_samples; offset += RENDER_CHUNK) {
+      int n = std::min(num_samples - offset, RENDER_CHUNK);
+      memset(track, 0, n * sizeof(int16_t));
+      player.render(track, n);
+      for (int i = 0; i < n; i++) {
+        mix[offset + i] += track[i];
+      }
+    }
+  }
+}
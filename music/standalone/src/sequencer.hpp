@@ -0,0 +1,87 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <string>
+#include "event_queue.hpp"
+#include "libfm/song.hpp"
+#include "libfm/song_player.hpp"
+
+// A song and its track players, already advanced to where playback should
+// pick up. Cues are built (and seeked) on the GUI thread and handed to the
+// audio thread whole, so starting, seeking and loading cost it a pointer swap.
+struct SequencerCue {
+  SequencerCue(std::shared_ptr<const fm::SongData> song, int position, int sample_rate);
+
+  std::shared_ptr<const fm::SongData> song;
+  int position;  // song position the players start next
+  fm::TrackPlayer players[fm::SONG_TRACK_COUNT];
+};
+
+struct SequencerCommand {
+  enum Type : uint8_t { PLAY, STOP, CUE, LOOP };
+
+  Type type;
+  SequencerCue* cue;  // CUE: where to continue; LOOP: the loop start, or null
+  int loop_end;       // LOOP: position that jumps back to the loop start
+};
+
+// Plays the chip's song tables (data/*.hex) next to the live voices.
+//
+// The GUI thread loads songs and drives the transport through gui(); the
+// audio thread calls tick() on every VSYNC_SAMPLES tick and render() for the
+// runs in between, which keeps the players' envelope ticks on the audio
+// thread's. Nothing on the audio side allocates or frees: cues come in
+// through a command queue and go back through another to be deleted. When the
+// command queue is full, the GUI keeps what it could not send and sends it
+// again on the next frame, so no transport change is lost.
+class Sequencer {
+ public:
+  explicit Sequencer(int sample_rate);
+  ~Sequencer();
+
+  Sequencer(const Sequencer&) = delete;
+  Sequencer& operator=(const Sequencer&) = delete;
+
+  // GUI thread.
+  bool load(const std::string& data_dir, std::string* error);
+  void gui();
+
+  // Audio thread.
+  void tick();
+  void render(int32_t* mix, int num_samples);
+
+ private:
+  bool send(const SequencerCommand& command);
+  void cue(int position);
+  void sendLoop();
+  void sendPending();
+  void collectRetired();
+  void applyCommand(const SequencerCommand& command);
+  void retire(SequencerCue* cue);
+
+  const int sample_rate_;
+
+  SpscQueue<SequencerCommand, 64> commands_;
+  SpscQueue<SequencerCue*, 128> retired_;
+  std::atomic<int> shown_position_{0};
+
+  // GUI thread
+  std::shared_ptr<const fm::SongData> song_;
+  char song_dir_[256]{"../data"};
+  std::string load_error_;
+  bool playing_{false};
+  bool looping_{false};
+  int loop_start_{0};
+  int loop_end_{0};
+  // changes the audio thread has yet to receive
+  bool loop_pending_{false};
+  int cue_pending_{-1};  // position to cue, or -1
+  bool transport_pending_{false};
+
+  // audio thread
+  SequencerCue* cue_{nullptr};
+  SequencerCue* loop_cue_{nullptr};
+  int cue_loop_end_{0};
+  bool cue_playing_{false};
+  int tick_{0};  // ticks played in the current position
+};
@@ -0,0 +1,36 @@
+#pragma once
+#include <atomic>
+
+// Hands the latest value from one writer thread to one reader thread without
+// locks or torn reads. The writer and reader each own one of three slots and
+// trade theirs for the middle one, which is tagged while it holds a value the
+// reader has not picked up yet.
+template <class T>
+class TripleBuffer {
+ public:
+  // Writer: fill back(), then publish() it. back() is not preserved across
+  // publishes, so write the whole value each time.
+  T& back() { return slots_[back_]; }
+  void publish() {
+    back_ = middle_.exchange(back_ | FRESH, std::memory_order_acq_rel) & INDEX;
+  }
+
+  // Reader: the most recently published value, or nullptr if nothing was
+  // published since the last call. Valid until the next read().
+  const T* read() {
+    if (!(middle_.load(std::memory_order_relaxed) & FRESH)) {
+      return nullptr;
+    }
+    front_ = middle_.exchange(front_, std::memory_order_acq_rel) & INDEX;
+    return &slots_[front_];
+  }
+
+ private:
+  static constexpr unsigned INDEX = 3;
+  static constexpr unsigned FRESH = 4;
+
+  T slots_[3];
+  alignas(64) unsigned back_{0};
+  alignas(64) std::atomic<unsigned> middle_{1};
+  alignas(64) unsigned front_{2};
+};
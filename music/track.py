@@ -4,6 +4,13 @@ import sounddevice as sd
 from synth import pulseconfig, pulse, snare
 from consts import master_clock, clocks_per_sample, samples_per_tick, bpm, samplerate
 
+try:
+    # libfm's Python module (music/python): put its build directory on
+    # PYTHONPATH to play through the C++ engine
+    import pyfm
+except ImportError:
+    pyfm = None
+
 INITIAL_SONGCOUNT = 0
 
 beats_per_tick = 4
@@ -253,6 +260,18 @@ class audiogen:
             if self.tick_samples >= samples_per_tick:
                 self.tick_samples = 0
         return out
+
+
+class nativegen:
+    """Plays the tables dump_tables() wrote through libfm; same output as
+    audiogen without the per-sample Python loops."""
+    def __init__(self, data_dir="../data"):
+        self.player = pyfm.SongPlayer(pyfm.Song(data_dir), INITIAL_SONGCOUNT)
+
+    def get_next_audio_chunk(self, frame_count):
+        out = np.zeros(frame_count, np.int16)
+        self.player.render(out)
+        return out.astype(np.float32)
                
  
 def main():
@@ -263,6 +282,9 @@ def main():
 
     gen = audiogen()
     gen.dump_tables()
+    if pyfm:
+        gen = nativegen()
+        print("rendering with pyfm")
 
     def audio_callback(outdata, frames, _, status):
         if status:
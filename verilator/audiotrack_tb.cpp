@@ -1,62 +1,230 @@
+// Audio-only harness for the Verilated music module. Instead of the 800
+// clocks per sample the full chip runs, only the edges that carry an enable
+// are clocked: one with sample_clk per sample, plus one with tick_clk every
+// SONG_SAMPLES_PER_TICK samples, where tt_um_a1k0n_kapton puts them.
+// audio_sample is the same as on the chip (music_check checks this against
+// libfm's MusicModel); the sigma-delta audio_out is not clocked.
+//
+// Live, a producer thread runs the RTL into a lock-free ring that the SDL
+// callback only copies out of. --headless writes a WAV as fast as the RTL
+// runs and reports how much faster than real time that is. --start-position
+// gets to any song position by running the RTL there, which at this rate takes
+// milliseconds, so unlike the full chip it needs no checkpoints.
+
+#include <signal.h>
 #include <stdint.h>
-#include "Vaudiotrack.h"
-#include "Vaudiotrack__Syms.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "Vmusic.h"
 #include "verilated.h"
+#include "libfm/music_model.hpp"
+#include "libfm/wav_writer.hpp"
 #include <SDL2/SDL.h>
 
-#define SAVE_AUDIO 1
-
-uint64_t samples_generated = 0;
-
-#if SAVE_AUDIO
-FILE *rawfp;
-#endif
-
-// SDL audio callback
-void audio_callback(void* userdata, uint8_t* stream, int len) {
-  Vaudiotrack* top = (Vaudiotrack*) userdata;
-
-  uint16_t *stream16 = (uint16_t*) stream;
-  // Write audio samples to the stream
-  for (int i = 0; i < len/2; i++) {
-    // force a new sample to be generated, rather than stepping through the
-    // sigma-delta modulator
-    top->rootp->audiotrack__DOT__sample_div = 1023;
-    top->clk48 = 0; top->eval(); top->clk48 = 1; top->eval();
-    uint16_t s = top->audio_sample;
-    if (s > 0x8000) {
-      // emulate harmonic distortion from a ~1ns slower rise time than fall
-      // time @ 48MHz; what this means is the upper half of the range gets
-      // "longer" downward pulses than the lower half gets upward pulses.
-      // this is exaggerating the effect and I don't actually hear any
-      // difference
-      s += (s - 0x8000) >> 4;
+static const int BLOCK_SAMPLES = 512;
+static const int RING_SAMPLES = 16384;  // ~0.5 s at SONG_SAMPLE_RATE
+
+static volatile sig_atomic_t interrupted = 0;
+
+static void onSignal(int) {
+  interrupted = 1;
+}
+
+// music.v clocked at the enables only.
+class MusicRtl {
+ public:
+  MusicRtl() : top_(new Vmusic), line_(0) {
+    top_->sample_clk = 0;
+    top_->tick_clk = 0;
+    top_->rst_n = 0;
+    clock();
+    top_->rst_n = 1;
+  }
+
+  ~MusicRtl() {
+    top_->final();
+    delete top_;
+  }
+
+  // audio_sample after each of the next num_samples sample clocks, as signed
+  // 16-bit PCM centred on the 13-bit range's midpoint.
+  void render(int16_t* out, int num_samples) {
+    for (int i = 0; i < num_samples; i++) {
+      top_->sample_clk = 1;
+      clock();
+      top_->sample_clk = 0;
+      out[i] = (int16_t) ((top_->audio_sample - 4096) << 3);
+      if (++line_ == fm::SONG_SAMPLES_PER_TICK) {
+        top_->tick_clk = 1;
+        clock();
+        top_->tick_clk = 0;
+        line_ = 0;
+      }
     }
-    stream16[i] = s;
   }
-  samples_generated += len;
 
-#if SAVE_AUDIO
-  fwrite(stream, sizeof(uint16_t), len/2, rawfp);
-#endif
-}
+  // Runs to the first sample of song position `position` (from reset).
+  void seek(int position) {
+    int16_t scratch[BLOCK_SAMPLES];
+    for (uint64_t left = (uint64_t) position * fm::SONG_SAMPLES_PER_POSITION; left > 0;) {
+      int n = left < BLOCK_SAMPLES ? (int) left : BLOCK_SAMPLES;
+      render(scratch, n);
+      left -= n;
+    }
+  }
 
-int main(int argc, char** argv) {
-  Verilated::commandArgs(argc, argv);
+  int songPosition() const { return top_->song_position; }
+
+ private:
+  void clock() {
+    top_->clk = 0; top_->eval(); top_->clk = 1; top_->eval();
+  }
+
+  Vmusic* top_;
+  int line_;
+};
+
+// Single-producer single-consumer sample ring. Each side only stores its own
+// index, so the SDL callback never takes a lock.
+class SampleRing {
+ public:
+  explicit SampleRing(size_t capacity)  // a power of two
+      : buffer_(capacity), mask_(capacity - 1), read_(0), write_(0) {}
+
+  size_t available() const {
+    return write_.load(std::memory_order_acquire) - read_.load(std::memory_order_acquire);
+  }
+  size_t space() const { return buffer_.size() - available(); }
+
+  // Producer: stores up to n samples, returns how many fit.
+  size_t write(const int16_t* samples, size_t n) {
+    size_t w = write_.load(std::memory_order_relaxed);
+    size_t free = buffer_.size() - (w - read_.load(std::memory_order_acquire));
+    if (n > free) n = free;
+    for (size_t i = 0; i < n; i++) {
+      buffer_[(w + i) & mask_] = samples[i];
+    }
+    write_.store(w + n, std::memory_order_release);
+    return n;
+  }
+
+  // Consumer: takes up to n samples, returns how many there were.
+  size_t read(int16_t* out, size_t n) {
+    size_t r = read_.load(std::memory_order_relaxed);
+    size_t queued = write_.load(std::memory_order_acquire) - r;
+    if (n > queued) n = queued;
+    for (size_t i = 0; i < n; i++) {
+      out[i] = buffer_[(r + i) & mask_];
+    }
+    read_.store(r + n, std::memory_order_release);
+    return n;
+  }
+
+ private:
+  std::vector<int16_t> buffer_;
+  size_t mask_;
+  std::atomic<size_t> read_;
+  std::atomic<size_t> write_;
+};
+
+struct Player {
+  SampleRing ring{RING_SAMPLES};
+  std::atomic<bool> running{true};
+  std::atomic<uint64_t> samples_generated{0};
+  std::atomic<int> song_position{0};
+  std::atomic<uint64_t> underruns{0};  // callback samples the ring could not supply
+  fm::WavWriter* wav{nullptr};
+  uint64_t max_samples{0};  // 0: no limit
+  int start_position{0};
+};
+
+// Producer: keeps the ring topped up, recording to the WAV as it goes.
+static void producerThread(Player* player) {
+  MusicRtl rtl;
+  rtl.seek(player->start_position);
+  int16_t block[BLOCK_SAMPLES];
+  while (player->running.load(std::memory_order_relaxed)) {
+    uint64_t generated = player->samples_generated.load(std::memory_order_relaxed);
+    if (player->max_samples && generated >= player->max_samples) {
+      break;
+    }
+    if (player->ring.space() < BLOCK_SAMPLES) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(2));
+      continue;
+    }
+    int n = BLOCK_SAMPLES;
+    if (player->max_samples && player->max_samples - generated < (uint64_t) n) {
+      n = (int) (player->max_samples - generated);
+    }
+    rtl.render(block, n);
+    player->ring.write(block, n);
+    if (player->wav) {
+      player->wav->write(block, n);
+    }
+    player->song_position.store(rtl.songPosition(), std::memory_order_relaxed);
+    player->samples_generated.store(generated + n, std::memory_order_relaxed);
+  }
+}
 
-  Vaudiotrack* top = new Vaudiotrack;
+// SDL audio callback: copies out of the ring, nothing else.
+static void audioCallback(void* userdata, uint8_t* stream, int len) {
+  Player* player = (Player*) userdata;
+  int16_t* out = (int16_t*) stream;
+  size_t n = len / sizeof(int16_t);
+  size_t got = player->ring.read(out, n);
+  if (got < n) {
+    memset(out + got, 0, (n - got) * sizeof(int16_t));
+    player->underruns.fetch_add(n - got, std::memory_order_relaxed);
+  }
+}
 
-#if SAVE_AUDIO
-  rawfp = fopen("audio.raw", "wb");
-  if (!rawfp) {
-    printf("Failed to open audio.raw\n");
+static int runHeadless(const char* wav_path, uint64_t num_samples, int start_position) {
+  fm::WavWriter wav;
+  if (!wav.open(wav_path, fm::SONG_SAMPLE_RATE)) {
+    fprintf(stderr, "Failed to open %s\n", wav_path);
     return 1;
   }
-#endif
+  MusicRtl rtl;
+  rtl.seek(start_position);
+  int16_t block[BLOCK_SAMPLES];
+  auto start = std::chrono::steady_clock::now();
+  uint64_t done = 0;
+  while (done < num_samples && !interrupted) {
+    int n = num_samples - done < BLOCK_SAMPLES ? (int) (num_samples - done) : BLOCK_SAMPLES;
+    rtl.render(block, n);
+    wav.write(block, n);
+    done += n;
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  if (!wav.close()) {
+    fprintf(stderr, "Failed to write %s\n", wav_path);
+    return 1;
+  }
+  printf("%llu samples (song position %d) to %s in %.3f s\n", (unsigned long long) done,
+         rtl.songPosition(), wav_path, seconds);
+  printf("%.0f samples/s, %.1fx real time\n", done / seconds,
+         done / seconds / fm::SONG_SAMPLE_RATE);
+  return 0;
+}
 
-  top->rst_n = 0;
-  top->clk48 = 0; top->eval(); top->clk48 = 1; top->eval();
-  top->rst_n = 1;
+static int runLive(const char* wav_path, uint64_t max_samples, int start_position) {
+  Player player;
+  fm::WavWriter wav;
+  if (wav_path) {
+    if (!wav.open(wav_path, fm::SONG_SAMPLE_RATE)) {
+      fprintf(stderr, "Failed to open %s\n", wav_path);
+      return 1;
+    }
+    player.wav = &wav;
+  }
+  player.max_samples = max_samples;
+  player.start_position = start_position;
 
   SDL_SetHint(SDL_HINT_NO_SIGNAL_HANDLERS, "1");
 
@@ -67,34 +235,96 @@ int main(int argc, char** argv) {
   }
 
   SDL_AudioSpec desiredSpec, obtainedSpec;
-  desiredSpec.freq = 46875;
-  desiredSpec.format = AUDIO_U16;
+  SDL_zero(desiredSpec);
+  desiredSpec.freq = fm::SONG_SAMPLE_RATE;
+  desiredSpec.format = AUDIO_S16SYS;
   desiredSpec.channels = 1;
-  desiredSpec.samples = 8192;
-  desiredSpec.callback = audio_callback;
-  desiredSpec.userdata = (void*) top;
+  desiredSpec.samples = 1024;
+  desiredSpec.callback = audioCallback;
+  desiredSpec.userdata = (void*) &player;
 
   SDL_AudioDeviceID audioDevice = SDL_OpenAudioDevice(NULL, 0, &desiredSpec, &obtainedSpec, 0);
   if (audioDevice == 0) {
     printf("Failed to open audio device: %s\n", SDL_GetError());
+    SDL_Quit();
     return 1;
   }
 
-  // Start audio playback
+  // fill the ring before starting playback
+  std::thread producer(producerThread, &player);
+  while (player.ring.space() >= BLOCK_SAMPLES && !interrupted) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
   SDL_PauseAudioDevice(audioDevice, 0);
 
-  for (;;) {
+  uint64_t played_limit = max_samples;
+  while (!interrupted) {
     usleep(100000);
-    fprintf(stderr, "\rsamples_generated: %lu\e[K", samples_generated);
+    uint64_t generated = player.samples_generated.load();
+    fprintf(stderr, "\rsamples_generated: %llu  position %d  underruns %llu\e[K",
+            (unsigned long long) generated, player.song_position.load(),
+            (unsigned long long) player.underruns.load());
     fflush(stderr);
-
-    //if (samples_generated >= 48000 * 10) {
-    //  break;
-    //}
+    if (played_limit && generated >= played_limit && player.ring.available() == 0) {
+      break;
+    }
   }
+  fprintf(stderr, "\n");
 
   // Close audio device and quit SDL
   SDL_CloseAudioDevice(audioDevice);
+  player.running = false;
+  producer.join();
   SDL_Quit();
+
+  if (wav_path && !wav.close()) {
+    fprintf(stderr, "Failed to write %s\n", wav_path);
+    return 1;
+  }
+  return 0;
 }
 
+static void usage(const char* argv0) {
+  fprintf(stderr,
+          "usage: %s [--headless] [--wav FILE] [--seconds S] [--start-position P]\n"
+          "  --headless   no audio device; write the WAV as fast as possible\n"
+          "  --wav FILE   record to FILE (headless default audiotrack.wav)\n"
+          "  --seconds S  stop after S seconds of audio (headless default to the\n"
+          "               end of the song, %d positions; live default until Ctrl-C)\n"
+          "  --start-position P\n"
+          "               start at song position P\n",
+          argv0, fm::MUSIC_SONG_LENGTH);
+}
+
+int main(int argc, char** argv) {
+  Verilated::commandArgs(argc, argv);
+
+  bool headless = false;
+  const char* wav_path = nullptr;
+  double seconds = 0;
+  int start_position = 0;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--headless")) {
+      headless = true;
+    } else if (!strcmp(argv[i], "--wav") && i + 1 < argc) {
+      wav_path = argv[++i];
+    } else if (!strcmp(argv[i], "--seconds") && i + 1 < argc) {
+      seconds = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--start-position") && i + 1 < argc) {
+      start_position = atoi(argv[++i]);
+    } else if (argv[i][0] != '+') {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  uint64_t num_samples = (uint64_t) (seconds * fm::SONG_SAMPLE_RATE);
+
+  signal(SIGINT, onSignal);
+  if (headless) {
+    if (!num_samples && start_position < fm::MUSIC_SONG_LENGTH) {
+      num_samples = (uint64_t) (fm::MUSIC_SONG_LENGTH - start_position) * fm::SONG_SAMPLES_PER_POSITION;
+    }
+    return runHeadless(wav_path ? wav_path : "audiotrack.wav", num_samples, start_position);
+  }
+  return runLive(wav_path, num_samples, start_position);
+}
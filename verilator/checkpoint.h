@@ -0,0 +1,136 @@
+// Checkpoints of a Verilated model built with --savable, taken at frame
+// boundaries and kept one file per frame in a directory (DIR/frame_000640.ckpt),
+// so that a run can restore the nearest one at or before the frame it wants
+// instead of simulating from reset.
+//
+// A checkpoint only restores into the same Verilated model it was saved from;
+// after an RTL change the directory has to be regenerated.
+
+#pragma once
+
+#include <dirent.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "verilated_save.h"
+
+template <class Model>
+class CheckpointStore {
+ public:
+  explicit CheckpointStore(const std::string& dir) : dir_(dir) {}
+
+  const std::string& dir() const { return dir_; }
+
+  // Creates the directory if it doesn't exist yet.
+  bool create() const {
+    return mkdir(dir_.c_str(), 0777) == 0 || errno == EEXIST;
+  }
+
+  std::string path(int frame) const {
+    char name[32];
+    snprintf(name, sizeof(name), "/frame_%06d.ckpt", frame);
+    return dir_ + name;
+  }
+
+  // Model state at the start of `frame`. Written to a temporary file and
+  // renamed into place, so an interrupted save never leaves a partial one.
+  bool save(Model* top, int frame) const {
+    std::string tmp = path(frame) + ".tmp";
+    if (!saveTo(top, frame, tmp)) {
+      return false;
+    }
+    return rename(tmp.c_str(), path(frame).c_str()) == 0;
+  }
+
+  bool saveTo(Model* top, int frame, const std::string& filename) const {
+    VerilatedSave os;
+    os.open(filename.c_str());
+    if (!os.isOpen()) {
+      return false;
+    }
+    uint32_t magic = MAGIC;
+    uint32_t f = frame;
+    os << magic << f;
+    os << *top;
+    os.close();
+    return true;
+  }
+
+  // Restores the checkpoint for exactly `frame`. A file saved from a
+  // different model is fatal inside Verilator.
+  bool restore(Model* top, int frame) const {
+    VerilatedRestore os;
+    os.open(path(frame).c_str());
+    if (!os.isOpen()) {
+      return false;
+    }
+    uint32_t magic, f;
+    os >> magic >> f;
+    if (magic != MAGIC || (int) f != frame) {
+      os.close();
+      return false;
+    }
+    os >> *top;
+    os.close();
+    return true;
+  }
+
+  // Frames that have a checkpoint, ascending.
+  std::vector<int> frames() const {
+    std::vector<int> result;
+    DIR* d = opendir(dir_.c_str());
+    if (!d) {
+      return result;
+    }
+    while (struct dirent* entry = readdir(d)) {
+      int frame, len = 0;
+      if (sscanf(entry->d_name, "frame_%d.ckpt%n", &frame, &len) == 1 && len > 0 &&
+          entry->d_name[len] == '\0') {
+        result.push_back(frame);
+      }
+    }
+    closedir(d);
+    std::sort(result.begin(), result.end());
+    return result;
+  }
+
+  // Latest checkpoint at or before frame, or -1 if there is none.
+  int nearest(int frame) const {
+    int best = -1;
+    for (int f : frames()) {
+      if (f <= frame) {
+        best = f;
+      }
+    }
+    return best;
+  }
+
+  // Whether two checkpoint files hold the same state.
+  static bool sameFile(const std::string& a, const std::string& b) {
+    FILE* fa = fopen(a.c_str(), "rb");
+    FILE* fb = fopen(b.c_str(), "rb");
+    bool same = fa && fb;
+    while (same) {
+      char ba[4096], bb[4096];
+      size_t na = fread(ba, 1, sizeof(ba), fa);
+      size_t nb = fread(bb, 1, sizeof(bb), fb);
+      same = na == nb && memcmp(ba, bb, na) == 0;
+      if (na < sizeof(ba)) {
+        break;
+      }
+    }
+    if (fa) fclose(fa);
+    if (fb) fclose(fb);
+    return same;
+  }
+
+ private:
+  static const uint32_t MAGIC = 0x54504b43;  // "CKPT"
+
+  std::string dir_;
+};
@@ -0,0 +1,166 @@
+// Differential check of libfm's MusicModel against the Verilated music module.
+// Both are driven with the same sample/tick schedule and audio_sample,
+// song_position and audio_out are compared after every clock; the first
+// diverging sample is reported.
+//
+// By default only the clocks that carry a sample_clk or tick_clk are
+// simulated. --full-rate runs all 800 clocks per sample, with the enables
+// placed where tt_um_a1k0n_kapton puts them, to also check the DAC.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "Vmusic.h"
+#include "verilated.h"
+#include "libfm/music_model.hpp"
+
+static const int CLOCKS_PER_SAMPLE = 800;
+
+struct Mismatch {
+  uint64_t sample;
+  uint64_t clock;
+  const char* signal;
+  int rtl;
+  int model;
+};
+
+static void clock(Vmusic* top) {
+  top->clk = 0;
+  top->eval();
+  top->clk = 1;
+  top->eval();
+}
+
+static bool compare(Vmusic* top, const fm::MusicModel& model, uint64_t sample, uint64_t clk,
+                    Mismatch* m) {
+  m->sample = sample;
+  m->clock = clk;
+  if (top->audio_sample != model.sample()) {
+    m->signal = "audio_sample";
+    m->rtl = top->audio_sample;
+    m->model = model.sample();
+    return false;
+  }
+  if (top->song_position != model.songPosition()) {
+    m->signal = "song_position";
+    m->rtl = top->song_position;
+    m->model = model.songPosition();
+    return false;
+  }
+  if (top->audio_out != model.audioOut()) {
+    m->signal = "audio_out";
+    m->rtl = top->audio_out;
+    m->model = model.audioOut();
+    return false;
+  }
+  return true;
+}
+
+// One clock edge on both sides. The DAC accumulates the sample from before
+// the edge, so the model steps it before applying the enable.
+static void step(Vmusic* top, fm::MusicModel& model, bool sample_clk, bool tick_clk) {
+  top->sample_clk = sample_clk;
+  top->tick_clk = tick_clk;
+  clock(top);
+  model.clockDac();
+  if (sample_clk) model.sampleClock();
+  if (tick_clk) model.tickClock();
+}
+
+int main(int argc, char** argv) {
+  Verilated::commandArgs(argc, argv);
+
+  std::string data_dir = "../data";
+  uint64_t num_samples = (uint64_t) fm::MUSIC_SONG_LENGTH * fm::SONG_SAMPLES_PER_POSITION;
+  bool full_rate = false;
+  for (int i = 1; i < argc; i++) {
+    if ((!strcmp(argv[i], "-n") || !strcmp(argv[i], "--samples")) && i + 1 < argc) {
+      num_samples = strtoull(argv[++i], NULL, 0);
+    } else if ((!strcmp(argv[i], "-d") || !strcmp(argv[i], "--data")) && i + 1 < argc) {
+      data_dir = argv[++i];
+    } else if (!strcmp(argv[i], "--full-rate")) {
+      full_rate = true;
+    } else if (argv[i][0] != '+') {
+      fprintf(stderr,
+              "usage: %s [-n SAMPLES] [-d DATA_DIR] [--full-rate]\n"
+              "  default: one full song (%llu samples)\n",
+              argv[0], (unsigned long long) num_samples);
+      return 1;
+    }
+  }
+
+  fm::SongData song;
+  std::string error;
+  if (!fm::loadSong(data_dir, &song, &error)) {
+    fprintf(stderr, "Failed to load song: %s\n", error.c_str());
+    return 1;
+  }
+  fm::MusicModel model(song);
+
+  Vmusic* top = new Vmusic;
+  top->sample_clk = 0;
+  top->tick_clk = 0;
+  top->rst_n = 0;
+  clock(top);
+  top->rst_n = 1;
+  model.reset();
+
+  Mismatch mismatch;
+  bool ok = compare(top, model, 0, 0, &mismatch);
+  uint64_t clk = 1;
+  uint64_t sample = 0;
+  auto rtl_start = std::chrono::steady_clock::now();
+  for (int line = 0; ok && sample < num_samples; sample++) {
+    if (full_rate) {
+      for (int x = 0; ok && x < CLOCKS_PER_SAMPLE; x++, clk++) {
+        bool tick = x == CLOCKS_PER_SAMPLE - 1 && line == fm::SONG_SAMPLES_PER_TICK - 1;
+        step(top, model, x == 0, tick);
+        ok = compare(top, model, sample, clk, &mismatch);
+      }
+    } else {
+      step(top, model, true, false);
+      ok = compare(top, model, sample, clk++, &mismatch);
+      if (ok && line == fm::SONG_SAMPLES_PER_TICK - 1) {
+        step(top, model, false, true);
+        ok = compare(top, model, sample, clk++, &mismatch);
+      }
+    }
+    line = line == fm::SONG_SAMPLES_PER_TICK - 1 ? 0 : line + 1;
+  }
+  double rtl_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - rtl_start).count();
+
+  top->final();
+  delete top;
+
+  if (!ok) {
+    printf("MISMATCH at sample %llu (clock %llu, song position %d, tick %d): %s rtl=%d model=%d\n",
+           (unsigned long long) mismatch.sample, (unsigned long long) mismatch.clock,
+           model.songPosition(), model.tickCounter(), mismatch.signal, mismatch.rtl, mismatch.model);
+    printf("model channels: bass=%d melody=%d backup=%d snare=%d\n",
+           model.channelSample(fm::SONG_BASS), model.channelSample(fm::SONG_MELODY),
+           model.channelSample(fm::SONG_BACKUP), model.channelSample(fm::SONG_SNARE));
+    return 1;
+  }
+
+  // time the model on its own over the same span
+  std::vector<uint16_t> buffer(fm::SONG_SAMPLES_PER_POSITION);
+  fm::MusicModel timed(song);
+  auto model_start = std::chrono::steady_clock::now();
+  for (uint64_t done = 0; done < num_samples; done += buffer.size()) {
+    uint64_t n = num_samples - done < buffer.size() ? num_samples - done : buffer.size();
+    timed.render(buffer.data(), (int) n);
+  }
+  double model_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - model_start).count();
+
+  printf("OK: %llu samples (%llu clocks) match\n", (unsigned long long) num_samples,
+         (unsigned long long) clk);
+  printf("rtl:   %.3f s, %.0f samples/s (%s)\n", rtl_seconds, num_samples / rtl_seconds,
+         full_rate ? "800 clocks/sample" : "enable clocks only");
+  printf("model: %.3f s, %.0f samples/s (%.0fx)\n", model_seconds, num_samples / model_seconds,
+         rtl_seconds / model_seconds);
+  return 0;
+}
@@ -0,0 +1,197 @@
+#include "vga_model.h"
+
+#include <string.h>
+#include "libfm/song.hpp"
+
+// tt_um_a1k0n_kapton's parameters
+static const int V_TOTAL = 525;
+static const int LOGO_SIZE = 128;
+static const int LOGO_SPEED = 2;
+static const int INTRO_FRAME_COUNT = 640;
+
+// lfsr_row advances on pix_x 770-798 of every line with circuit_v == 7
+static const int LFSR_ROW_STEPS = 29;
+// Circuit tiles covering pix_x 0-639 when scrolled up to 7 pixels left.
+static const int ROW_TILES = (VgaModel::WIDTH + 7 + 7) / 8;
+
+static uint8_t lfsrStep(uint8_t l) {
+  return ((l << 1) & 0x7f) | (((l >> 6) ^ (l >> 5)) & 1);
+}
+
+// uo_out of a visible pixel: hsync and vsync high, 2 bits per color.
+static uint8_t uoOut(int r, int g, int b) {
+  return 0x88 | ((b & 1) << 6) | ((g & 1) << 5) | ((r & 1) << 4) | ((b >> 1) << 2) | ((g >> 1) << 1) | (r >> 1);
+}
+
+static const uint8_t BLANK = 0x88;
+static const uint8_t BAR = uoOut(1, 1, 2);
+static const uint8_t INTRO_BACKGROUND = uoOut(3, 3, 3);
+static const uint8_t INTRO_LOGO = uoOut(2, 0, 0);
+
+// intro_logo, from transition_index's diagonal wipe
+static bool introAt(int frame_counter, int x, int y) {
+  int dxy = (x + y) & 2047;
+  int transition_index = ((dxy & 15) + (dxy >> 5)) & 63;
+  return ((frame_counter - transition_index) & 8191) < INTRO_FRAME_COUNT;
+}
+
+VgaModel::VgaModel() : frame_(0), logo_(LOGO_SIZE * LOGO_SIZE), samples_(V_TOTAL) {
+  memset(circuit_, 0, sizeof(circuit_));
+  reset();
+}
+
+bool VgaModel::load(const std::string& data_dir, std::string* error) {
+  std::vector<uint32_t> logo, truchet;
+  if (!fm::readMemHex(data_dir + "/logo.hex", &logo) || logo.size() < logo_.size()) {
+    *error = data_dir + "/logo.hex";
+    return false;
+  }
+  if (!fm::readMemHex(data_dir + "/truchet.hex", &truchet) || truchet.size() < 64) {
+    *error = data_dir + "/truchet.hex";
+    return false;
+  }
+  fm::SongData song;
+  if (!fm::loadSong(data_dir, &song, error)) {
+    return false;
+  }
+
+  for (size_t i = 0; i < logo_.size(); i++) {
+    logo_[i] = logo[i] & 1;
+  }
+  for (int kapton = 0; kapton < 2; kapton++) {
+    for (int v = 0; v < 8; v++) {
+      for (int idx = 0; idx < 2; idx++) {
+        for (int u = 0; u < 8; u++) {
+          bool trace = truchet[((idx ? v : 7 - v) << 3) | u] & 1;
+          circuit_[kapton][v][idx][u] = kapton ? uoOut(trace ? 2 : 1, trace ? 3 : 1, 0)
+                                               : uoOut(trace ? 1 : 0, trace ? 3 : 1, trace ? 2 : 1);
+        }
+      }
+    }
+  }
+  music_.reset(new fm::MusicModel(song));
+  reset();
+  return true;
+}
+
+void VgaModel::reset() {
+  state_.frame_counter = 0;
+  state_.lfsr = 0x55;
+  state_.lfsr_frame = 0x55;
+  state_.logo_x = 256;
+  state_.logo_y = 128;
+  state_.logo_dx = false;
+  state_.logo_dy = true;
+  frame_ = 0;
+  if (music_) {
+    music_->reset();
+  }
+}
+
+void VgaModel::seek(int frame) {
+  reset();
+  if (music_) {
+    music_->advance(frame * V_TOTAL);
+  }
+  while (frame_ < frame) {
+    nextFrame();
+  }
+}
+
+// next_frame: every register updates from its value before the edge.
+void VgaModel::nextFrame() {
+  FrameState& s = state_;
+  s.lfsr = s.lfsr_frame;
+  if ((s.frame_counter & 3) == 2) {
+    s.lfsr_frame = lfsrStep(s.lfsr_frame);
+  }
+  s.frame_counter = (s.frame_counter + 1) & 8191;
+
+  int logo_x = (s.logo_x + (s.logo_dx ? LOGO_SPEED : -LOGO_SPEED)) & 1023;
+  int logo_y = (s.logo_y + (s.logo_dy ? LOGO_SPEED : -LOGO_SPEED)) & 1023;
+  if (s.logo_dx && s.logo_x > WIDTH - LOGO_SIZE - 2 * LOGO_SPEED) {
+    s.logo_dx = false;
+  } else if (!s.logo_dx && s.logo_x < 2 * LOGO_SPEED) {
+    s.logo_dx = true;
+  }
+  if (s.logo_dy && s.logo_y > HEIGHT - LOGO_SIZE - 2 * LOGO_SPEED) {
+    s.logo_dy = false;
+  } else if (!s.logo_dy && s.logo_y < 2 * LOGO_SPEED) {
+    s.logo_dy = true;
+  }
+  s.logo_x = logo_x;
+  s.logo_y = logo_y;
+  frame_++;
+}
+
+void VgaModel::renderFrame(uint8_t* pixels) {
+  music_->render(samples_.data(), V_TOTAL);
+
+  // The wipe's transition_index only spans 0-63, so most frames are all
+  // circuit or all intro.
+  int intro_count = 0;
+  for (int t = 0; t < 64; t++) {
+    intro_count += ((state_.frame_counter - t) & 8191) < INTRO_FRAME_COUNT;
+  }
+  Intro intro = intro_count == 0 ? INTRO_NONE : intro_count == 64 ? INTRO_ALL : INTRO_MIXED;
+
+  // Rows only depend on lfsr_row at their start, which advances after every
+  // eighth line.
+  uint8_t lfsr = state_.lfsr;
+  for (int y = 0; y < HEIGHT; y++) {
+    renderRow(y, lfsr, samples_[y], intro, pixels + y * WIDTH);
+    if ((y & 7) == 7) {
+      for (int i = 0; i < LFSR_ROW_STEPS; i++) {
+        lfsr = lfsrStep(lfsr);
+      }
+    }
+  }
+  nextFrame();
+}
+
+void VgaModel::renderRow(int y, uint8_t lfsr, int audio_sample, Intro intro, uint8_t* out) const {
+  const FrameState& s = state_;
+  // circuit_u = (pix_x + 2 * frame_counter) & 7 and lfsr steps after every
+  // pixel with circuit_u == 7, so the circuit is 8-pixel tiles, one lfsr bit
+  // each, starting `scroll` pixels left of the screen. row[scroll + x] is
+  // pix_x = x.
+  uint8_t row[ROW_TILES * 8];
+  const int scroll = (2 * s.frame_counter) & 7;
+  const uint8_t(*tiles)[8] = circuit_[(y >> 6) == 6][y & 7];
+  for (int t = 0; t < ROW_TILES; t++) {
+    memcpy(row + 8 * t, tiles[lfsr & 1], 8);
+    lfsr = lfsrStep(lfsr);
+  }
+  uint8_t* pix = row + scroll;
+
+  if (intro != INTRO_NONE) {
+    bool logo_row = y >= s.logo_y && y < s.logo_y + LOGO_SIZE;
+    const uint8_t* logo = &logo_[((y - s.logo_y) & (LOGO_SIZE - 1)) * LOGO_SIZE];
+    if (intro == INTRO_ALL) {
+      memset(pix, INTRO_BACKGROUND, WIDTH);
+      int end = s.logo_x + LOGO_SIZE < WIDTH ? s.logo_x + LOGO_SIZE : WIDTH;
+      for (int x = s.logo_x; logo_row && x < end; x++) {
+        if (logo[x - s.logo_x]) {
+          pix[x] = INTRO_LOGO;
+        }
+      }
+    } else {
+      for (int x = 0; x < WIDTH; x++) {
+        if (!introAt(s.frame_counter, x, y)) {
+          continue;
+        }
+        bool on = logo_row && x >= s.logo_x && x < s.logo_x + LOGO_SIZE && logo[(x - s.logo_x) & (LOGO_SIZE - 1)];
+        pix[x] = on ? INTRO_LOGO : INTRO_BACKGROUND;
+      }
+    }
+  }
+
+  // the level bar, audio_sample[12:4] pixels wide, covers everything
+  int bar = audio_sample >> 4;
+  if (bar > 0) {
+    memset(pix, BAR, bar < WIDTH ? bar : WIDTH);
+  }
+
+  memcpy(out, pix + 1, WIDTH - 1);
+  out[WIDTH - 1] = BLANK;
+}
@@ -0,0 +1,69 @@
+// Behavioral model of tt_um_a1k0n_kapton's video output. Every visible pixel
+// is a pure function of pix_x, pix_y, the registers next_frame updates and
+// the line's audio_sample, so the model keeps only that per-frame state and
+// renders whole rows at a time instead of clocking 420000 times a frame.
+// Frames are bit-identical to what vgademo_tb captures from the Verilated
+// model, and render in well under a millisecond.
+//
+// audio_sample (the level bar) comes from libfm's MusicModel, clocked once
+// per line like the chip's sample_clk.
+
+#pragma once
+
+#include <stdint.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include "libfm/music_model.hpp"
+
+class VgaModel {
+ public:
+  static const int WIDTH = 640;
+  static const int HEIGHT = 480;
+
+  VgaModel();
+
+  // logo.hex, truchet.hex and the song tables from data_dir (the RTL reads
+  // ../data). Returns false and names the file that failed in *error.
+  bool load(const std::string& data_dir, std::string* error);
+
+  // State after rst_n; load() resets too.
+  void reset();
+  // reset(), then step to the start of `frame`, counted from reset.
+  void seek(int frame);
+  int frame() const { return frame_; }
+
+  // Renders the current frame into WIDTH * HEIGHT uo_out bytes and steps to
+  // the next. The layout is simulateFrame's: uo_out is sampled after each
+  // clock edge, so column h shows pix_x = h + 1 and the last column is blank.
+  void renderFrame(uint8_t* pixels);
+
+ private:
+  // The registers next_frame updates, at pix_x = pix_y = 0.
+  struct FrameState {
+    int frame_counter;  // 13 bits
+    uint8_t lfsr;       // lfsr and lfsr_row: lfsr_frame from before the edge
+    uint8_t lfsr_frame;
+    int logo_x;
+    int logo_y;
+    bool logo_dx;
+    bool logo_dy;
+  };
+
+  enum Intro { INTRO_NONE, INTRO_ALL, INTRO_MIXED };
+
+  void nextFrame();
+  // One visible line given lfsr_row at its start (lfsr's value at pix_x = 0).
+  void renderRow(int y, uint8_t lfsr, int audio_sample, Intro intro, uint8_t* out) const;
+
+  FrameState state_;
+  int frame_;
+
+  // 128x128 logo bitmap, one byte per pixel
+  std::vector<uint8_t> logo_;
+  // circuit colors as uo_out for [kapton_tape][circuit_v][tile idx][circuit_u]
+  uint8_t circuit_[2][8][2][8];
+
+  std::unique_ptr<fm::MusicModel> music_;
+  std::vector<uint16_t> samples_;  // audio_sample on each line of the frame
+};
@@ -1,31 +1,688 @@
+// Verilated tt_um_a1k0n_kapton driven at one pixel per clock. The simulation
+// runs on its own thread and hands finished frames to the SDL thread through
+// a double-buffered FrameQueue, so presenting overlaps simulating the next
+// frame. --headless skips SDL and reports the simulation's throughput.
+// --capture streams frames to disk from a writer thread (FrameCapture).
+// --audio decodes the audio pin back to PCM (AudioPin).
+// --checkpoints saves and restores model snapshots (checkpoint.h) to start at
+// any frame or song position, and --regress simulates the intervals between
+// them in parallel processes.
+// --model renders frames with the behavioral VgaModel instead of Verilator,
+// for previewing, and --check compares every simulated frame against it.
+
+#include <errno.h>
+#include <math.h>
 #include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
 #include "Vtt_um_a1k0n_kapton.h"
 #include "verilated.h"
+#include "checkpoint.h"
+#include "vga_model.h"
+#include "libfm/sigma_delta.hpp"
+#include "libfm/wav_writer.hpp"
 #include <SDL2/SDL.h>
 
 #define H_TOTAL 800
 #define H_DISPLAY 640
 #define V_TOTAL 525
 #define V_DISPLAY 480
+#define FRAME_PIXELS (H_DISPLAY * V_DISPLAY)
+#define FRAME_CLOCKS (H_TOTAL * V_TOTAL)
 
-#undef SAVE_FRAMES
+// VGA pixel clock; the chip runs one clock per pixel
+#define PIXEL_CLOCK_HZ 25175000.0
 
-#if SAVE_FRAMES
-#include <SDL2/SDL_image.h>
-#endif
+// music.v ticks once per frame and advances the song every 5 ticks, so song
+// position p starts at frame 5p
+#define FRAMES_PER_POSITION 5
 
-int main(int argc, char** argv) {
-  Verilated::commandArgs(argc, argv);
+// Frames hold the raw uo_out of every visible pixel; these decode it:
+// assign uo_out = {hsync, B[0], G[0], R[0], vsync, B[1], G[1], R[1]};
+static uint32_t palette[256];     // ARGB8888
+static uint8_t palette_raw[256];  // 2 bits per channel: {B, G, R}
+static uint8_t palette_yuv[256][3];  // BT.601 limited-range Y, Cb, Cr
 
-  Vtt_um_a1k0n_kapton* top = new Vtt_um_a1k0n_kapton;
+static void initPalette() {
+  for (uint32_t uo_out = 0; uo_out < 256; uo_out++) {
+    uint32_t r = ((uo_out&1) << 1) | ((uo_out&16) >> 4);
+    uint32_t g = ((uo_out&2)) | ((uo_out&32) >> 5);
+    uint32_t b = ((uo_out&4) >> 1) | ((uo_out&64) >> 6);
+    palette_raw[uo_out] = r | (g << 2) | (b << 4);
+    double R = r*0x55, G = g*0x55, B = b*0x55;
+    palette_yuv[uo_out][0] = (uint8_t) (16.5 + (65.481*R + 128.553*G + 24.966*B) / 255);
+    palette_yuv[uo_out][1] = (uint8_t) (128.5 + (-37.797*R - 74.203*G + 112.0*B) / 255);
+    palette_yuv[uo_out][2] = (uint8_t) (128.5 + (112.0*R - 93.786*G - 18.214*B) / 255);
+    r = (r*0x55) << 16;
+    g = (g*0x55) << 8;
+    b = b*0x55;
+    palette[uo_out] = 0xFF000000 | r | g | b;
+  }
+}
 
-  top->rst_n = 0;
+static void clock(Vtt_um_a1k0n_kapton* top) {
   top->clk = 0; top->eval(); top->clk = 1; top->eval();
+}
+
+static Vtt_um_a1k0n_kapton* newModel() {
+  Vtt_um_a1k0n_kapton* top = new Vtt_um_a1k0n_kapton;
+  top->rst_n = 0;
+  clock(top);
   top->rst_n = 1;
+  return top;
+}
+
+// Clocks one whole frame (FRAME_CLOCKS clocks), storing uo_out for the
+// visible pixels; decoding is left to whoever consumes the frame. If
+// audio_bits is given (FRAME_CLOCKS / 8 zeroed bytes), uio_out[7], the audio
+// pin, is packed into it one bit per clock.
+static void simulateFrame(Vtt_um_a1k0n_kapton* top, uint8_t* pixels, uint8_t* audio_bits) {
+  int clk = 0;
+  for (int v = 0; v < V_TOTAL; v++) {
+    for (int h = 0; h < H_TOTAL; h++, clk++) {
+      clock(top);
+      if (v < V_DISPLAY && h < H_DISPLAY) {
+        *pixels++ = top->uo_out;
+      }
+      if (audio_bits) {
+        audio_bits[clk >> 3] |= ((top->uio_out >> 7) & 1) << (clk & 7);
+      }
+    }
+  }
+}
+
+// The chip's only audio output is audio_out, a 1-bit sigma-delta stream on
+// uio_out[7]. AudioPin runs each frame's bits through libfm's decimator, one
+// sample per line, and writes the PCM to a WAV at the rate the pin plays it.
+class AudioPin {
+ public:
+  AudioPin() : bits_(FRAME_CLOCKS / 8), pcm_(V_TOTAL + 1), samples_(0), decode_seconds_(0) {}
+
+  bool open(const char* path) {
+    return wav_.open(path, (int) lround(PIXEL_CLOCK_HZ / fm::SIGMA_DELTA_DECIMATION));
+  }
+  bool close() { return wav_.close(); }
+
+  // Zeroed buffer for simulateFrame, then decode() once it is full.
+  uint8_t* frameBits() {
+    memset(bits_.data(), 0, bits_.size());
+    return bits_.data();
+  }
+  void decode() {
+    auto start = std::chrono::steady_clock::now();
+    int n = decimator_.process(bits_.data(), (int) bits_.size(), pcm_.data());
+    decode_seconds_ += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    wav_.write(pcm_.data(), n);
+    samples_ += n;
+  }
+
+  int64_t samples() const { return samples_; }
+  double decodeSeconds() const { return decode_seconds_; }
+  const char* simdLevel() const { return fm::simdLevelName(decimator_.simdLevel()); }
+
+ private:
+  std::vector<uint8_t> bits_;
+  std::vector<int16_t> pcm_;
+  fm::SigmaDeltaDecimator decimator_;
+  fm::WavWriter wav_;
+  int64_t samples_;
+  double decode_seconds_;
+};
+
+// Two frame buffers passed between the simulation thread, which fills one
+// while the presenter shows the other, and the presenter. Frames come out in
+// order; the simulation waits when both are queued.
+class FrameQueue {
+ public:
+  FrameQueue() : write_(0), read_(0), closed_(false) {
+    for (int i = 0; i < 2; i++) {
+      frames_[i].resize(FRAME_PIXELS);
+      state_[i] = FREE;
+    }
+  }
+
+  // Simulation thread: the buffer to draw the next frame into, once the
+  // presenter is done with it; null after close().
+  uint8_t* beginWrite() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cond_.wait(lock, [this] { return closed_ || state_[write_] == FREE; });
+    return closed_ ? nullptr : frames_[write_].data();
+  }
+
+  void endWrite() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    state_[write_] = QUEUED;
+    write_ ^= 1;
+    cond_.notify_all();
+  }
+
+  // Presenter: the oldest queued frame, waiting up to timeout_ms for one;
+  // null if there is none yet.
+  const uint8_t* beginRead(int timeout_ms) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cond_.wait_for(lock, std::chrono::milliseconds(timeout_ms),
+                   [this] { return closed_ || state_[read_] == QUEUED; });
+    if (state_[read_] != QUEUED) {
+      return nullptr;
+    }
+    state_[read_] = SHOWING;
+    return frames_[read_].data();
+  }
+
+  void endRead() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    state_[read_] = FREE;
+    read_ ^= 1;
+    cond_.notify_all();
+  }
+
+  void close() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    closed_ = true;
+    cond_.notify_all();
+  }
+
+  // Presenter: closed with no frame left to show.
+  bool drained() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return closed_ && state_[read_] != QUEUED;
+  }
+
+ private:
+  enum State { FREE, QUEUED, SHOWING };
+
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  std::vector<uint8_t> frames_[2];
+  State state_[2];
+  int write_;
+  int read_;
+  bool closed_;
+};
+
+// Streams a range of frames to a file from its own thread. The simulation
+// only copies each frame into a bounded ring; if the writer falls that far
+// behind, frames are dropped (and counted) rather than stalling it, unless
+// setBlocking() asks to wait for the writer instead.
+//
+// Formats, by file extension:
+//   .y4m  YUV4MPEG2, 4:4:4 at 59.94 fps, for ffmpeg and most players
+//   other raw, one byte per pixel, 2 bits per channel (bits 1:0 R, 3:2 G,
+//         5:4 B), 640x480 frames back to back: 4x smaller than ARGB
+class FrameCapture {
+ public:
+  FrameCapture(int first, int last, int ring_frames)
+      : first_(first), last_(last), ring_(ring_frames), head_(0), count_(0), closing_(false),
+        blocking_(false), file_(nullptr), y4m_(false), written_(0), dropped_(0) {
+    for (std::vector<uint8_t>& frame : ring_) {
+      frame.resize(FRAME_PIXELS);
+    }
+  }
+
+  ~FrameCapture() { close(); }
+
+  bool open(const std::string& path) {
+    file_ = fopen(path.c_str(), "wb");
+    if (!file_) {
+      return false;
+    }
+    y4m_ = path.size() >= 4 && path.compare(path.size() - 4, 4, ".y4m") == 0;
+    if (y4m_) {
+      fprintf(file_, "YUV4MPEG2 W%d H%d F60000:1001 Ip A1:1 C444\n", H_DISPLAY, V_DISPLAY);
+    }
+    writer_ = std::thread(&FrameCapture::writerThread, this);
+    return true;
+  }
+
+  // --model renders faster than frames can be written, and nothing is lost
+  // by waiting for it.
+  void setBlocking(bool blocking) { blocking_ = blocking; }
+
+  bool wants(int frame) const { return frame >= first_ && (last_ < 0 || frame <= last_); }
+  bool done(int frame) const { return last_ >= 0 && frame > last_; }
+
+  // Simulation thread: queues a copy of pixels.
+  void push(const uint8_t* pixels) {
+    int slot;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      if (blocking_) {
+        cond_.wait(lock, [this] { return count_ < (int) ring_.size(); });
+      }
+      if (count_ == (int) ring_.size()) {
+        dropped_++;
+        return;
+      }
+      slot = (head_ + count_) % ring_.size();
+    }
+    // the writer does not touch a slot until it is counted
+    memcpy(ring_[slot].data(), pixels, FRAME_PIXELS);
+    std::lock_guard<std::mutex> lock(mutex_);
+    count_++;
+    cond_.notify_one();
+  }
+
+  // Writes out whatever is queued and closes the file.
+  void close() {
+    if (!file_) {
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      closing_ = true;
+      cond_.notify_one();
+    }
+    writer_.join();
+    fclose(file_);
+    file_ = nullptr;
+  }
+
+  int written() const { return written_; }
+  int dropped() const { return dropped_; }
+
+ private:
+  void writerThread() {
+    std::vector<uint8_t> out(FRAME_PIXELS * 3);
+    for (;;) {
+      int slot;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cond_.wait(lock, [this] { return closing_ || count_ > 0; });
+        if (count_ == 0) {
+          return;
+        }
+        slot = head_;
+      }
+      write(ring_[slot].data(), &out);
+      std::lock_guard<std::mutex> lock(mutex_);
+      head_ = (head_ + 1) % ring_.size();
+      count_--;
+      cond_.notify_one();
+    }
+  }
+
+  void write(const uint8_t* pixels, std::vector<uint8_t>* out) {
+    size_t bytes = FRAME_PIXELS;
+    if (y4m_) {
+      // planar: all Y, then all Cb, then all Cr
+      uint8_t* y = out->data();
+      for (int i = 0; i < FRAME_PIXELS; i++) {
+        const uint8_t* yuv = palette_yuv[pixels[i]];
+        y[i] = yuv[0];
+        y[i + FRAME_PIXELS] = yuv[1];
+        y[i + 2 * FRAME_PIXELS] = yuv[2];
+      }
+      fputs("FRAME\n", file_);
+      bytes *= 3;
+    } else {
+      for (int i = 0; i < FRAME_PIXELS; i++) {
+        (*out)[i] = palette_raw[pixels[i]];
+      }
+    }
+    if (fwrite(out->data(), 1, bytes, file_) == bytes) {
+      written_++;
+    }
+  }
+
+  int first_;
+  int last_;  // -1: no end
+
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  std::vector<std::vector<uint8_t>> ring_;
+  int head_;
+  int count_;
+  bool closing_;
+  bool blocking_;
 
-#if SAVE_FRAMES
-  FILE *rawfp = fopen("video.raw", "wb");
-#endif
+  std::thread writer_;
+  FILE* file_;
+  bool y4m_;
+  int written_;  // writer thread only, read after close()
+  int dropped_;  // simulation thread only
+};
+
+typedef CheckpointStore<Vtt_um_a1k0n_kapton> Checkpoints;
+
+// FNV-1a of a frame, to spot RTL changes that alter the picture.
+static uint32_t frameHash(const uint8_t* pixels) {
+  uint32_t hash = 2166136261u;
+  for (int i = 0; i < FRAME_PIXELS; i++) {
+    hash = (hash ^ palette[pixels[i]]) * 16777619u;
+  }
+  return hash;
+}
+
+// Folds frame hashes into one for a whole run; --headless from reset and
+// --regress over the same frames agree.
+static uint32_t runHash(uint32_t hash, uint32_t frame_hash) {
+  return (hash ^ frame_hash) * 16777619u;
+}
+
+// The model and everything done around each of its frames, on whichever
+// thread is simulating.
+struct Simulation {
+  Vtt_um_a1k0n_kapton* top;  // null with --model
+  VgaModel* model;           // --model renders with it, --check compares
+  int frame;  // next frame to simulate, counted from reset
+  FrameCapture* capture;
+  AudioPin* audio;
+  const Checkpoints* checkpoints;
+  int checkpoint_every;  // 0: don't save
+  int restored_frame;    // the checkpoint we started from, not saved again
+  std::vector<uint8_t> model_pixels;  // --check
+  double model_seconds;
+  int checked_frames;
+  int mismatched_frames;
+};
+
+// --check: renders the same frame with the model and reports the first pixel
+// that differs, for the first few frames that do.
+static void checkFrame(Simulation* sim, const uint8_t* pixels) {
+  sim->model_pixels.resize(FRAME_PIXELS);
+  auto start = std::chrono::steady_clock::now();
+  sim->model->renderFrame(sim->model_pixels.data());
+  sim->model_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  sim->checked_frames++;
+  const uint8_t* expected = sim->model_pixels.data();
+  for (int i = 0; i < FRAME_PIXELS; i++) {
+    if (pixels[i] != expected[i]) {
+      if (sim->mismatched_frames++ < 10) {
+        printf("frame %d: first mismatch at x=%d y=%d: rtl %02x (rgb %06x) model %02x (rgb %06x)\n",
+               sim->frame, i % H_DISPLAY, i / H_DISPLAY, pixels[i], palette[pixels[i]] & 0xffffff,
+               expected[i], palette[expected[i]] & 0xffffff);
+      }
+      break;
+    }
+  }
+}
+
+static void stepFrame(Simulation* sim, uint8_t* pixels) {
+  if (!sim->top) {
+    auto start = std::chrono::steady_clock::now();
+    sim->model->renderFrame(pixels);
+    sim->model_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  } else {
+    if (sim->checkpoint_every && sim->frame % sim->checkpoint_every == 0 &&
+        sim->frame != sim->restored_frame) {
+      if (!sim->checkpoints->save(sim->top, sim->frame)) {
+        fprintf(stderr, "Failed to save %s\n", sim->checkpoints->path(sim->frame).c_str());
+      }
+    }
+    simulateFrame(sim->top, pixels, sim->audio ? sim->audio->frameBits() : nullptr);
+    if (sim->model) {
+      checkFrame(sim, pixels);
+    }
+  }
+  if (sim->capture && sim->capture->wants(sim->frame)) {
+    sim->capture->push(pixels);
+  }
+  if (sim->audio) {
+    sim->audio->decode();
+  }
+  sim->frame++;
+}
+
+// Restores the latest checkpoint at or before `frame`, or stays at reset if
+// there is none, then simulates the rest of the way without capture or audio.
+// VgaModel seeks directly.
+static void seekFrame(Simulation* sim, int frame) {
+  if (!sim->top) {
+    sim->model->seek(frame);
+    sim->frame = frame;
+    return;
+  }
+  int from = sim->checkpoints ? sim->checkpoints->nearest(frame) : -1;
+  if (from > 0) {
+    if (sim->checkpoints->restore(sim->top, from)) {
+      sim->frame = from;
+      sim->restored_frame = from;
+      printf("restored %s\n", sim->checkpoints->path(from).c_str());
+    } else {
+      fprintf(stderr, "Failed to restore %s, starting from reset\n",
+              sim->checkpoints->path(from).c_str());
+    }
+  }
+  if (sim->frame < frame) {
+    printf("simulating frames %d-%d to reach frame %d\n", sim->frame, frame - 1, frame);
+  }
+  FrameCapture* capture = sim->capture;
+  AudioPin* audio = sim->audio;
+  VgaModel* model = sim->model;
+  sim->capture = nullptr;
+  sim->audio = nullptr;
+  sim->model = nullptr;
+  std::vector<uint8_t> pixels(FRAME_PIXELS);
+  while (sim->frame < frame) {
+    stepFrame(sim, pixels.data());
+  }
+  sim->capture = capture;
+  sim->audio = audio;
+  sim->model = model;
+  if (model) {
+    model->seek(sim->frame);
+  }
+}
+
+// The end of --capture-range has been written; nothing more to record.
+static bool captureDone(const Simulation* sim) {
+  return sim->capture && sim->capture->done(sim->frame);
+}
+
+static void simulationThread(Simulation* sim, FrameQueue* queue) {
+  while (!captureDone(sim)) {
+    uint8_t* pixels = queue->beginWrite();
+    if (!pixels) {
+      return;
+    }
+    stepFrame(sim, pixels);
+    queue->endWrite();
+  }
+  queue->close();
+}
+
+// --regress: the frames between consecutive checkpoints (and from reset to
+// the first) are independent, so each interval runs in its own process with
+// its own model. Each shard sends back its frame hashes and whether its final
+// state matches the checkpoint the next interval starts from.
+enum ShardStatus : uint8_t {
+  SHARD_OPEN_END,  // no checkpoint at the end to compare with
+  SHARD_MATCH,
+  SHARD_DIVERGED,
+  SHARD_RESTORE_FAILED,
+};
+
+static void runShard(const Checkpoints& checkpoints, int first, int last, int fd) {
+  Vtt_um_a1k0n_kapton* top = newModel();
+  uint8_t status = SHARD_OPEN_END;
+  if (first > 0 && !checkpoints.restore(top, first)) {
+    status = SHARD_RESTORE_FAILED;
+    last = first;
+  }
+  std::vector<uint8_t> pixels(FRAME_PIXELS);
+  for (int frame = first; frame < last; frame++) {
+    simulateFrame(top, pixels.data(), nullptr);
+    uint32_t hash = frameHash(pixels.data());
+    if (write(fd, &hash, sizeof(hash)) != sizeof(hash)) {
+      _exit(1);
+    }
+  }
+  if (status == SHARD_OPEN_END && access(checkpoints.path(last).c_str(), F_OK) == 0) {
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), ".shard%d", (int) getpid());
+    std::string mine = checkpoints.path(last) + suffix;
+    bool same = checkpoints.saveTo(top, last, mine) && Checkpoints::sameFile(mine, checkpoints.path(last));
+    unlink(mine.c_str());
+    status = same ? SHARD_MATCH : SHARD_DIVERGED;
+  }
+  if (write(fd, &status, 1) != 1) {
+    _exit(1);
+  }
+  top->final();
+  _exit(0);
+}
+
+struct Shard {
+  int first;
+  int last;
+  pid_t pid;
+  int fd;
+};
+
+static bool readAll(int fd, void* buffer, size_t size) {
+  uint8_t* p = (uint8_t*) buffer;
+  while (size) {
+    ssize_t n = read(fd, p, size);
+    if (n <= 0) {
+      return false;
+    }
+    p += n;
+    size -= n;
+  }
+  return true;
+}
+
+static int runRegress(const Checkpoints& checkpoints, int frames, int max_shards) {
+  std::vector<Shard> shards;
+  for (int frame : checkpoints.frames()) {
+    if (frame > 0 && frame < frames) {
+      shards.push_back({frame, 0, 0, -1});
+    }
+  }
+  shards.insert(shards.begin(), {0, 0, 0, -1});
+  for (size_t i = 0; i < shards.size(); i++) {
+    shards[i].last = i + 1 < shards.size() ? shards[i + 1].first : frames;
+  }
+  printf("%d frames in %d intervals, %d at a time\n", frames, (int) shards.size(), max_shards);
+  fflush(stdout);
+
+  auto start = std::chrono::steady_clock::now();
+  size_t launched = 0;
+  auto launch = [&]() {
+    Shard& shard = shards[launched++];
+    int fds[2];
+    if (pipe(fds) != 0) {
+      perror("pipe");
+      exit(1);
+    }
+    shard.pid = fork();
+    if (shard.pid == 0) {
+      close(fds[0]);
+      runShard(checkpoints, shard.first, shard.last, fds[1]);
+    }
+    close(fds[1]);
+    shard.fd = fds[0];
+  };
+
+  // collect in order, keeping up to max_shards running
+  int failures = 0;
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < shards.size(); i++) {
+    while (launched < shards.size() && launched < i + max_shards) {
+      launch();
+    }
+    Shard& shard = shards[i];
+    std::vector<uint32_t> hashes(shard.last - shard.first);
+    uint8_t status = SHARD_RESTORE_FAILED;
+    bool ok = readAll(shard.fd, hashes.data(), hashes.size() * sizeof(uint32_t)) &&
+              readAll(shard.fd, &status, 1);
+    close(shard.fd);
+    int wstatus;
+    waitpid(shard.pid, &wstatus, 0);
+    if (!ok && status != SHARD_RESTORE_FAILED) {
+      status = SHARD_RESTORE_FAILED;
+    }
+    const char* result = !ok                            ? "FAILED"
+                         : status == SHARD_MATCH        ? "matches the next checkpoint"
+                         : status == SHARD_DIVERGED     ? "DIVERGED from the next checkpoint"
+                                                        : "ok";
+    if (!ok || status == SHARD_DIVERGED) {
+      failures++;
+    }
+    for (uint32_t h : hashes) {
+      hash = runHash(hash, h);
+    }
+    printf("frames %d-%d: last frame hash %08x, %s\n", shard.first, shard.last - 1,
+           hashes.empty() ? 0 : hashes.back(), result);
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  printf("%d frames in %.3f s, %.2f frames/s\n", frames, seconds, frames / seconds);
+  printf("run hash %08x\n", hash);
+  return failures ? 1 : 0;
+}
+
+static void usage(const char* argv0) {
+  fprintf(stderr,
+          "usage: %s [--headless] [--frames N] [--capture FILE [--capture-range FIRST-LAST]]\n"
+          "          [--audio FILE] [--checkpoints DIR [--checkpoint-every N]]\n"
+          "          [--start-frame F | --start-position P] [--regress [--shards N]]\n"
+          "          [--model | --check] [--data DIR]\n"
+          "  --headless       no window; simulate and report clocks/s and frames/s\n"
+          "  --frames N       stop after N frames (headless default 60, or the\n"
+          "                   end of the capture range)\n"
+          "  --capture FILE   record frames to FILE: .y4m, or else 1 byte/pixel raw\n"
+          "  --capture-range FIRST-LAST\n"
+          "                   frames to record, counted from 0 (default all;\n"
+          "                   FIRST- for no end); the run ends after LAST\n"
+          "  --capture-buffers N\n"
+          "                   frames the writer may fall behind before frames\n"
+          "                   are dropped (default 16)\n"
+          "  --audio FILE     decode the audio pin (uio_out[7]) to a WAV\n"
+          "  --checkpoints DIR\n"
+          "                   directory of model snapshots to start from and save to\n"
+          "  --checkpoint-every N\n"
+          "                   save a snapshot at every Nth frame\n"
+          "  --start-frame F  start at frame F, from the nearest snapshot at or before it\n"
+          "  --start-position P\n"
+          "                   start at song position P (frame %d * P)\n"
+          "  --regress        simulate frames 0 to --frames (default: the last\n"
+          "                   snapshot) as parallel intervals between snapshots,\n"
+          "                   checking each against the next; prints the run hash\n"
+          "  --shards N       intervals to run at once (default: one per core)\n"
+          "  --model          render with the C++ VgaModel instead of simulating\n"
+          "  --check          simulate and compare every frame against VgaModel\n"
+          "  --data DIR       VgaModel's logo, truchet and song tables (default ../data)\n",
+          argv0, FRAMES_PER_POSITION);
+}
+
+static int runHeadless(Simulation* sim, int frames) {
+  std::vector<uint8_t> pixels(FRAME_PIXELS);
+  uint32_t hash = 2166136261u;
+  auto start = std::chrono::steady_clock::now();
+  int i = 0;
+  for (; i < frames && !captureDone(sim); i++) {
+    stepFrame(sim, pixels.data());
+    hash = runHash(hash, frameHash(pixels.data()));
+  }
+  frames = i;
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  double clocks = (double) frames * H_TOTAL * V_TOTAL;
+  printf("%d frames (%.0f clocks) in %.3f s\n", frames, clocks, seconds);
+  printf("%.0f clocks/s, %.2f frames/s, %.4fx real time\n", clocks / seconds, frames / seconds,
+         clocks / seconds / PIXEL_CLOCK_HZ);
+  printf("last frame hash %08x\n", frameHash(pixels.data()));
+  printf("run hash %08x (frames %d-%d)\n", hash, sim->frame - frames, sim->frame - 1);
+  if (sim->audio) {
+    printf("audio decoding (%s): %.3f s, %.1f%% of the run\n", sim->audio->simdLevel(),
+           sim->audio->decodeSeconds(), 100 * sim->audio->decodeSeconds() / seconds);
+  }
+  if (sim->model && frames > 0) {
+    printf("VgaModel: %.3f ms/frame\n", 1000 * sim->model_seconds / frames);
+  }
+  return 0;
+}
+
+static int runWindow(Simulation* sim, int max_frames) {
   // Initialize SDL
   if (SDL_Init(SDL_INIT_VIDEO) != 0) {
     SDL_Log("Failed to initialize SDL: %s", SDL_GetError());
@@ -59,10 +716,13 @@ int main(int argc, char** argv) {
     return 1;
   }
 
-  // Main loop
+  FrameQueue queue;
+  std::thread simulation(simulationThread, sim, &queue);
+
+  // Main loop: present frames as the simulation finishes them
   bool quit = false;
   int frame = 0;
-  while (!quit) {
+  while (!quit && (max_frames == 0 || frame < max_frames)) {
     // Handle events
     SDL_Event event;
     while (SDL_PollEvent(&event)) {
@@ -71,48 +731,38 @@ int main(int argc, char** argv) {
       }
     }
 
+    // short timeout so events keep being handled while the sim is busy
+    const uint8_t* frame_pixels = queue.beginRead(10);
+    if (!frame_pixels) {
+      if (queue.drained()) {
+        break;  // the capture range is written
+      }
+      continue;
+    }
+
     // Get a framebuffer pointer
     uint32_t* pixels;
     int pitch;
     int ret = SDL_LockTexture(texture, nullptr, (void**)&pixels, &pitch);
     if (ret != 0) {
       SDL_Log("Failed to lock texture: %s", SDL_GetError());
+      queue.endRead();
       break;
     }
 
     if (pitch != H_DISPLAY*4) {
       SDL_Log("Unexpected pitch: %d", pitch);
+      SDL_UnlockTexture(texture);
+      queue.endRead();
       break;
     }
 
-    int k = 0;
-    for(int v = 0; v < V_TOTAL; v++) {
-      for(int h = 0; h < H_TOTAL; h++) {
-        // clock the system
-        top->clk = 0; top->eval(); top->clk = 1; top->eval();
-        if (v < V_DISPLAY && h < H_DISPLAY) {
-          // assign uo_out = {hsync, B[0], G[0], R[0], vsync, B[1], G[1], R[1]};
-          uint32_t uo_out = top->uo_out;
-          uint32_t r = ((uo_out&1) << 1) | ((uo_out&16) >> 4);
-          uint32_t g = ((uo_out&2)) | ((uo_out&32) >> 5);
-          uint32_t b = ((uo_out&4) >> 1) | ((uo_out&64) >> 6);
-          r = (r*0x55) << 16;
-          g = (g*0x55) << 8;
-          b = b*0x55;
-          uint32_t color = 0xFF000000 | r | g | b;
-          pixels[k++] = color;
-        }
-      }
-    }
-
-#if SAVE_FRAMES
-    // Save the frame to a file
-    if (rawfp) {
-      fwrite(pixels, sizeof(uint32_t), H_DISPLAY*V_DISPLAY, rawfp);
+    for (int i = 0; i < FRAME_PIXELS; i++) {
+      pixels[i] = palette[frame_pixels[i]];
     }
-#endif
+    queue.endRead();
     frame++;
-    
+
     // Unlock the texture
     SDL_UnlockTexture(texture);
 
@@ -122,6 +772,9 @@ int main(int argc, char** argv) {
     SDL_RenderPresent(renderer);
   }
 
+  queue.close();
+  simulation.join();
+
   // Cleanup
   SDL_DestroyRenderer(renderer);
   SDL_DestroyWindow(window);
@@ -129,3 +782,193 @@ int main(int argc, char** argv) {
 
   return 0;
 }
+
+int main(int argc, char** argv) {
+  Verilated::commandArgs(argc, argv);
+
+  bool headless = false;
+  int max_frames = 0;  // 0: until the window is closed
+  const char* capture_path = nullptr;
+  int capture_first = 0;
+  int capture_last = -1;
+  int capture_buffers = 16;
+  const char* audio_path = nullptr;
+  const char* checkpoint_dir = nullptr;
+  int checkpoint_every = 0;
+  int start_frame = 0;
+  bool regress = false;
+  bool use_model = false;
+  bool check = false;
+  std::string data_dir = "../data";
+  int max_shards = (int) std::thread::hardware_concurrency();
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--headless")) {
+      headless = true;
+    } else if (!strcmp(argv[i], "--frames") && i + 1 < argc) {
+      max_frames = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--capture") && i + 1 < argc) {
+      capture_path = argv[++i];
+    } else if (!strcmp(argv[i], "--capture-range") && i + 1 < argc) {
+      char* end;
+      capture_first = strtol(argv[++i], &end, 10);
+      if (*end != '-') {
+        usage(argv[0]);
+        return 1;
+      }
+      capture_last = end[1] ? atoi(end + 1) : -1;
+    } else if (!strcmp(argv[i], "--capture-buffers") && i + 1 < argc) {
+      capture_buffers = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--audio") && i + 1 < argc) {
+      audio_path = argv[++i];
+    } else if (!strcmp(argv[i], "--checkpoints") && i + 1 < argc) {
+      checkpoint_dir = argv[++i];
+    } else if (!strcmp(argv[i], "--checkpoint-every") && i + 1 < argc) {
+      checkpoint_every = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--start-frame") && i + 1 < argc) {
+      start_frame = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--start-position") && i + 1 < argc) {
+      start_frame = atoi(argv[++i]) * FRAMES_PER_POSITION;
+    } else if (!strcmp(argv[i], "--regress")) {
+      regress = true;
+    } else if (!strcmp(argv[i], "--shards") && i + 1 < argc) {
+      max_shards = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--model")) {
+      use_model = true;
+    } else if (!strcmp(argv[i], "--check")) {
+      check = true;
+    } else if (!strcmp(argv[i], "--data") && i + 1 < argc) {
+      data_dir = argv[++i];
+    } else if (argv[i][0] != '+') {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (capture_buffers < 1) {
+    capture_buffers = 1;
+  }
+  if (max_shards < 1) {
+    max_shards = 1;
+  }
+  if (((checkpoint_every > 0 || regress) && !checkpoint_dir) || checkpoint_every < 0 || start_frame < 0) {
+    usage(argv[0]);
+    return 1;
+  }
+  // the model has no audio pin or Verilator state
+  if ((use_model && (check || audio_path || checkpoint_dir)) || (check && regress)) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  initPalette();
+
+  Checkpoints* checkpoints = nullptr;
+  if (checkpoint_dir) {
+    checkpoints = new Checkpoints(checkpoint_dir);
+    if (checkpoint_every > 0 && !checkpoints->create()) {
+      fprintf(stderr, "Failed to create %s: %s\n", checkpoint_dir, strerror(errno));
+      return 1;
+    }
+  }
+
+  if (regress) {
+    int frames = max_frames;
+    if (frames <= 0) {
+      std::vector<int> saved = checkpoints->frames();
+      if (saved.empty()) {
+        fprintf(stderr, "No checkpoints in %s; make some with --checkpoint-every\n", checkpoint_dir);
+        return 1;
+      }
+      frames = saved.back();
+    }
+    int ret = runRegress(*checkpoints, frames, max_shards);
+    delete checkpoints;
+    return ret;
+  }
+
+  FrameCapture* capture = nullptr;
+  if (capture_path) {
+    capture = new FrameCapture(capture_first, capture_last, capture_buffers);
+    capture->setBlocking(use_model);
+    if (!capture->open(capture_path)) {
+      fprintf(stderr, "Failed to open %s: %s\n", capture_path, strerror(errno));
+      return 1;
+    }
+  }
+
+  AudioPin* audio = nullptr;
+  if (audio_path) {
+    audio = new AudioPin;
+    if (!audio->open(audio_path)) {
+      fprintf(stderr, "Failed to open %s: %s\n", audio_path, strerror(errno));
+      return 1;
+    }
+  }
+
+  VgaModel* model = nullptr;
+  if (use_model || check) {
+    model = new VgaModel;
+    std::string error;
+    if (!model->load(data_dir, &error)) {
+      fprintf(stderr, "Failed to load %s\n", error.c_str());
+      return 1;
+    }
+  }
+
+  Simulation sim;
+  sim.top = use_model ? nullptr : newModel();
+  sim.model = model;
+  sim.frame = 0;
+  sim.capture = capture;
+  sim.audio = audio;
+  sim.checkpoints = checkpoints;
+  sim.checkpoint_every = checkpoint_every;
+  sim.restored_frame = -1;
+  sim.model_seconds = 0;
+  sim.checked_frames = 0;
+  sim.mismatched_frames = 0;
+  seekFrame(&sim, start_frame);
+
+  int ret = 0;
+  if (headless) {
+    int frames = max_frames;
+    if (frames <= 0) {
+      frames = capture && capture_last >= start_frame ? capture_last + 1 - start_frame : 60;
+    }
+    ret = runHeadless(&sim, frames);
+  } else {
+    ret = runWindow(&sim, max_frames);
+  }
+  if (sim.top) {
+    sim.top->final();
+    delete sim.top;
+  }
+  delete checkpoints;
+  delete model;
+
+  if (check) {
+    printf("model check: %d of %d frames differ\n", sim.mismatched_frames, sim.checked_frames);
+    if (sim.mismatched_frames) {
+      ret = 1;
+    }
+  }
+
+  if (capture) {
+    capture->close();
+    printf("captured %d frames to %s", capture->written(), capture_path);
+    if (capture->dropped()) {
+      printf(", DROPPED %d (raise --capture-buffers)", capture->dropped());
+    }
+    printf("\n");
+    delete capture;
+  }
+  if (audio) {
+    if (!audio->close()) {
+      fprintf(stderr, "Failed to write %s\n", audio_path);
+      ret = 1;
+    } else {
+      printf("decoded %lld audio samples to %s\n", (long long) audio->samples(), audio_path);
+    }
+    delete audio;
+  }
+  return ret;
+}